@@ -0,0 +1,159 @@
+#include "backendLoad.h"
+#include "requestStats.h"
+#include "loguru.hpp"
+#include <algorithm>
+#include <inttypes.h>
+#include <utility>
+#include <vector>
+
+void CBackendLoad::submit(EQueryPriority priority, Task &&task)
+{
+  int64_t now = monotonicTimeUs();
+  uint64_t ticket;
+  {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    if (priority != qpCritical && slotsFull()) {
+      Lanes_[priority].push_back(CWaitingTask{std::move(task), now});
+      return;
+    }
+
+    ticket = NextTicket_++;
+    Pending_.emplace_hint(Pending_.end(), ticket, CPendingQuery{now, false});
+  }
+
+  task(ticket);
+}
+
+void CBackendLoad::leave(uint64_t ticket)
+{
+  int64_t now = monotonicTimeUs();
+  Task task;
+  uint64_t nextTicket;
+  {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    auto It = Pending_.find(ticket);
+    if (It != Pending_.end()) {
+      if (It->second.TimedOut)
+        TimedOutPending_--;
+      Pending_.erase(It);
+    }
+    StartedTicket_ = std::max(StartedTicket_, ticket + 1);
+    if (!popNext(now, task, nextTicket))
+      return;
+  }
+
+  task(nextTicket);
+}
+
+void CBackendLoad::expire()
+{
+  if (!Timeout_)
+    return;
+
+  int64_t now = monotonicTimeUs();
+  size_t expired = 0;
+  std::vector<std::pair<Task, uint64_t>> tasks;
+  {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    for (auto &query: Pending_) {
+      if (!query.second.TimedOut && now - query.second.Time >= Timeout_) {
+        query.second.TimedOut = true;
+        TimedOutPending_++;
+        expired++;
+      }
+    }
+
+    Task task;
+    uint64_t ticket;
+    while (popNext(now, task, ticket))
+      tasks.emplace_back(std::move(task), ticket);
+  }
+
+  if (expired) {
+    TimedOut_.fetch_add(expired, std::memory_order_relaxed);
+    LOG_F(WARNING, "backend loop didn't answer %zu API queries in %" PRIi64 " ms", expired, Timeout_ / 1000);
+  }
+
+  for (auto &task: tasks)
+    task.first(task.second);
+}
+
+bool CBackendLoad::popNext(int64_t now, Task &task, uint64_t &ticket)
+{
+  if (slotsFull())
+    return false;
+
+  std::deque<CWaitingTask> *lane = nullptr;
+  std::deque<CWaitingTask> &interactive = Lanes_[qpInteractive];
+  std::deque<CWaitingTask> &bulk = Lanes_[qpBulk];
+  if (!bulk.empty() && (interactive.empty() || now - bulk.front().Time >= AgingTime_))
+    lane = &bulk;
+  else if (!interactive.empty())
+    lane = &interactive;
+  else
+    return false;
+
+  task = std::move(lane->front().Function);
+  lane->pop_front();
+  ticket = NextTicket_++;
+  Pending_.emplace_hint(Pending_.end(), ticket, CPendingQuery{now, false});
+  return true;
+}
+
+int64_t CBackendLoad::oldestTime()
+{
+  auto It = Pending_.lower_bound(StartedTicket_);
+  int64_t time = It != Pending_.end() ? It->second.Time : 0;
+  for (const auto &lane: Lanes_) {
+    if (!lane.empty() && (!time || lane.front().Time < time))
+      time = lane.front().Time;
+  }
+
+  return time;
+}
+
+size_t CBackendLoad::queueDepth()
+{
+  std::lock_guard<std::mutex> lock(Mutex_);
+  size_t depth = Pending_.size();
+  for (const auto &lane: Lanes_)
+    depth += lane.size();
+  return depth;
+}
+
+int64_t CBackendLoad::oldestAge()
+{
+  int64_t now = monotonicTimeUs();
+  std::lock_guard<std::mutex> lock(Mutex_);
+  int64_t time = oldestTime();
+  return time ? now - time : 0;
+}
+
+bool CBackendLoad::overloaded(size_t maxDepth, int64_t maxAge)
+{
+  int64_t now = monotonicTimeUs();
+  size_t depth;
+  int64_t age;
+  bool stateChanged;
+  bool overloaded;
+  {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    depth = Pending_.size();
+    for (const auto &lane: Lanes_)
+      depth += lane.size();
+    int64_t time = oldestTime();
+    age = time ? now - time : 0;
+    overloaded = (maxDepth && depth >= maxDepth) || (maxAge && age >= maxAge);
+    stateChanged = overloaded != Overloaded_;
+    Overloaded_ = overloaded;
+  }
+
+  if (stateChanged) {
+    if (overloaded)
+      LOG_F(WARNING, "backend loop overloaded: %zu queries in queue, oldest not started %" PRIi64 " ms ago, shedding API queries", depth, age / 1000);
+    else
+      LOG_F(INFO, "backend loop load is normal now: %zu queries in queue", depth);
+  }
+
+  return overloaded;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+
+// Share accounting, round finalisation and payouts run inside poolcore backend loops and are not submitted here;
+// lanes order API queries only, which are limited so that loop work isn't delayed behind them
+enum EQueryPriority {
+  // Account management and payouts, never delayed or shed
+  qpCritical = 0,
+  // Dashboard queries, small and latency sensitive
+  qpInteractive,
+  // Exports and history queries
+  qpBulk,
+  qpLanesNum
+};
+
+// Queries sent by HTTP layer to one backend event loop (accounting or statistic)
+// Backend loops process tasks in FIFO order together with share accounting, so only limited number of
+// API queries is submitted at once; others wait in priority lanes, interactive lane first.
+// Bulk query waiting longer than aging time is submitted before interactive ones (starvation protection).
+// Load is measured by queries not started by backend loop yet: waiting in lanes or submitted after the last
+// answered one (loop is FIFO, so earlier ones are running or done); one slow query doesn't mean loop lag.
+class CBackendLoad {
+public:
+  // Task must issue exactly one backend query and call leave(ticket) from its callback
+  typedef std::function<void(uint64_t ticket)> Task;
+
+public:
+  // timeout equal to 0 disables expiration of unanswered queries
+  CBackendLoad(unsigned maxConcurrency, int64_t agingTime, int64_t timeout) : MaxConcurrency_(maxConcurrency), AgingTime_(agingTime), Timeout_(timeout) {}
+
+  // Run task now if loop has free slot or enqueue it
+  void submit(EQueryPriority priority, Task &&task);
+  void leave(uint64_t ticket);
+  // Marks queries not answered in timeout, called periodically
+  // Timed out query keeps its slot until leave(): it can be just slow because loop is busy. If callback is lost,
+  // up to maxConcurrency extra slots are given for timed out queries, so API queries don't stop forever.
+  void expire();
+
+  // Submitted and waiting queries
+  size_t queueDepth();
+  // Age of oldest query not started by backend loop in microseconds
+  int64_t oldestAge();
+  // maxDepth or maxAge equal to 0 disables corresponding check
+  bool overloaded(size_t maxDepth, int64_t maxAge);
+  // API query rejected with 'busy' and event stream update skipped because of overload
+  void queryShed() { Shed_.fetch_add(1, std::memory_order_relaxed); }
+  void eventSkipped() { EventsSkipped_.fetch_add(1, std::memory_order_relaxed); }
+
+  uint64_t shed() const { return Shed_.load(std::memory_order_relaxed); }
+  uint64_t eventsSkipped() const { return EventsSkipped_.load(std::memory_order_relaxed); }
+  uint64_t timedOut() const { return TimedOut_.load(std::memory_order_relaxed); }
+
+private:
+  struct CWaitingTask {
+    Task Function;
+    int64_t Time;
+  };
+
+  struct CPendingQuery {
+    int64_t Time;
+    bool TimedOut;
+  };
+
+private:
+  // Must be called with locked mutex
+  bool slotsFull() const {
+    return MaxConcurrency_ && Pending_.size() >= MaxConcurrency_ + std::min<size_t>(TimedOutPending_, MaxConcurrency_);
+  }
+  // Must be called with locked mutex, returns task which must be run after unlock
+  bool popNext(int64_t now, Task &task, uint64_t &ticket);
+  int64_t oldestTime();
+
+private:
+  unsigned MaxConcurrency_;
+  int64_t AgingTime_;
+  int64_t Timeout_;
+  std::mutex Mutex_;
+  uint64_t NextTicket_ = 0;
+  // Tickets below this one are started by backend loop
+  uint64_t StartedTicket_ = 0;
+  std::map<uint64_t, CPendingQuery> Pending_;
+  // Timed out queries in Pending_
+  size_t TimedOutPending_ = 0;
+  std::deque<CWaitingTask> Lanes_[qpLanesNum];
+  std::atomic<uint64_t> Shed_ = 0;
+  std::atomic<uint64_t> EventsSkipped_ = 0;
+  std::atomic<uint64_t> TimedOut_ = 0;
+  bool Overloaded_ = false;
+};
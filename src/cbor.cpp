@@ -0,0 +1,203 @@
+#include "cbor.h"
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <cmath>
+#include <stdlib.h>
+#include <string.h>
+
+enum ECborMajorType {
+  cmtUnsigned = 0,
+  cmtNegative = 1,
+  cmtText = 3
+};
+
+static inline bool tokencasecmp(const char *data, size_t size, const char *token)
+{
+  size_t tokenSize = strlen(token);
+  if (size != tokenSize)
+    return false;
+  for (size_t i = 0; i < size; i++) {
+    if (tolower(static_cast<unsigned char>(data[i])) != token[i])
+      return false;
+  }
+  return true;
+}
+
+EReplyFormat selectReplyFormat(const char *data, size_t size)
+{
+  double cborWeight = 0.0;
+  double jsonWeight = 0.0;
+  const char *p = data;
+  const char *end = data + size;
+  while (p < end) {
+    // Element format: <type>/<subtype>[;q=<weight>]
+    const char *elementEnd = static_cast<const char*>(memchr(p, ',', end - p));
+    if (!elementEnd)
+      elementEnd = end;
+
+    const char *typeEnd = static_cast<const char*>(memchr(p, ';', elementEnd - p));
+    if (!typeEnd)
+      typeEnd = elementEnd;
+
+    while (p < typeEnd && isspace(static_cast<unsigned char>(*p)))
+      p++;
+    const char *typeLast = typeEnd;
+    while (typeLast > p && isspace(static_cast<unsigned char>(typeLast[-1])))
+      typeLast--;
+
+    double weight = 1.0;
+    for (const char *q = typeEnd; q + 2 < elementEnd; q++) {
+      if ((*q == 'q' || *q == 'Q') && q[1] == '=') {
+        char buffer[16] = {0};
+        memcpy(buffer, q + 2, std::min<size_t>(elementEnd - (q + 2), sizeof(buffer) - 1));
+        weight = strtod(buffer, nullptr);
+        break;
+      }
+    }
+
+    if (tokencasecmp(p, typeLast - p, "application/cbor"))
+      cborWeight = weight;
+    else if (tokencasecmp(p, typeLast - p, "application/json"))
+      jsonWeight = weight;
+
+    p = elementEnd + 1;
+  }
+
+  // JSON is the default for equal weights
+  return cborWeight > 0.0 && cborWeight > jsonWeight ? rfCbor : rfJson;
+}
+
+const char *replyFormatContentType(EReplyFormat format)
+{
+  return format == rfCbor ? "application/cbor" : "application/json";
+}
+
+namespace CBOR {
+
+static inline void writeHead(xmstream &stream, unsigned majorType, uint64_t value)
+{
+  uint8_t buffer[9];
+  size_t argumentSize;
+  uint8_t major = static_cast<uint8_t>(majorType << 5);
+  if (value < 24) {
+    buffer[0] = major | static_cast<uint8_t>(value);
+    argumentSize = 0;
+  } else if (value <= 0xFF) {
+    buffer[0] = major | 24;
+    argumentSize = 1;
+  } else if (value <= 0xFFFF) {
+    buffer[0] = major | 25;
+    argumentSize = 2;
+  } else if (value <= 0xFFFFFFFF) {
+    buffer[0] = major | 26;
+    argumentSize = 4;
+  } else {
+    buffer[0] = major | 27;
+    argumentSize = 8;
+  }
+
+  // Big endian argument
+  for (size_t i = argumentSize; i >= 1; i--, value >>= 8)
+    buffer[i] = static_cast<uint8_t>(value);
+  stream.write(buffer, argumentSize + 1);
+}
+
+// Half precision bits of float if conversion is exact
+static inline bool halfExact(float value, uint16_t *half)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+  int exponent = static_cast<int>((bits >> 23) & 0xFF) - 127;
+  uint32_t mantissa = bits & 0x7FFFFF;
+
+  if ((bits & 0x7FFFFFFF) == 0) {
+    *half = sign;
+    return true;
+  }
+
+  if (exponent >= -14 && exponent <= 15) {
+    if (mantissa & 0x1FFF)
+      return false;
+    *half = sign | static_cast<uint16_t>((exponent + 15) << 10) | static_cast<uint16_t>(mantissa >> 13);
+    return true;
+  }
+
+  if (exponent >= -24 && exponent < -14) {
+    // Subnormal half: significand * 2^-24
+    uint32_t significand = mantissa | 0x800000;
+    unsigned shift = static_cast<unsigned>(-1 - exponent);
+    if (significand & ((1u << shift) - 1))
+      return false;
+    *half = sign | static_cast<uint16_t>(significand >> shift);
+    return true;
+  }
+
+  return false;
+}
+
+void writeInt(xmstream &stream, int64_t value)
+{
+  if (value >= 0)
+    writeHead(stream, cmtUnsigned, static_cast<uint64_t>(value));
+  else
+    writeHead(stream, cmtNegative, static_cast<uint64_t>(-(value + 1)));
+}
+
+void writeDouble(xmstream &stream, double value)
+{
+  uint8_t buffer[9];
+  if (std::isnan(value)) {
+    const uint8_t nan[] = {0xF9, 0x7E, 0x00};
+    stream.write(nan, sizeof(nan));
+    return;
+  }
+
+  float single = std::fabs(value) <= FLT_MAX || std::isinf(value) ? static_cast<float>(value) : 0.0f;
+  if (static_cast<double>(single) == value) {
+    uint16_t half;
+    if (std::isinf(single)) {
+      half = std::signbit(single) ? 0xFC00 : 0x7C00;
+    } else if (!halfExact(single, &half)) {
+      uint32_t bits;
+      memcpy(&bits, &single, sizeof(bits));
+      buffer[0] = 0xFA;
+      for (size_t i = 4; i >= 1; i--, bits >>= 8)
+        buffer[i] = static_cast<uint8_t>(bits);
+      stream.write(buffer, 5);
+      return;
+    }
+
+    buffer[0] = 0xF9;
+    buffer[1] = static_cast<uint8_t>(half >> 8);
+    buffer[2] = static_cast<uint8_t>(half);
+    stream.write(buffer, 3);
+    return;
+  }
+
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  buffer[0] = 0xFB;
+  for (size_t i = 8; i >= 1; i--, bits >>= 8)
+    buffer[i] = static_cast<uint8_t>(bits);
+  stream.write(buffer, 9);
+}
+
+void writeString(xmstream &stream, std::string_view value)
+{
+  writeHead(stream, cmtText, value.size());
+  stream.write(value.data(), value.size());
+}
+
+void writeBoolean(xmstream &stream, bool value)
+{
+  stream.write(static_cast<uint8_t>(value ? 0xF5 : 0xF4));
+}
+
+void writeNull(xmstream &stream)
+{
+  stream.write(static_cast<uint8_t>(0xF6));
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "p2putils/xmstream.h"
+#include <string_view>
+#include <stdint.h>
+
+enum EReplyFormat {
+  rfJson = 0,
+  rfCbor
+};
+
+// Choose reply format from Accept header value, CBOR only if preferred over JSON
+EReplyFormat selectReplyFormat(const char *data, size_t size);
+const char *replyFormatContentType(EReplyFormat format);
+
+// CBOR (RFC 8949) encoder with the interface of JSON::Object/JSON::Array, so the same serializer
+// code produces both formats. Maps and arrays have indefinite length and closed by destructor like
+// JSON brackets; numbers use the shortest exact encoding (doubles may become half or single floats)
+namespace CBOR {
+
+void writeInt(xmstream &stream, int64_t value);
+void writeDouble(xmstream &stream, double value);
+void writeString(xmstream &stream, std::string_view value);
+void writeBoolean(xmstream &stream, bool value);
+void writeNull(xmstream &stream);
+
+class Object {
+public:
+  Object(xmstream &stream) : Stream_(stream) { Stream_.write(static_cast<uint8_t>(0xBF)); }
+  ~Object() { Stream_.write(static_cast<uint8_t>(0xFF)); }
+
+  void addField(const char *name) { writeString(Stream_, name); }
+  void addString(const char *name, std::string_view value) { addField(name); writeString(Stream_, value); }
+  void addInt(const char *name, int64_t value) { addField(name); writeInt(Stream_, value); }
+  void addDouble(const char *name, double value) { addField(name); writeDouble(Stream_, value); }
+  void addBoolean(const char *name, bool value) { addField(name); writeBoolean(Stream_, value); }
+  void addNull(const char *name) { addField(name); writeNull(Stream_); }
+
+private:
+  xmstream &Stream_;
+};
+
+class Array {
+public:
+  Array(xmstream &stream) : Stream_(stream) { Stream_.write(static_cast<uint8_t>(0x9F)); }
+  ~Array() { Stream_.write(static_cast<uint8_t>(0xFF)); }
+
+  // Elements have no separators
+  void addField() {}
+  void addString(std::string_view value) { writeString(Stream_, value); }
+  void addInt(int64_t value) { writeInt(Stream_, value); }
+  void addDouble(double value) { writeDouble(Stream_, value); }
+
+private:
+  xmstream &Stream_;
+};
+
+}
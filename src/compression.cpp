@@ -0,0 +1,132 @@
+#include "compression.h"
+#include <algorithm>
+#include <cctype>
+#include <stdlib.h>
+#include <string.h>
+
+static inline bool tokencasecmp(const char *data, size_t size, const char *token)
+{
+  size_t tokenSize = strlen(token);
+  if (size != tokenSize)
+    return false;
+  for (size_t i = 0; i < size; i++) {
+    if (tolower(static_cast<unsigned char>(data[i])) != token[i])
+      return false;
+  }
+  return true;
+}
+
+EContentEncoding selectContentEncoding(const char *data, size_t size)
+{
+  // Weights of listed codings, -1 if coding is not listed; '*' applies to codings not listed explicitly
+  double gzip = -1.0;
+  double deflate = -1.0;
+  double any = -1.0;
+  const char *p = data;
+  const char *end = data + size;
+  while (p < end) {
+    // Element format: <coding>[;q=<weight>]
+    const char *elementEnd = static_cast<const char*>(memchr(p, ',', end - p));
+    if (!elementEnd)
+      elementEnd = end;
+
+    const char *codingEnd = static_cast<const char*>(memchr(p, ';', elementEnd - p));
+    if (!codingEnd)
+      codingEnd = elementEnd;
+
+    while (p < codingEnd && isspace(static_cast<unsigned char>(*p)))
+      p++;
+    const char *codingLast = codingEnd;
+    while (codingLast > p && isspace(static_cast<unsigned char>(codingLast[-1])))
+      codingLast--;
+
+    double weight = 1.0;
+    for (const char *q = codingEnd; q + 2 < elementEnd; q++) {
+      if ((*q == 'q' || *q == 'Q') && q[1] == '=') {
+        char buffer[16] = {0};
+        size_t weightSize = std::min<size_t>(elementEnd - (q + 2), sizeof(buffer) - 1);
+        memcpy(buffer, q + 2, weightSize);
+        weight = strtod(buffer, nullptr);
+        break;
+      }
+    }
+
+    if (tokencasecmp(p, codingLast - p, "gzip"))
+      gzip = weight;
+    else if (tokencasecmp(p, codingLast - p, "deflate"))
+      deflate = weight;
+    else if (tokencasecmp(p, codingLast - p, "*"))
+      any = weight;
+
+    p = elementEnd + 1;
+  }
+
+  if (gzip < 0.0)
+    gzip = any;
+  if (deflate < 0.0)
+    deflate = any;
+
+  // Coding with zero weight is not acceptable, gzip preferred if weights are equal
+  if (gzip > 0.0 && gzip >= deflate)
+    return ceGzip;
+  if (deflate > 0.0)
+    return ceDeflate;
+  return ceIdentity;
+}
+
+const char *contentEncodingName(EContentEncoding encoding)
+{
+  switch (encoding) {
+    case ceGzip : return "gzip";
+    case ceDeflate : return "deflate";
+    default : return "identity";
+  }
+}
+
+CCompressor::~CCompressor()
+{
+  if (Initialized_)
+    deflateEnd(&Stream_);
+}
+
+bool CCompressor::init(EContentEncoding encoding, int level)
+{
+  if (Initialized_) {
+    if (Encoding_ == encoding && Level_ == level)
+      return deflateReset(&Stream_) == Z_OK;
+    deflateEnd(&Stream_);
+    Initialized_ = false;
+  }
+
+  // windowBits+16 selects gzip wrapper
+  memset(&Stream_, 0, sizeof(Stream_));
+  int windowBits = encoding == ceGzip ? 15 + 16 : 15;
+  if (deflateInit2(&Stream_, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    return false;
+
+  Encoding_ = encoding;
+  Level_ = level;
+  Initialized_ = true;
+  return true;
+}
+
+void CCompressor::write(xmstream &out, const void *data, size_t size, bool finish)
+{
+  Stream_.next_in = static_cast<Bytef*>(const_cast<void*>(data));
+  Stream_.avail_in = static_cast<uInt>(size);
+  int flush = finish ? Z_FINISH : Z_SYNC_FLUSH;
+  for (;;) {
+    size_t available = deflateBound(&Stream_, Stream_.avail_in) + 16;
+    uint8_t *ptr = out.reserve<uint8_t>(available);
+    Stream_.next_out = ptr;
+    Stream_.avail_out = static_cast<uInt>(available);
+    int result = deflate(&Stream_, flush);
+    // Return unused space back
+    out.seekSet(out.offsetOf() - Stream_.avail_out);
+    out.truncate();
+    if (result == Z_STREAM_END || result == Z_STREAM_ERROR)
+      break;
+    if (Stream_.avail_in == 0 && Stream_.avail_out != 0)
+      break;
+  }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "p2putils/xmstream.h"
+#include <zlib.h>
+
+enum EContentEncoding {
+  ceIdentity = 0,
+  ceGzip,
+  ceDeflate
+};
+
+// Choose best supported encoding from Accept-Encoding header value
+EContentEncoding selectContentEncoding(const char *data, size_t size);
+const char *contentEncodingName(EContentEncoding encoding);
+
+// zlib deflate stream producing gzip or zlib ("deflate" in HTTP terms) format
+class CCompressor {
+public:
+  CCompressor() {}
+  CCompressor(const CCompressor&) = delete;
+  CCompressor &operator=(const CCompressor&) = delete;
+  ~CCompressor();
+
+  // Initialize new stream or reset existing one with same encoding
+  bool init(EContentEncoding encoding, int level);
+  // Compress data and append result to output
+  // Without 'finish' output is flushed to byte boundary, so it can be sent to client immediately
+  void write(xmstream &out, const void *data, size_t size, bool finish);
+
+private:
+  z_stream Stream_;
+  EContentEncoding Encoding_ = ceIdentity;
+  int Level_ = 0;
+  bool Initialized_ = false;
+};
@@ -300,7 +300,27 @@ bool CPoolFrontendConfig::load(rapidjson::Document &document, std::string &error
     jsonParseBoolean(object, "isMaster", &IsMaster, &error, localPath, errorDescription);
     jsonParseUInt(object, "httpPort", &HttpPort, &error, localPath, errorDescription);
     jsonParseUInt(object, "workerThreadsNum", &WorkerThreadsNum, 0, &error, localPath, errorDescription);
+    jsonParseUInt(object, "eventLoopStallThreshold", &EventLoopStallThreshold, 500, &error, localPath, errorDescription);
     jsonParseUInt(object, "httpThreadsNum", &HttpThreadsNum, 0, &error, localPath, errorDescription);
+    jsonParseUInt(object, "httpQueryThreadsNum", &HttpQueryThreadsNum, 2, &error, localPath, errorDescription);
+    jsonParseUInt(object, "httpKeepAliveTimeout", &HttpKeepAliveTimeout, 60, &error, localPath, errorDescription);
+    jsonParseUInt(object, "httpMaxRequestsPerConnection", &HttpMaxRequestsPerConnection, 1000, &error, localPath, errorDescription);
+    jsonParseUInt(object, "httpCacheTTL", &HttpCacheTTL, 5, &error, localPath, errorDescription);
+    jsonParseUInt(object, "httpCompressionLevel", &HttpCompressionLevel, 6, &error, localPath, errorDescription);
+    jsonParseUInt(object, "httpCompressionThreshold", &HttpCompressionThreshold, 1024, &error, localPath, errorDescription);
+    jsonParseDouble(object, "httpRateLimitPerIp", &HttpRateLimitPerIp, 0.0, &error, localPath, errorDescription);
+    jsonParseDouble(object, "httpRateLimitPerSession", &HttpRateLimitPerSession, 10.0, &error, localPath, errorDescription);
+    jsonParseDouble(object, "httpRateLimitBurst", &HttpRateLimitBurst, 100.0, &error, localPath, errorDescription);
+    jsonParseUInt(object, "httpMaxInFlightRequests", &HttpMaxInFlightRequests, 1024, &error, localPath, errorDescription);
+    jsonParseUInt(object, "httpBackendMaxQueueDepth", &HttpBackendMaxQueueDepth, 256, &error, localPath, errorDescription);
+    jsonParseUInt(object, "httpBackendMaxQueueAge", &HttpBackendMaxQueueAge, 2000, &error, localPath, errorDescription);
+    jsonParseUInt(object, "httpBackendMaxConcurrency", &HttpBackendMaxConcurrency, 8, &error, localPath, errorDescription);
+    jsonParseUInt(object, "httpBackendQueryTimeout", &HttpBackendQueryTimeout, 30000, &error, localPath, errorDescription);
+    jsonParseUInt(object, "httpBulkQueryAgingTime", &HttpBulkQueryAgingTime, 1000, &error, localPath, errorDescription);
+    jsonParseUInt(object, "httpEventStreamInterval", &HttpEventStreamInterval, 5, &error, localPath, errorDescription);
+    jsonParseUInt(object, "httpSessionCacheTTL", &HttpSessionCacheTTL, 10, &error, localPath, errorDescription);
+    jsonParseUInt(object, "httpTraceSampleInterval", &HttpTraceSampleInterval, 0, &error, localPath, errorDescription);
+    jsonParseUInt(object, "httpTraceBufferSize", &HttpTraceBufferSize, 256, &error, localPath, errorDescription);
     jsonParseString(object, "adminPasswordHash", AdminPasswordHash, "", &error, localPath, errorDescription);
     jsonParseString(object, "observerPasswordHash", ObserverPasswordHash, "", &error, localPath, errorDescription);
     jsonParseString(object, "dbPath", DbPath, &error, localPath, errorDescription);
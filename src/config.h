@@ -76,7 +76,28 @@ struct CPoolFrontendConfig {
   bool IsMaster;
   unsigned HttpPort;
   unsigned WorkerThreadsNum;
+  unsigned EventLoopStallThreshold;
   unsigned HttpThreadsNum;
+  unsigned HttpQueryThreadsNum;
+  unsigned HttpKeepAliveTimeout;
+  unsigned HttpMaxRequestsPerConnection;
+  unsigned HttpCacheTTL;
+  unsigned HttpCompressionLevel;
+  unsigned HttpCompressionThreshold;
+  // Disabled by default: behind reverse proxy all clients share its address
+  double HttpRateLimitPerIp;
+  double HttpRateLimitPerSession;
+  double HttpRateLimitBurst;
+  unsigned HttpMaxInFlightRequests;
+  unsigned HttpBackendMaxQueueDepth;
+  unsigned HttpBackendMaxQueueAge;
+  unsigned HttpBackendMaxConcurrency;
+  unsigned HttpBackendQueryTimeout;
+  unsigned HttpBulkQueryAgingTime;
+  unsigned HttpEventStreamInterval;
+  unsigned HttpSessionCacheTTL;
+  unsigned HttpTraceSampleInterval;
+  unsigned HttpTraceBufferSize;
   std::string AdminPasswordHash;
   std::string ObserverPasswordHash;
   std::string DbPath;
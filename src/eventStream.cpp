@@ -0,0 +1,167 @@
+#include "eventStream.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+static CEventFrame makeChunk(const char *prefix, const void *data, size_t size)
+{
+  // Frame is a complete chunk of 'Transfer-Encoding: chunked' reply
+  size_t prefixSize = strlen(prefix);
+  size_t payloadSize = prefixSize + size + 2;
+  char hex[16];
+  int hexSize = snprintf(hex, sizeof(hex), "%zx\r\n", payloadSize);
+
+  std::string *frame = new std::string;
+  frame->reserve(hexSize + payloadSize + 2);
+  frame->append(hex, hexSize);
+  frame->append(prefix, prefixSize);
+  frame->append(static_cast<const char*>(data), size);
+  frame->append("\n\n\r\n", 4);
+  return CEventFrame(frame);
+}
+
+CEventFrame CEventStream::makeFrame(const char *event, const void *data, size_t size)
+{
+  std::string prefix = "event: ";
+  prefix.append(event);
+  prefix.append("\ndata: ");
+  return makeChunk(prefix.c_str(), data, size);
+}
+
+CEventFrame CEventStream::makeComment(const char *text)
+{
+  return makeChunk(": ", text, strlen(text));
+}
+
+void CEventStream::subscribe(CEventSubscriber *subscriber, const std::vector<std::string> &topics)
+{
+  std::lock_guard<std::mutex> lock(Mutex_);
+  std::vector<std::string> &subscriberTopics = Subscribers_[subscriber];
+  for (const auto &topic: topics) {
+    if (std::find(subscriberTopics.begin(), subscriberTopics.end(), topic) != subscriberTopics.end())
+      continue;
+    subscriberTopics.push_back(topic);
+    Topics_[topic].push_back(subscriber);
+  }
+}
+
+std::vector<std::string> CEventStream::topics()
+{
+  std::vector<std::string> result;
+  std::lock_guard<std::mutex> lock(Mutex_);
+  result.reserve(Topics_.size());
+  for (const auto &topic: Topics_)
+    result.push_back(topic.first);
+  return result;
+}
+
+void CEventStream::publish(const std::string &topic, const CEventFrame &frame)
+{
+  // Socket writes can take time, don't block other publishers and subscribe calls
+  std::vector<CEventSubscriber*> subscribers;
+  {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    auto It = Topics_.find(topic);
+    if (It == Topics_.end())
+      return;
+    subscribers = It->second;
+    acquire(subscribers);
+  }
+
+  std::vector<CEventSubscriber*> closed;
+  for (CEventSubscriber *subscriber: subscribers) {
+    if (subscriber->pushEvent(frame))
+      FramesSent_.fetch_add(1, std::memory_order_relaxed);
+    else
+      closed.push_back(subscriber);
+  }
+
+  finish(subscribers, closed);
+}
+
+void CEventStream::publishAll(const CEventFrame &frame)
+{
+  std::vector<CEventSubscriber*> subscribers;
+  {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    subscribers.reserve(Subscribers_.size());
+    for (const auto &subscriber: Subscribers_)
+      subscribers.push_back(subscriber.first);
+    acquire(subscribers);
+  }
+
+  std::vector<CEventSubscriber*> closed;
+  for (CEventSubscriber *subscriber: subscribers) {
+    if (!subscriber->pushEvent(frame))
+      closed.push_back(subscriber);
+  }
+
+  finish(subscribers, closed);
+}
+
+void CEventStream::collect()
+{
+  std::vector<CEventSubscriber*> subscribers;
+  {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    subscribers.reserve(Subscribers_.size());
+    for (const auto &subscriber: Subscribers_)
+      subscribers.push_back(subscriber.first);
+    acquire(subscribers);
+  }
+
+  std::vector<CEventSubscriber*> closed;
+  for (CEventSubscriber *subscriber: subscribers) {
+    if (subscriber->eventStreamClosed())
+      closed.push_back(subscriber);
+  }
+
+  finish(subscribers, closed);
+}
+
+size_t CEventStream::subscribersNum()
+{
+  std::lock_guard<std::mutex> lock(Mutex_);
+  return Subscribers_.size();
+}
+
+bool CEventStream::remove(CEventSubscriber *subscriber)
+{
+  auto It = Subscribers_.find(subscriber);
+  if (It == Subscribers_.end())
+    return false;
+
+  for (const auto &topic: It->second) {
+    auto topicIt = Topics_.find(topic);
+    if (topicIt == Topics_.end())
+      continue;
+    std::vector<CEventSubscriber*> &subscribers = topicIt->second;
+    subscribers.erase(std::remove(subscribers.begin(), subscribers.end(), subscriber), subscribers.end());
+    if (subscribers.empty())
+      Topics_.erase(topicIt);
+  }
+
+  Subscribers_.erase(It);
+  return true;
+}
+
+void CEventStream::acquire(const std::vector<CEventSubscriber*> &subscribers)
+{
+  for (CEventSubscriber *subscriber: subscribers)
+    subscriber->acquireSubscriber();
+}
+
+void CEventStream::finish(std::vector<CEventSubscriber*> &subscribers, std::vector<CEventSubscriber*> &closed)
+{
+  if (!closed.empty()) {
+    // Concurrent publish can find same subscriber closed, only one of them holds registry reference
+    std::lock_guard<std::mutex> lock(Mutex_);
+    closed.erase(std::remove_if(closed.begin(), closed.end(), [this](CEventSubscriber *subscriber) { return !remove(subscriber); }), closed.end());
+  }
+
+  // Subscriber can be destroyed here, registry lock must not be held
+  for (CEventSubscriber *subscriber: closed)
+    subscriber->releaseSubscriber();
+  for (CEventSubscriber *subscriber: subscribers)
+    subscriber->releaseSubscriber();
+}
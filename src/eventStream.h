@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+// Serialized Server-Sent Events frame (HTTP chunk with 'event' and 'data' lines)
+typedef std::shared_ptr<const std::string> CEventFrame;
+
+// Long-lived connection receiving event frames
+class CEventSubscriber {
+public:
+  virtual ~CEventSubscriber() {}
+  // Called without registry lock; returns false if subscriber is gone
+  virtual bool pushEvent(const CEventFrame &frame) = 0;
+  // Called once per tick without registry lock, subscriber can re-check its access rights here
+  virtual bool eventStreamClosed() = 0;
+  // Registry holds one reference while subscriber registered and one per publish in progress
+  virtual void acquireSubscriber() = 0;
+  virtual void releaseSubscriber() = 0;
+};
+
+// Topics registry; every update serialized once and same frame sent to all topic subscribers
+class CEventStream {
+public:
+  static CEventFrame makeFrame(const char *event, const void *data, size_t size);
+  static CEventFrame makeComment(const char *text);
+
+  void subscribe(CEventSubscriber *subscriber, const std::vector<std::string> &topics);
+  // Topics having at least one subscriber
+  std::vector<std::string> topics();
+  void publish(const std::string &topic, const CEventFrame &frame);
+  void publishAll(const CEventFrame &frame);
+  // Remove subscribers with closed connections
+  void collect();
+
+  size_t subscribersNum();
+  uint64_t framesSent() const { return FramesSent_.load(std::memory_order_relaxed); }
+
+private:
+  // Must be called with locked mutex
+  bool remove(CEventSubscriber *subscriber);
+  void acquire(const std::vector<CEventSubscriber*> &subscribers);
+  // Unregisters closed subscribers and releases all references taken by acquire
+  void finish(std::vector<CEventSubscriber*> &subscribers, std::vector<CEventSubscriber*> &closed);
+
+private:
+  std::mutex Mutex_;
+  std::unordered_map<std::string, std::vector<CEventSubscriber*>> Topics_;
+  std::unordered_map<CEventSubscriber*, std::vector<std::string>> Subscribers_;
+  std::atomic<uint64_t> FramesSent_ = 0;
+};
@@ -0,0 +1,291 @@
+#include "fastJson.h"
+#include "poolcommon/utils.h"
+#include <atomic>
+#include <cmath>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FASTJSON_SSE2
+#endif
+
+namespace FastJSON {
+
+static const char digitPairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static const uint64_t pow10Table[] = {
+  1ULL,
+  10ULL,
+  100ULL,
+  1000ULL,
+  10000ULL,
+  100000ULL,
+  1000000ULL,
+  10000000ULL,
+  100000000ULL,
+  1000000000ULL,
+  10000000000ULL,
+  100000000000ULL,
+  1000000000000ULL,
+  10000000000000ULL,
+  100000000000000ULL,
+  1000000000000000ULL,
+  10000000000000000ULL,
+  100000000000000000ULL,
+  1000000000000000000ULL
+};
+
+// Scaled doubles below this bound are rounded by multiplication: error of product is less than 2^-9,
+// ties closer than RoundingGuard go to snprintf
+static constexpr double FastDoubleLimit = 1e12;
+static constexpr double RoundingGuard = 1.0 / 256;
+
+// Format of poolcommon JSON::Object/JSON::Array and FormatMoney, fastjsontest compares outputs on every build:
+// no spaces around separators, doubles printed by "%.3f", strings escape quote, backslash and newline
+// by backslash and other control characters as \u00XX; money has at least two fractional digits
+static constexpr unsigned Precision = 3;
+static constexpr unsigned MoneyMinFraction = 2;
+
+static std::atomic<bool> gEnabled = true;
+
+static inline char *formatUnsigned(char *end, uint64_t value)
+{
+  char *p = end;
+  while (value >= 100) {
+    unsigned pair = static_cast<unsigned>(value % 100) * 2;
+    value /= 100;
+    p -= 2;
+    p[0] = digitPairs[pair];
+    p[1] = digitPairs[pair + 1];
+  }
+
+  if (value >= 10) {
+    unsigned pair = static_cast<unsigned>(value) * 2;
+    p -= 2;
+    p[0] = digitPairs[pair];
+    p[1] = digitPairs[pair + 1];
+  } else {
+    *--p = static_cast<char>('0' + value);
+  }
+
+  return p;
+}
+
+// Writes exactly 'digits' digits of value with leading zeros
+static inline void formatFixedWidth(char *out, uint64_t value, unsigned digits)
+{
+  char *p = out + digits;
+  while (p - out >= 2) {
+    unsigned pair = static_cast<unsigned>(value % 100) * 2;
+    value /= 100;
+    p -= 2;
+    p[0] = digitPairs[pair];
+    p[1] = digitPairs[pair + 1];
+  }
+  if (p != out)
+    *--p = static_cast<char>('0' + value % 10);
+}
+
+static bool isPowerOf10(int64_t value, unsigned *digits)
+{
+  for (unsigned i = 1; i < sizeof(pow10Table) / sizeof(pow10Table[0]); i++) {
+    if (static_cast<uint64_t>(value) == pow10Table[i]) {
+      *digits = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+void writeInt(xmstream &stream, int64_t value)
+{
+  char buffer[24];
+  char *end = buffer + sizeof(buffer);
+  uint64_t absValue = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+  char *p = formatUnsigned(end, absValue);
+  if (value < 0)
+    *--p = '-';
+  stream.write(p, end - p);
+}
+
+void writeDouble(xmstream &stream, double value)
+{
+  double absValue = std::fabs(value);
+  double scaled = absValue * static_cast<double>(pow10Table[Precision]);
+  double integral = std::floor(scaled);
+  double fraction = scaled - integral;
+  // NaN and infinity fail first comparison
+  if (!(scaled < FastDoubleLimit) || std::fabs(fraction - 0.5) < RoundingGuard) {
+    char buffer[512];
+    int size = snprintf(buffer, sizeof(buffer), "%.*f", static_cast<int>(Precision), value);
+    stream.write(buffer, static_cast<size_t>(size) < sizeof(buffer) ? size : sizeof(buffer) - 1);
+    return;
+  }
+
+  uint64_t rounded = static_cast<uint64_t>(integral) + (fraction > 0.5 ? 1 : 0);
+  char buffer[48];
+  char *end = buffer + sizeof(buffer);
+  char *p = end - Precision;
+  formatFixedWidth(p, rounded % pow10Table[Precision], Precision);
+  *--p = '.';
+  p = formatUnsigned(p, rounded / pow10Table[Precision]);
+  if (std::signbit(value))
+    *--p = '-';
+  stream.write(p, end - p);
+}
+
+static inline bool needsEscape(uint8_t c)
+{
+  return c < 0x20 || c == '\"' || c == '\\';
+}
+
+static inline size_t findEscape(const char *data, size_t size)
+{
+  size_t i = 0;
+#ifdef FASTJSON_SSE2
+  const __m128i quote = _mm_set1_epi8('\"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control = _mm_set1_epi8(0x1F);
+  for (; i + 16 <= size; i += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    __m128i flags = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+    flags = _mm_or_si128(flags, _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+    if (_mm_movemask_epi8(flags))
+      break;
+  }
+#else
+  const uint64_t ones = 0x0101010101010101ULL;
+  const uint64_t highBits = 0x8080808080808080ULL;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+    uint64_t quote = word ^ (ones * '\"');
+    uint64_t backslash = word ^ (ones * '\\');
+    uint64_t flags = ((quote - ones) & ~quote) |
+                     ((backslash - ones) & ~backslash) |
+                     ((word - ones * 0x20) & ~word);
+    if (flags & highBits)
+      break;
+  }
+#endif
+
+  for (; i < size; i++) {
+    if (needsEscape(static_cast<uint8_t>(data[i])))
+      break;
+  }
+  return i;
+}
+
+void writeString(xmstream &stream, std::string_view value)
+{
+  static const char hexDigits[] = "0123456789abcdef";
+  stream.write('\"');
+  const char *data = value.data();
+  size_t size = value.size();
+  for (;;) {
+    size_t clean = findEscape(data, size);
+    stream.write(data, clean);
+    if (clean == size)
+      break;
+
+    uint8_t c = static_cast<uint8_t>(data[clean]);
+    if (c == '\"') {
+      stream.write("\\\"", 2);
+    } else if (c == '\\') {
+      stream.write("\\\\", 2);
+    } else if (c == '\n') {
+      stream.write("\\n", 2);
+    } else {
+      char escape[6] = {'\\', 'u', '0', '0', hexDigits[c >> 4], hexDigits[c & 0xF]};
+      stream.write(escape, sizeof(escape));
+    }
+    data += clean + 1;
+    size -= clean + 1;
+  }
+  stream.write('\"');
+}
+
+void writeMoney(xmstream &stream, int64_t value, int64_t rationalPartSize)
+{
+  unsigned digits;
+  if (value == INT64_MIN || !isPowerOf10(rationalPartSize, &digits) || digits < MoneyMinFraction) {
+    std::string money = FormatMoney(value, rationalPartSize);
+    stream.write('\"');
+    stream.write(money.data(), money.size());
+    stream.write('\"');
+    return;
+  }
+
+  uint64_t absValue = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+  char buffer[48];
+  char *end = buffer + sizeof(buffer);
+  char *fraction = end - digits;
+  formatFixedWidth(fraction, absValue % pow10Table[digits], digits);
+  char *fractionEnd = end;
+  while (fractionEnd - fraction > static_cast<ptrdiff_t>(MoneyMinFraction) && fractionEnd[-1] == '0')
+    fractionEnd--;
+
+  char *p = fraction;
+  *--p = '.';
+  p = formatUnsigned(p, absValue / pow10Table[digits]);
+  if (value < 0)
+    *--p = '-';
+  *--p = '\"';
+  stream.write(p, fractionEnd - p);
+  stream.write('\"');
+}
+
+void Object::addField(const char *name)
+{
+  if (!First_)
+    Stream_.write(',');
+  First_ = false;
+  Stream_.write('\"');
+  Stream_.write(name, strlen(name));
+  Stream_.write("\":", 2);
+}
+
+void Object::addBoolean(const char *name, bool value)
+{
+  addField(name);
+  if (value)
+    Stream_.write("true", 4);
+  else
+    Stream_.write("false", 5);
+}
+
+void Object::addNull(const char *name)
+{
+  addField(name);
+  Stream_.write("null", 4);
+}
+
+void Array::addField()
+{
+  if (!First_)
+    Stream_.write(',');
+  First_ = false;
+}
+
+bool enabled()
+{
+  return gEnabled.load(std::memory_order_relaxed);
+}
+
+void setEnabled(bool enabled)
+{
+  gEnabled = enabled;
+}
+
+}
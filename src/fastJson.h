@@ -0,0 +1,56 @@
+#pragma once
+
+#include "p2putils/xmstream.h"
+#include <string_view>
+#include <stdint.h>
+
+// Serializer for data-heavy replies with the same output as poolcommon JSON::Object/JSON::Array
+// Numbers are formatted with digit pair table instead of printf, money without FormatMoney string,
+// strings are copied by SSE2 (or 8-byte word) blocks up to character which needs escaping.
+// Output format is fixed, fastjsontest (runs after build) fails if poolcommon output differs
+namespace FastJSON {
+
+bool enabled();
+// Force JSON::Object path, for comparison of outputs
+void setEnabled(bool enabled);
+
+void writeInt(xmstream &stream, int64_t value);
+void writeDouble(xmstream &stream, double value);
+void writeString(xmstream &stream, std::string_view value);
+// Quoted FormatMoney(value, rationalPartSize)
+void writeMoney(xmstream &stream, int64_t value, int64_t rationalPartSize);
+
+class Object {
+public:
+  Object(xmstream &stream) : Stream_(stream) { Stream_.write('{'); }
+  ~Object() { Stream_.write('}'); }
+
+  void addField(const char *name);
+  void addString(const char *name, std::string_view value) { addField(name); writeString(Stream_, value); }
+  void addInt(const char *name, int64_t value) { addField(name); writeInt(Stream_, value); }
+  void addDouble(const char *name, double value) { addField(name); writeDouble(Stream_, value); }
+  void addBoolean(const char *name, bool value);
+  void addNull(const char *name);
+  void addMoney(const char *name, int64_t value, int64_t rationalPartSize) { addField(name); writeMoney(Stream_, value, rationalPartSize); }
+
+private:
+  xmstream &Stream_;
+  bool First_ = true;
+};
+
+class Array {
+public:
+  Array(xmstream &stream) : Stream_(stream) { Stream_.write('['); }
+  ~Array() { Stream_.write(']'); }
+
+  void addField();
+  void addString(std::string_view value) { addField(); writeString(Stream_, value); }
+  void addInt(int64_t value) { addField(); writeInt(Stream_, value); }
+  void addDouble(double value) { addField(); writeDouble(Stream_, value); }
+
+private:
+  xmstream &Stream_;
+  bool First_ = true;
+};
+
+}
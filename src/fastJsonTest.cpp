@@ -0,0 +1,221 @@
+// Compares FastJSON output with poolcommon JSON::Object/JSON::Array and FormatMoney
+// Runs after build: change of poolcommon format must be reflected in FastJSON
+#include "fastJson.h"
+#include "poolcommon/jsonSerializer.h"
+#include "poolcommon/utils.h"
+#include <cmath>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+
+static unsigned gErrors = 0;
+
+static uint64_t random64(uint64_t &seed)
+{
+  seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  uint64_t x = seed;
+  x ^= x >> 33;
+  x *= 0xFF51AFD7ED558CCDULL;
+  x ^= x >> 33;
+  return x;
+}
+
+static std::string toString(xmstream &stream)
+{
+  return std::string(stream.data<const char>(), stream.sizeOf());
+}
+
+static void check(const char *what, const std::string &reference, const std::string &fast)
+{
+  if (reference == fast)
+    return;
+  if (++gErrors <= 16)
+    fprintf(stderr, "%s: poolcommon '%s', FastJSON '%s'\n", what, reference.c_str(), fast.c_str());
+}
+
+static void checkDouble(double value)
+{
+  xmstream reference;
+  xmstream fast;
+  {
+    JSON::Object object(reference);
+    object.addDouble("a", value);
+  }
+  {
+    FastJSON::Object object(fast);
+    object.addDouble("a", value);
+  }
+  check("double", toString(reference), toString(fast));
+}
+
+static void checkInt(int64_t value)
+{
+  xmstream reference;
+  xmstream fast;
+  {
+    JSON::Object object(reference);
+    object.addInt("a", value);
+  }
+  {
+    FastJSON::Object object(fast);
+    object.addInt("a", value);
+  }
+  check("int", toString(reference), toString(fast));
+}
+
+static void checkString(const std::string &value)
+{
+  xmstream reference;
+  xmstream fast;
+  {
+    JSON::Object object(reference);
+    object.addString("a", value);
+  }
+  {
+    FastJSON::Object object(fast);
+    object.addString("a", value);
+  }
+  check("string", toString(reference), toString(fast));
+}
+
+static void checkMoney(int64_t value, int64_t rationalPartSize)
+{
+  xmstream fast;
+  FastJSON::writeMoney(fast, value, rationalPartSize);
+  check("money", "\"" + FormatMoney(value, rationalPartSize) + "\"", toString(fast));
+}
+
+static void checkObject()
+{
+  const std::string text = "quote \" backslash \\ newline \n tab \t control \x01 utf-8 \xD0\x9F\xD1\x80\xD0\xB8";
+  xmstream reference;
+  {
+    JSON::Object object(reference);
+    object.addString("status", "ok");
+    object.addString("text", text);
+    object.addInt("min", INT64_MIN);
+    object.addDouble("rate", 0.024);
+    object.addBoolean("yes", true);
+    object.addBoolean("no", false);
+    object.addNull("null");
+    object.addField("array");
+    {
+      JSON::Array array(reference);
+      array.addField();
+      {
+        JSON::Object item(reference);
+        item.addString("name", "worker");
+        item.addDouble("shareWork", 0.8);
+      }
+      array.addField();
+      {
+        JSON::Object item(reference);
+      }
+    }
+    object.addField("doubles");
+    {
+      JSON::Array array(reference);
+      array.addDouble(1.5);
+      array.addDouble(-2.25);
+    }
+  }
+
+  xmstream fast;
+  {
+    FastJSON::Object object(fast);
+    object.addString("status", "ok");
+    object.addString("text", text);
+    object.addInt("min", INT64_MIN);
+    object.addDouble("rate", 0.024);
+    object.addBoolean("yes", true);
+    object.addBoolean("no", false);
+    object.addNull("null");
+    object.addField("array");
+    {
+      FastJSON::Array array(fast);
+      array.addField();
+      {
+        FastJSON::Object item(fast);
+        item.addString("name", "worker");
+        item.addDouble("shareWork", 0.8);
+      }
+      array.addField();
+      {
+        FastJSON::Object item(fast);
+      }
+    }
+    object.addField("doubles");
+    {
+      FastJSON::Array array(fast);
+      array.addDouble(1.5);
+      array.addDouble(-2.25);
+    }
+  }
+
+  check("object", toString(reference), toString(fast));
+}
+
+int main()
+{
+  uint64_t seed = 1;
+
+  // Doubles: rounding ties, precision boundary, non-finite values, random magnitudes from 2^-24 to 2^40
+  for (double value: {0.0, -0.0, 1.0, -1.0, 0.5, 0.0005, 0.0015, -0.0004, 0.001, 0.024, 0.8, 4.0, 123.4565, 2.675,
+                      1e-10, 999.9995, 999999.9999, 1e9, 1e12, 1e15, 1e20, -1e20, 1e300, 5e-324,
+                      std::nan(""), HUGE_VAL, -HUGE_VAL})
+    checkDouble(value);
+  for (unsigned i = 0; i < 200000; i++) {
+    double mantissa = static_cast<double>(random64(seed) >> 11) / 9007199254740992.0;
+    double value = std::ldexp(mantissa, static_cast<int>(random64(seed) % 64) - 24);
+    checkDouble(i & 1 ? -value : value);
+    // Exact binary fractions, decimal rounding ties among them
+    checkDouble(std::floor(value * 8) / 8 + 0.0625);
+  }
+
+  // Integers of every length
+  for (int64_t value: {INT64_MIN, INT64_MIN + 1, INT64_MAX, static_cast<int64_t>(0), static_cast<int64_t>(-1)})
+    checkInt(value);
+  for (unsigned i = 0; i < 200000; i++)
+    checkInt(static_cast<int64_t>(random64(seed) >> (1 + random64(seed) % 63)) * (i & 1 ? -1 : 1));
+
+  // Strings: all single bytes, random strings with dense and sparse escapes
+  for (unsigned c = 0; c < 256; c++)
+    checkString(std::string(1, static_cast<char>(c)));
+  for (unsigned i = 0; i < 100000; i++) {
+    std::string value(random64(seed) % 80, ' ');
+    uint64_t escapeRate = random64(seed) % 4;
+    for (char &c: value) {
+      uint64_t x = random64(seed);
+      bool randomByte = !escapeRate || x % (16u << escapeRate) == 0;
+      c = static_cast<char>(randomByte ? x >> 8 : 'a' + (x >> 8) % 26);
+    }
+    checkString(value);
+  }
+
+  // Money for every power of 10 rational part size, and one which is not
+  static const int64_t moneyValues[] = {
+    0, 1, -1, 5, 10, 99, 100, 12345678, -12345678, 100000000, 123456789012LL, -100000000, 2100000000000000LL,
+    INT64_MAX, INT64_MIN + 1, 1000000000000000000LL, -999999999999999999LL
+  };
+  for (int64_t rationalPartSize = 1; ; rationalPartSize *= 10) {
+    for (int64_t value: moneyValues)
+      checkMoney(value, rationalPartSize);
+    for (unsigned i = 0; i < 10000; i++)
+      checkMoney(static_cast<int64_t>(random64(seed) >> (1 + random64(seed) % 63)) * (i & 1 ? -1 : 1), rationalPartSize);
+    if (rationalPartSize == 1000000000000000000LL)
+      break;
+  }
+  for (int64_t value: moneyValues)
+    checkMoney(value, 12345);
+
+  checkObject();
+
+  if (gErrors) {
+    fprintf(stderr, "FastJSON output differs from poolcommon in %u cases, update src/fastJson.cpp\n", gErrors);
+    return 1;
+  }
+
+  printf("FastJSON output matches poolcommon\n");
+  return 0;
+}
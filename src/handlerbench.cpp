@@ -0,0 +1,370 @@
+#include "fastJson.h"
+#include "requestStats.h"
+#include "serializers.h"
+#include "streamingReply.h"
+#include "poolcore/coinLibrary.h"
+#include "loguru.hpp"
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <getopt.h>
+
+// Serialization cost of data-heavy API calls on synthetic data, without nodes and databases
+// Data generated with fixed seed, so results are comparable between runs and builds
+
+enum CmdLineOptsTy {
+  clOptHelp = 1,
+  clOptCoin,
+  clOptUsers,
+  clOptWorkers,
+  clOptHistory,
+  clOptBlocks,
+  clOptPayouts,
+  clOptIterations,
+  clOptSeed,
+  clOptOutput,
+  clOptReferenceJson,
+  clOptFormat
+};
+
+static option cmdLineOpts[] = {
+  {"help", no_argument, nullptr, clOptHelp},
+  {"coin", required_argument, nullptr, clOptCoin},
+  {"users", required_argument, nullptr, clOptUsers},
+  {"workers", required_argument, nullptr, clOptWorkers},
+  {"history", required_argument, nullptr, clOptHistory},
+  {"blocks", required_argument, nullptr, clOptBlocks},
+  {"payouts", required_argument, nullptr, clOptPayouts},
+  {"iterations", required_argument, nullptr, clOptIterations},
+  {"seed", required_argument, nullptr, clOptSeed},
+  {"output", required_argument, nullptr, clOptOutput},
+  {"reference-json", no_argument, nullptr, clOptReferenceJson},
+  {"format", required_argument, nullptr, clOptFormat},
+  {nullptr, 0, nullptr, 0}
+};
+
+struct CBenchConfig {
+  std::string Coin = "BTC";
+  size_t Users = 100000;
+  size_t Workers = 1000000;
+  size_t History = 8640;
+  size_t Blocks = 10000;
+  size_t Payouts = 10000;
+  unsigned Iterations = 5;
+  uint64_t Seed = 1;
+  // Directory for replies of last iteration, for comparison of serializer output between builds
+  std::string Output;
+  // Serialize with poolcommon JSON::Object instead of FastJSON
+  bool ReferenceJson = false;
+  EReplyFormat Format = rfJson;
+};
+
+struct CSyntheticData {
+  CCoinInfo CoinInfo;
+  int64_t CurrentTime;
+  StatisticDb::CStats Aggregate;
+  std::vector<StatisticDb::CStats> Workers;
+  std::vector<StatisticDb::CStats> History;
+  std::vector<StatisticDb::CredentialsWithStatistic> Users;
+  std::vector<FoundBlockRecord> Blocks;
+  std::vector<int64_t> Confirmations;
+  std::vector<PayoutDbRecord> Payouts;
+};
+
+static std::string randomHex(std::mt19937_64 &random, size_t size)
+{
+  static const char digits[] = "0123456789abcdef";
+  std::string result(size, '0');
+  for (auto &c: result)
+    c = digits[random() & 0xF];
+  return result;
+}
+
+static void generate(const CBenchConfig &config, CSyntheticData &data)
+{
+  std::mt19937_64 random(config.Seed);
+  std::lognormal_distribution<double> shareRate(0.0, 1.5);
+  // Fixed time for reproducible output
+  data.CurrentTime = 1700000000;
+
+  data.Workers.resize(config.Workers);
+  data.Aggregate = StatisticDb::CStats();
+  for (size_t i = 0; i < config.Workers; i++) {
+    StatisticDb::CStats &worker = data.Workers[i];
+    worker.WorkerId = "worker" + std::to_string(random() % (config.Workers * 4));
+    worker.ClientsNum = 1;
+    worker.WorkersNum = 1;
+    worker.SharesPerSecond = shareRate(random);
+    worker.SharesWork = worker.SharesPerSecond * (random() % 1000000) / 1000.0;
+    worker.AveragePower = static_cast<uint64_t>(worker.SharesPerSecond * 4294967.296);
+    worker.LastShareTime = data.CurrentTime - static_cast<int64_t>(random() % 3600);
+    worker.Time = 0;
+    data.Aggregate.WorkersNum++;
+    data.Aggregate.SharesPerSecond += worker.SharesPerSecond;
+    data.Aggregate.SharesWork += worker.SharesWork;
+    data.Aggregate.AveragePower += worker.AveragePower;
+    data.Aggregate.LastShareTime = std::max(data.Aggregate.LastShareTime, worker.LastShareTime);
+  }
+  data.Aggregate.ClientsNum = data.Aggregate.WorkersNum;
+
+  data.History.resize(config.History);
+  for (size_t i = 0; i < config.History; i++) {
+    StatisticDb::CStats &stats = data.History[i];
+    stats.Time = data.CurrentTime - static_cast<int64_t>((config.History - i) * 300);
+    stats.SharesPerSecond = shareRate(random) * 1000.0;
+    stats.SharesWork = stats.SharesPerSecond * 300.0 * (random() % 100000) / 100.0;
+    stats.AveragePower = static_cast<uint64_t>(stats.SharesPerSecond * 4294967.296);
+  }
+
+  data.Users.resize(config.Users);
+  for (size_t i = 0; i < config.Users; i++) {
+    StatisticDb::CredentialsWithStatistic &user = data.Users[i];
+    user.Credentials.Login = "user" + std::to_string(i);
+    user.Credentials.Name = "User \"" + std::to_string(i) + "\"";
+    user.Credentials.EMail = user.Credentials.Login + "@example.com";
+    user.Credentials.RegistrationDate = data.CurrentTime - static_cast<int64_t>(random() % 100000000);
+    user.Credentials.IsActive = random() % 16 != 0;
+    user.Credentials.IsReadOnly = false;
+    user.Credentials.FeePlan = random() % 4 ? "default" : "special";
+    user.WorkersNum = static_cast<uint32_t>(random() % 64);
+    user.SharesPerSecond = user.WorkersNum * shareRate(random);
+    user.AveragePower = static_cast<uint64_t>(user.SharesPerSecond * 4294967.296);
+    user.LastShareTime = data.CurrentTime - static_cast<int64_t>(random() % 86400);
+  }
+
+  data.Blocks.resize(config.Blocks);
+  data.Confirmations.resize(config.Blocks);
+  for (size_t i = 0; i < config.Blocks; i++) {
+    FoundBlockRecord &block = data.Blocks[i];
+    block.Height = 800000 - i;
+    block.Hash = randomHex(random, 64);
+    block.Time = data.CurrentTime - static_cast<int64_t>(i * 600);
+    block.AvailableCoins = 625000000 + static_cast<int64_t>(random() % 100000000);
+    block.FoundBy = "user" + std::to_string(random() % std::max<size_t>(config.Users, 1));
+    data.Confirmations[i] = static_cast<int64_t>(i) + 1;
+  }
+
+  data.Payouts.resize(config.Payouts);
+  for (size_t i = 0; i < config.Payouts; i++) {
+    PayoutDbRecord &payout = data.Payouts[i];
+    payout.Time = data.CurrentTime - static_cast<int64_t>(i * 3600);
+    payout.TransactionId = randomHex(random, 64);
+    payout.Value = static_cast<int64_t>(random() % 1000000000);
+    payout.Status = static_cast<int>(random() % 3);
+  }
+}
+
+// Streaming reply drained by parts as if every part was written to socket
+static size_t drain(CStreamingReply &reply, xmstream &stream, FILE *output)
+{
+  size_t size = 0;
+  bool more;
+  do {
+    more = reply.next(stream);
+    size += stream.sizeOf();
+    if (output)
+      fwrite(stream.data(), 1, stream.sizeOf(), output);
+    stream.reset();
+  } while (more);
+  return size;
+}
+
+struct CBenchmark {
+  const char *Name;
+  size_t Rows;
+  // Returns reply size
+  std::function<size_t(xmstream&, FILE*)> Run;
+};
+
+static void runBenchmark(const CBenchConfig &config, const CBenchmark &benchmark)
+{
+  std::vector<int64_t> times;
+  size_t size = 0;
+  for (unsigned i = 0; i < config.Iterations; i++) {
+    FILE *output = nullptr;
+    if (!config.Output.empty() && i == config.Iterations - 1) {
+      std::string path = config.Output + "/" + benchmark.Name + (config.Format == rfCbor ? ".cbor" : ".json");
+      output = fopen(path.c_str(), "wb");
+      if (!output)
+        LOG_F(ERROR, "can't open %s", path.c_str());
+    }
+
+    xmstream stream;
+    int64_t beginTime = monotonicTimeUs();
+    size = benchmark.Run(stream, output);
+    times.push_back(monotonicTimeUs() - beginTime);
+    if (output)
+      fclose(output);
+  }
+
+  std::sort(times.begin(), times.end());
+  int64_t best = times.front();
+  int64_t median = times[times.size() / 2];
+  printf("%-24s %10zu %10.2f %10.2f %10.1f %10.2f %10.1f\n",
+         benchmark.Name,
+         benchmark.Rows,
+         best / 1000.0,
+         median / 1000.0,
+         benchmark.Rows ? best * 1000.0 / benchmark.Rows : 0.0,
+         size / 1048576.0,
+         best ? size / 1.048576 / best : 0.0);
+}
+
+void printHelpMessage()
+{
+  printf("handlerbench usage:\n");
+  printf("  --coin <name>             coin info for power units and money format, default BTC\n");
+  printf("  --users <n>               userEnumerateAll rows, default 100000\n");
+  printf("  --workers <n>             backendQueryUserStats workers, default 1000000\n");
+  printf("  --history <n>             backendQueryUserStatsHistory rows, default 8640\n");
+  printf("  --blocks <n>              backendQueryFoundBlocks rows, default 10000\n");
+  printf("  --payouts <n>             backendQueryPayouts rows, default 10000\n");
+  printf("  --iterations <n>          default 5\n");
+  printf("  --seed <n>                synthetic data seed, default 1\n");
+  printf("  --output <directory>      write replies of last iteration to <directory>/<benchmark>.json\n");
+  printf("  --reference-json          serialize with poolcommon JSON instead of fast serializer\n");
+  printf("  --format <json|cbor>      reply format, default json\n");
+}
+
+int main(int argc, char **argv)
+{
+  loguru::g_stderr_verbosity = loguru::Verbosity_OFF;
+  loguru::g_preamble_thread = false;
+  loguru::g_preamble_file = true;
+  loguru::g_flush_interval_ms = 100;
+  loguru::init(argc, argv);
+  loguru::g_stderr_verbosity = 1;
+  loguru::set_thread_name("main");
+
+  CBenchConfig config;
+
+  // Parsing command line
+  int res;
+  int index = 0;
+  while ((res = getopt_long(argc, argv, "", cmdLineOpts, &index)) != -1) {
+    switch (res) {
+      case clOptHelp :
+        printHelpMessage();
+        return 0;
+      case clOptCoin :
+        config.Coin = optarg;
+        break;
+      case clOptUsers :
+        config.Users = strtoull(optarg, nullptr, 10);
+        break;
+      case clOptWorkers :
+        config.Workers = strtoull(optarg, nullptr, 10);
+        break;
+      case clOptHistory :
+        config.History = strtoull(optarg, nullptr, 10);
+        break;
+      case clOptBlocks :
+        config.Blocks = strtoull(optarg, nullptr, 10);
+        break;
+      case clOptPayouts :
+        config.Payouts = strtoull(optarg, nullptr, 10);
+        break;
+      case clOptIterations :
+        config.Iterations = atoi(optarg);
+        break;
+      case clOptSeed :
+        config.Seed = strtoull(optarg, nullptr, 10);
+        break;
+      case clOptOutput :
+        config.Output = optarg;
+        break;
+      case clOptReferenceJson :
+        config.ReferenceJson = true;
+        break;
+      case clOptFormat :
+        if (strcmp(optarg, "json") == 0) {
+          config.Format = rfJson;
+        } else if (strcmp(optarg, "cbor") == 0) {
+          config.Format = rfCbor;
+        } else {
+          fprintf(stderr, "Error: unknown format %s\n", optarg);
+          exit(1);
+        }
+        break;
+      case ':' :
+        fprintf(stderr, "Error: option %s missing argument\n", cmdLineOpts[index].name);
+        break;
+      case '?' :
+        exit(1);
+      default :
+        break;
+    }
+  }
+
+  if (config.Iterations == 0) {
+    fprintf(stderr, "Error: --iterations must be positive\n");
+    exit(1);
+  }
+
+  FastJSON::setEnabled(!config.ReferenceJson);
+  LOG_F(INFO, "serializer: %s", config.Format == rfCbor ? "CBOR" : FastJSON::enabled() ? "fast JSON" : "poolcommon JSON");
+  EReplyFormat format = config.Format;
+
+  CSyntheticData data;
+  data.CoinInfo = CCoinLibrary::get(config.Coin.c_str());
+  if (data.CoinInfo.Name.empty()) {
+    fprintf(stderr, "Error: unknown coin %s\n", config.Coin.c_str());
+    exit(1);
+  }
+
+  int64_t generateTime = monotonicTimeUs();
+  generate(config, data);
+  LOG_F(INFO, "synthetic data generated in %.2f s", (monotonicTimeUs() - generateTime) / 1000000.0);
+
+  std::vector<CBenchmark> benchmarks = {
+    {"backendQueryUserStats", data.Workers.size(), [&data, format](xmstream &stream, FILE *output) -> size_t {
+      serializeUserStats(stream, format, data.CoinInfo, data.CurrentTime, data.Aggregate, data.Workers, AllFields);
+      if (output)
+        fwrite(stream.data(), 1, stream.sizeOf(), output);
+      return stream.sizeOf();
+    }},
+    {"userEnumerateAll", data.Users.size(), [&data, format](xmstream &stream, FILE *output) -> size_t {
+      auto reply = arrayStreamingReply(format, "users", CReplyRows(data.Users), [](auto &object) {
+        object.addString("status", "ok");
+      }, [format](xmstream &stream, const StatisticDb::CredentialsWithStatistic &user) {
+        serializeUserRow(stream, format, user, AllFields);
+      });
+      return drain(*reply, stream, output);
+    }},
+    {"queryStatsHistory", data.History.size(), [&data, format](xmstream &stream, FILE *output) -> size_t {
+      auto reply = arrayStreamingReply(format, "stats", CReplyRows(data.History), [&data](auto &object) {
+        object.addString("status", "ok");
+        object.addString("powerUnit", data.CoinInfo.getPowerUnitName());
+        object.addInt("powerMultLog10", data.CoinInfo.PowerMultLog10);
+        object.addInt("currentTime", data.CurrentTime);
+      }, [format](xmstream &stream, const StatisticDb::CStats &stats) {
+        serializeStatsHistoryRow(stream, format, stats, AllFields);
+      });
+      return drain(*reply, stream, output);
+    }},
+    {"backendQueryFoundBlocks", data.Blocks.size(), [&data, format](xmstream &stream, FILE *output) -> size_t {
+      auto reply = arrayStreamingReply(format, "blocks", CReplyRows(data.Blocks, data.Confirmations), [](auto &object) {
+        object.addString("status", "ok");
+      }, [&data, format](xmstream &stream, const FoundBlockRecord &block, int64_t confirmations) {
+        serializeFoundBlock(stream, format, block, confirmations, data.CoinInfo, AllFields);
+      });
+      return drain(*reply, stream, output);
+    }},
+    {"backendQueryPayouts", data.Payouts.size(), [&data, format](xmstream &stream, FILE *output) -> size_t {
+      serializePayouts(stream, format, data.Payouts, data.CoinInfo, AllFields);
+      if (output)
+        fwrite(stream.data(), 1, stream.sizeOf(), output);
+      return stream.sizeOf();
+    }}
+  };
+
+  printf("%-24s %10s %10s %10s %10s %10s %10s\n", "benchmark", "rows", "best, ms", "median, ms", "ns/row", "size, MB", "MB/s");
+  for (const auto &benchmark: benchmarks)
+    runBenchmark(config, benchmark);
+  return 0;
+}
@@ -1,4 +1,6 @@
 #include "http.h"
+#include "metrics.h"
+#include "serializers.h"
 #include "poolcommon/utils.h"
 #include "poolcore/thread.h"
 #include "asyncio/coroutine.h"
@@ -6,58 +8,145 @@
 #include "loguru.hpp"
 #include "rapidjson/document.h"
 #include "poolcommon/jsonSerializer.h"
+#include <algorithm>
+#include <cctype>
+#include <cinttypes>
 #include <cmath>
+#include <iterator>
+#include <string_view>
+
+#if defined(OS_LINUX)
+extern "C" int mallctl(const char *name, void *oldp, size_t *oldlenp, void *newp, size_t newlen);
+#endif
+
+namespace {
+struct CRequestArena {
+  char ValueBuffer[32768];
+  char StackBuffer[8192];
+  rapidjson::MemoryPoolAllocator<> ValueAllocator{ValueBuffer, sizeof(ValueBuffer)};
+  rapidjson::MemoryPoolAllocator<> StackAllocator{StackBuffer, sizeof(StackBuffer)};
+};
+}
+
+static CRequestArena &requestArena()
+{
+  static thread_local CRequestArena arena;
+  return arena;
+}
 
-std::unordered_map<std::string, std::pair<int, PoolHttpConnection::FunctionTy>> PoolHttpConnection::FunctionNameMap_ = {
-  // User manager functions
-  {"userAction", {hmPost, fnUserAction}},
-  {"userCreate", {hmPost, fnUserCreate}},
-  {"userResendEmail", {hmPost, fnUserResendEmail}},
-  {"userLogin", {hmPost, fnUserLogin}},
-  {"userLogout", {hmPost, fnUserLogout}},
-  {"userQueryMonitoringSession", {hmPost, fnUserQueryMonitoringSession}},
-  {"userChangeEmail", {hmPost, fnUserChangeEmail}},
-  {"userChangePasswordForce", {hmPost, fnUserChangePasswordForce}},
-  {"userChangePasswordInitiate", {hmPost, fnUserChangePasswordInitiate}},
-  {"userGetCredentials", {hmPost, fnUserGetCredentials}},
-  {"userGetSettings", {hmPost, fnUserGetSettings}},
-  {"userUpdateCredentials", {hmPost, fnUserUpdateCredentials}},
-  {"userUpdateSettings", {hmPost, fnUserUpdateSettings}},
-  {"userEnumerateAll", {hmPost, fnUserEnumerateAll}},
-  {"userEnumerateFeePlan", {hmPost, fnUserEnumerateFeePlan}},
-  {"userGetFeePlan", {hmPost, fnUserGetFeePlan}},
-  {"userUpdateFeePlan", {hmPost, fnUserUpdateFeePlan}},
-  {"userChangeFeePlan", {hmPost, fnUserChangeFeePlan}},
-  {"userActivate2faInitiate", {hmPost, fnUserActivate2faInitiate}},
-  {"userDeactivate2faInitiate", {hmPost, fnUserDeactivate2faInitiate}},
-  // Backend functions
-  {"backendManualPayout", {hmPost, fnBackendManualPayout}},
-  {"backendQueryCoins", {hmPost, fnBackendQueryCoins}},
-  {"backendQueryFoundBlocks", {hmPost, fnBackendQueryFoundBlocks}},
-  {"backendQueryPayouts", {hmPost, fnBackendQueryPayouts}},
-  {"backendQueryPoolBalance", {hmPost, fnBackendQueryPoolBalance}},
-  {"backendQueryPoolStats", {hmPost, fnBackendQueryPoolStats}},
-  {"backendQueryPoolStatsHistory", {hmPost, fnBackendQueryPoolStatsHistory}},
-  {"backendQueryProfitSwitchCoeff", {hmPost, fnBackendQueryProfitSwitchCoeff}},
-  {"backendQueryUserBalance", {hmPost, fnBackendQueryUserBalance}},
-  {"backendQueryUserStats", {hmPost, fnBackendQueryUserStats}},
-  {"backendQueryUserStatsHistory", {hmPost, fnBackendQueryUserStatsHistory}},
-  {"backendQueryWorkerStatsHistory", {hmPost, fnBackendQueryWorkerStatsHistory}},
-  {"backendQueryPPLNSPayouts", {hmPost, fnBackendQueryPPLNSPayouts}},
-  {"backendQueryPPLNSAcc", {hmPost, fnBackendQueryPPLNSAcc}},
-  {"backendUpdateProfitSwitchCoeff", {hmPost, fnBackendUpdateProfitSwitchCoeff}},
-  {"backendPoolLuck", {hmPost, fnBackendPoolLuck}},
-  // Instance functions
-  {"instanceEnumerateAll", {hmPost, fnInstanceEnumerateAll}},
-  // Complex mining stats functions
-  {"complexMiningStatsGetInfo", {hmPost, fnComplexMiningStatsGetInfo}}
+static inline uint64_t clientId(const HostAddress &address)
+{
+  // IPv6 clients limited by /64 prefix
+  if (address.family == AF_INET)
+    return address.ipv4;
+  uint64_t prefix;
+  memcpy(&prefix, address.ipv6, sizeof(prefix));
+  return prefix;
+}
+
+static constexpr size_t MaxCachedResponseSize = 1u << 20;
+// Total size of cached responses
+static constexpr size_t MaxCacheSize = 64u << 20;
+static constexpr size_t SmallBody = 4096;
+static constexpr size_t LargeBody = 65536;
+static constexpr size_t MaxEventTopics = 64;
+// Slow event stream client loses updates above this limit
+static constexpr size_t MaxQueuedEvents = 64;
+// Comment frame interval (seconds) for proxies closing idle connections
+static constexpr unsigned EventKeepAliveInterval = 30;
+static constexpr size_t MaxBatchCalls = 16;
+// Session limiter bucket shared by all unknown and expired session ids
+static constexpr uint64_t UnknownSessionClient = 0;
+
+constexpr PoolHttpConnection::CEndpoint PoolHttpConnection::Endpoints_[] = {
+  {"backendManualPayout", hmPost, PoolHttpConnection::fnBackendManualPayout, PoolHttpConnection::alUser, false, SmallBody, 1, qpCritical, false},
+  {"backendPoolLuck", hmPost, PoolHttpConnection::fnBackendPoolLuck, PoolHttpConnection::alNone, true, SmallBody, 1, qpInteractive, false},
+  {"backendQueryCoins", hmPost, PoolHttpConnection::fnBackendQueryCoins, PoolHttpConnection::alNone, true, SmallBody, 1, qpInteractive, false},
+  {"backendQueryFoundBlocks", hmPost, PoolHttpConnection::fnBackendQueryFoundBlocks, PoolHttpConnection::alNone, true, SmallBody, 2, qpInteractive, true},
+  {"backendQueryPPLNSAcc", hmPost, PoolHttpConnection::fnBackendQueryPPLNSAcc, PoolHttpConnection::alUser, false, SmallBody, 5, qpBulk, false},
+  {"backendQueryPPLNSPayouts", hmPost, PoolHttpConnection::fnBackendQueryPPLNSPayouts, PoolHttpConnection::alUser, false, SmallBody, 5, qpBulk, false},
+  {"backendQueryPayouts", hmPost, PoolHttpConnection::fnBackendQueryPayouts, PoolHttpConnection::alUser, false, SmallBody, 5, qpBulk, true},
+  {"backendQueryPoolBalance", hmPost, PoolHttpConnection::fnBackendQueryPoolBalance, PoolHttpConnection::alUser, false, SmallBody, 1, qpInteractive, false},
+  {"backendQueryPoolStats", hmPost, PoolHttpConnection::fnBackendQueryPoolStats, PoolHttpConnection::alNone, true, SmallBody, 1, qpInteractive, false},
+  {"backendQueryPoolStatsHistory", hmPost, PoolHttpConnection::fnBackendQueryPoolStatsHistory, PoolHttpConnection::alNone, false, SmallBody, 10, qpBulk, true},
+  {"backendQueryProfitSwitchCoeff", hmPost, PoolHttpConnection::fnBackendQueryProfitSwitchCoeff, PoolHttpConnection::alObserver, false, SmallBody, 1, qpInteractive, false},
+  {"backendQueryUserBalance", hmPost, PoolHttpConnection::fnBackendQueryUserBalance, PoolHttpConnection::alUser, false, SmallBody, 1, qpInteractive, false},
+  {"backendQueryUserStats", hmPost, PoolHttpConnection::fnBackendQueryUserStats, PoolHttpConnection::alUser, false, SmallBody, 2, qpInteractive, true},
+  {"backendQueryUserStatsHistory", hmPost, PoolHttpConnection::fnBackendQueryUserStatsHistory, PoolHttpConnection::alUser, false, SmallBody, 10, qpBulk, true},
+  {"backendQueryWorkerStatsHistory", hmPost, PoolHttpConnection::fnBackendQueryWorkerStatsHistory, PoolHttpConnection::alUser, false, SmallBody, 10, qpBulk, true},
+  {"backendUpdateProfitSwitchCoeff", hmPost, PoolHttpConnection::fnBackendUpdateProfitSwitchCoeff, PoolHttpConnection::alAdmin, false, SmallBody, 1, qpCritical, false},
+  {"batch", hmPost, PoolHttpConnection::fnBatch, PoolHttpConnection::alNone, false, LargeBody, 1, qpInteractive, false},
+  {"complexMiningStatsGetInfo", hmPost, PoolHttpConnection::fnComplexMiningStatsGetInfo, PoolHttpConnection::alAdmin, false, SmallBody, 5, qpBulk, false},
+  {"eventSubscribe", hmPost, PoolHttpConnection::fnEventSubscribe, PoolHttpConnection::alNone, false, SmallBody, 5, qpInteractive, false},
+  {"instanceEnumerateAll", hmPost, PoolHttpConnection::fnInstanceEnumerateAll, PoolHttpConnection::alNone, true, SmallBody, 1, qpInteractive, false},
+  {"serverStats", hmPost, PoolHttpConnection::fnServerStats, PoolHttpConnection::alAdmin, false, SmallBody, 1, qpCritical, false},
+  {"serverTraces", hmPost, PoolHttpConnection::fnServerTraces, PoolHttpConnection::alAdmin, false, SmallBody, 1, qpCritical, false},
+  {"userAction", hmPost, PoolHttpConnection::fnUserAction, PoolHttpConnection::alNone, false, SmallBody, 1, qpCritical, false},
+  {"userActivate2faInitiate", hmPost, PoolHttpConnection::fnUserActivate2faInitiate, PoolHttpConnection::alUser, false, SmallBody, 1, qpCritical, false},
+  {"userChangeEmail", hmPost, PoolHttpConnection::fnUserChangeEmail, PoolHttpConnection::alUser, false, SmallBody, 1, qpCritical, false},
+  {"userChangeFeePlan", hmPost, PoolHttpConnection::fnUserChangeFeePlan, PoolHttpConnection::alAdmin, false, SmallBody, 1, qpCritical, false},
+  {"userChangePasswordForce", hmPost, PoolHttpConnection::fnUserChangePasswordForce, PoolHttpConnection::alAdmin, false, SmallBody, 1, qpCritical, false},
+  {"userChangePasswordInitiate", hmPost, PoolHttpConnection::fnUserChangePasswordInitiate, PoolHttpConnection::alNone, false, SmallBody, 5, qpCritical, false},
+  {"userCreate", hmPost, PoolHttpConnection::fnUserCreate, PoolHttpConnection::alNone, false, SmallBody, 5, qpCritical, false},
+  {"userDeactivate2faInitiate", hmPost, PoolHttpConnection::fnUserDeactivate2faInitiate, PoolHttpConnection::alUser, false, SmallBody, 1, qpCritical, false},
+  {"userEnumerateAll", hmPost, PoolHttpConnection::fnUserEnumerateAll, PoolHttpConnection::alObserver, false, SmallBody, 20, qpBulk, true},
+  {"userEnumerateFeePlan", hmPost, PoolHttpConnection::fnUserEnumerateFeePlan, PoolHttpConnection::alObserver, false, SmallBody, 1, qpInteractive, false},
+  {"userGetCredentials", hmPost, PoolHttpConnection::fnUserGetCredentials, PoolHttpConnection::alUser, false, SmallBody, 1, qpInteractive, false},
+  {"userGetFeePlan", hmPost, PoolHttpConnection::fnUserGetFeePlan, PoolHttpConnection::alObserver, false, SmallBody, 1, qpInteractive, false},
+  {"userGetSettings", hmPost, PoolHttpConnection::fnUserGetSettings, PoolHttpConnection::alUser, false, SmallBody, 1, qpInteractive, false},
+  {"userLogin", hmPost, PoolHttpConnection::fnUserLogin, PoolHttpConnection::alNone, false, SmallBody, 5, qpCritical, false},
+  {"userLogout", hmPost, PoolHttpConnection::fnUserLogout, PoolHttpConnection::alUser, false, SmallBody, 1, qpCritical, false},
+  {"userQueryMonitoringSession", hmPost, PoolHttpConnection::fnUserQueryMonitoringSession, PoolHttpConnection::alUser, false, SmallBody, 1, qpCritical, false},
+  {"userResendEmail", hmPost, PoolHttpConnection::fnUserResendEmail, PoolHttpConnection::alNone, false, SmallBody, 5, qpCritical, false},
+  {"userUpdateCredentials", hmPost, PoolHttpConnection::fnUserUpdateCredentials, PoolHttpConnection::alUser, false, SmallBody, 1, qpCritical, false},
+  {"userUpdateFeePlan", hmPost, PoolHttpConnection::fnUserUpdateFeePlan, PoolHttpConnection::alAdmin, false, LargeBody, 1, qpCritical, false},
+  {"userUpdateSettings", hmPost, PoolHttpConnection::fnUserUpdateSettings, PoolHttpConnection::alUser, false, LargeBody, 1, qpCritical, false}
 };
 
+constexpr PoolHttpConnection::CEndpoint PoolHttpConnection::MetricsEndpoint_ = {"metrics", hmGet, PoolHttpConnection::fnMetrics, PoolHttpConnection::alNone, false, 0, 1, qpInteractive, false};
+
+constexpr bool PoolHttpConnection::endpointsSorted()
+{
+  for (size_t i = 1; i < std::size(Endpoints_); i++) {
+    if (!(Endpoints_[i-1].Name < Endpoints_[i].Name))
+      return false;
+  }
+  return true;
+}
+
+const PoolHttpConnection::CEndpoint *PoolHttpConnection::findEndpoint(std::string_view name)
+{
+  static_assert(endpointsSorted(), "API endpoints table must be sorted by name");
+  const CEndpoint *It = std::lower_bound(std::begin(Endpoints_), std::end(Endpoints_), name, [](const CEndpoint &endpoint, std::string_view name) {
+    return endpoint.Name < name;
+  });
+  return It != std::end(Endpoints_) && It->Name == name ? It : nullptr;
+}
+
+unsigned PoolHttpConnection::maxEndpointCost()
+{
+  unsigned result = 0;
+  for (const auto &endpoint: Endpoints_)
+    result = std::max(result, endpoint.Cost);
+  return result;
+}
+
 static inline bool rawcmp(Raw data, const char *operand) {
   size_t opSize = strlen(operand);
   return data.size == opSize && memcmp(data.data, operand, opSize) == 0;
 }
 
+static inline bool rawcasecmp(Raw data, const char *operand) {
+  size_t opSize = strlen(operand);
+  if (data.size != opSize)
+    return false;
+  for (size_t i = 0; i < opSize; i++) {
+    if (tolower(static_cast<unsigned char>(data.data[i])) != operand[i])
+      return false;
+  }
+  return true;
+}
+
 static inline void jsonParseString(rapidjson::Value &document, const char *name, std::string &out, bool *validAcc) {
   if (document.HasMember(name) && document[name].IsString())
     out = document[name].GetString();
@@ -198,16 +287,97 @@ static void addUserFeePlan(xmstream &stream, const UserFeePlanRecord &plan)
   }
 }
 
+typedef CThreadLocalSlab<sizeof(PoolHttpConnection), 1024> CConnectionSlab;
+
+void *PoolHttpConnection::operator new(size_t)
+{
+  return CConnectionSlab::allocate();
+}
+
+void PoolHttpConnection::operator delete(void *object)
+{
+  CConnectionSlab::release(object);
+}
+
+const CPoolCounters &PoolHttpConnection::poolCounters()
+{
+  return CConnectionSlab::counters();
+}
+
+PoolHttpConnection::~PoolHttpConnection()
+{
+  if (!Parent_)
+    Server_.connectionClosed();
+
+  if (Context.Admitted)
+    Server_.releaseRequest();
+
+  if (Buffer_ != InlineBuffer_)
+    Server_.bufferPool().release(Buffer_);
+}
+
 void PoolHttpConnection::run()
 {
-  aioRead(Socket_, buffer, sizeof(buffer), afNone, 0, readCb, this);
+  readNext();
+}
+
+void PoolHttpConnection::readNext()
+{
+  uint64_t timeout = Server_.config().HttpKeepAliveTimeout * 1000000ULL;
+  aioRead(Socket_, Buffer_+oldDataSize, BufferSize_-oldDataSize, afNone, timeout, readCb, this);
+}
+
+bool PoolHttpConnection::growBuffer()
+{
+  if (Buffer_ != InlineBuffer_)
+    return false;
+
+  Buffer_ = static_cast<char*>(Server_.bufferPool().acquire());
+  BufferSize_ = Server_.bufferPool().bufferSize();
+  memcpy(Buffer_, InlineBuffer_, oldDataSize);
+  return true;
+}
+
+void PoolHttpConnection::shrinkBuffer()
+{
+  if (Buffer_ == InlineBuffer_ || oldDataSize > sizeof(InlineBuffer_))
+    return;
+
+  memcpy(InlineBuffer_, Buffer_, oldDataSize);
+  Server_.bufferPool().release(Buffer_);
+  Buffer_ = InlineBuffer_;
+  BufferSize_ = sizeof(InlineBuffer_);
 }
 
 int PoolHttpConnection::onParse(HttpRequestComponent *component)
 {
   if (component->type == httpRequestDtMethod) {
+    Context.StartTime = monotonicTimeUs();
     Context.method = component->method;
     Context.function = fnUnknown;
+    Context.Endpoint = nullptr;
+    Context.Encoding = ceIdentity;
+    Context.Format = rfJson;
+    return 1;
+  }
+
+  if (component->type == httpRequestDtVersion) {
+    // HTTP/1.1 connections are persistent by default
+    Context.KeepAlive = component->version.majorVersion > 1 || (component->version.majorVersion == 1 && component->version.minorVersion >= 1);
+    return 1;
+  }
+
+  if (component->type == httpRequestDtHeaderEntry) {
+    if (component->header.entryId == hhConnection) {
+      if (rawcasecmp(component->header.stringValue, "close"))
+        Context.KeepAlive = false;
+      else if (rawcasecmp(component->header.stringValue, "keep-alive"))
+        Context.KeepAlive = true;
+    } else if (component->header.entryId == hhAcceptEncoding && Server_.config().HttpCompressionLevel) {
+      Context.Encoding = selectContentEncoding(component->header.stringValue.data, component->header.stringValue.size);
+    } else if (component->header.entryId == hhAccept && Context.Endpoint && Context.Endpoint->BinaryReply) {
+      Context.Format = selectReplyFormat(component->header.stringValue.data, component->header.stringValue.size);
+    }
     return 1;
   }
 
@@ -215,85 +385,203 @@ int PoolHttpConnection::onParse(HttpRequestComponent *component)
     // Wait 'api'
     if (Context.function == fnUnknown && rawcmp(component->data, "api")) {
       Context.function = fnApi;
+    } else if (Context.function == fnUnknown && Context.method == hmGet && rawcmp(component->data, "metrics")) {
+      Context.function = fnMetrics;
+      Context.Endpoint = &MetricsEndpoint_;
     } else if (Context.function == fnApi) {
-      std::string functionName(component->data.data, component->data.data + component->data.size);
-      auto It = FunctionNameMap_.find(functionName);
-      if (It == FunctionNameMap_.end() || It->second.first != Context.method) {
+      const CEndpoint *endpoint = findEndpoint(std::string_view(component->data.data, component->data.size));
+      if (!endpoint || endpoint->Method != Context.method) {
         reply404();
         return 0;
       }
 
-      Context.function = It->second.second;
+      Context.function = endpoint->Function;
+      Context.Endpoint = endpoint;
       return 1;
     } else {
       reply404();
       return 0;
     }
   } else if (component->type == httpRequestDtData) {
+    if (!checkBodySize(component->data.size))
+      return 0;
     Context.Request.append(component->data.data, component->data.data + component->data.size);
     return 1;
   } else if (component->type == httpRequestDtDataLast) {
-    Context.Request.append(component->data.data, component->data.data + component->data.size);
-    rapidjson::Document document;
-    document.Parse(!Context.Request.empty() ? Context.Request.c_str() : "{}");
-    if (document.HasParseError() || !document.IsObject()) {
-      replyWithStatus("invalid_json");
+    if (!checkBodySize(component->data.size))
+      return 0;
+    Context.Dispatched = true;
+    Context.BytesIn = Context.Request.size() + component->data.size;
+    unsigned maxRequests = Server_.config().HttpMaxRequestsPerConnection;
+    if (maxRequests && RequestsNum_+1 >= maxRequests)
+      Context.KeepAlive = false;
+
+    // Cheap per-client check before parsing
+    if (!Server_.ipRateLimiter().consume(ClientId_, Context.Endpoint->Cost)) {
+      reply429();
       return 1;
     }
 
-    switch (Context.function) {
-      case fnUserAction: onUserAction(document); break;
-      case fnUserCreate: onUserCreate(document); break;
-      case fnUserResendEmail: onUserResendEmail(document); break;
-      case fnUserLogin: onUserLogin(document); break;
-      case fnUserLogout: onUserLogout(document); break;
-      case fnUserQueryMonitoringSession: onUserQueryMonitoringSession(document); break;
-      case fnUserChangeEmail: onUserChangeEmail(document); break;
-      case fnUserChangePasswordInitiate: onUserChangePasswordInitiate(document); break;
-      case fnUserChangePasswordForce: onUserChangePasswordForce(document); break;
-      case fnUserGetCredentials: onUserGetCredentials(document); break;
-      case fnUserGetSettings: onUserGetSettings(document); break;
-      case fnUserUpdateCredentials: onUserUpdateCredentials(document); break;
-      case fnUserUpdateSettings: onUserUpdateSettings(document); break;
-      case fnUserEnumerateAll: onUserEnumerateAll(document); break;
-      case fnUserEnumerateFeePlan: onUserEnumerateFeePlan(document); break;
-      case fnUserGetFeePlan: onUserGetFeePlan(document); break;
-      case fnUserUpdateFeePlan: onUserUpdateFeePlan(document); break;
-      case fnUserChangeFeePlan: onUserChangeFeePlan(document); break;
-      case fnUserActivate2faInitiate: onUserActivate2faInitiate(document); break;
-      case fnUserDeactivate2faInitiate: onUserDeactivate2faInitiate(document); break;
-      case fnBackendManualPayout: onBackendManualPayout(document); break;
-      case fnBackendQueryUserBalance: onBackendQueryUserBalance(document); break;
-      case fnBackendQueryUserStats: onBackendQueryUserStats(document); break;
-      case fnBackendQueryUserStatsHistory: onBackendQueryUserStatsHistory(document); break;
-      case fnBackendQueryWorkerStatsHistory: onBackendQueryWorkerStatsHistory(document); break;
-      case fnBackendQueryCoins : onBackendQueryCoins(document); break;
-      case fnBackendQueryFoundBlocks: onBackendQueryFoundBlocks(document); break;
-      case fnBackendQueryPayouts: onBackendQueryPayouts(document); break;
-      case fnBackendQueryPoolBalance: onBackendQueryPoolBalance(document); break;
-      case fnBackendQueryPoolStats: onBackendQueryPoolStats(document); break;
-      case fnBackendQueryPoolStatsHistory : onBackendQueryPoolStatsHistory(document); break;
-      case fnBackendQueryProfitSwitchCoeff : onBackendQueryProfitSwitchCoeff(document); break;
-      case fnBackendQueryPPLNSPayouts : onBackendQueryPPLNSPayouts(document); break;
-      case fnBackendQueryPPLNSAcc : onBackendQueryPPLNSAcc(document); break;
-      case fnBackendUpdateProfitSwitchCoeff : onBackendUpdateProfitSwitchCoeff(document); break;
-      case fnBackendPoolLuck : onBackendPoolLuck(document); break;
-      case fnInstanceEnumerateAll : onInstanceEnumerateAll(document); break;
-      case fnComplexMiningStatsGetInfo : onComplexMiningStatsGetInfo(document); break;
-      default:
-        reply404();
-        return 0;
+    char emptyRequest[] = "{}";
+    char *body = emptyRequest;
+    char *terminator = nullptr;
+    char terminatorSaved = 0;
+    char *data = const_cast<char*>(component->data.data);
+    if (Context.Request.empty() && component->data.size && data >= Buffer_ && data + component->data.size < Buffer_ + BufferSize_) {
+      // Whole body inside receive buffer, parse it in place
+      // Byte after body can be a part of next pipelined request, restore it after dispatch
+      body = data;
+      terminator = data + component->data.size;
+      terminatorSaved = *terminator;
+      *terminator = 0;
+    } else {
+      Context.Request.append(component->data.data, component->data.data + component->data.size);
+      if (!Context.Request.empty())
+        body = Context.Request.data();
+    }
+
+    int result = dispatchRequest(body);
+    if (terminator)
+      *terminator = terminatorSaved;
+    return result;
+  }
+
+  return 1;
+}
+
+int PoolHttpConnection::dispatchRequest(char *body)
+{
+  // Values and parser stack allocated in per-thread arena, no heap usage for typical request
+  CRequestArena &arena = requestArena();
+  arena.ValueAllocator.Clear();
+  arena.StackAllocator.Clear();
+  CRequestDocument document(&arena.ValueAllocator, 1024, &arena.StackAllocator);
+  document.ParseInsitu(body);
+  Context.Trace = Server_.tracer().start(Context.Endpoint->Name);
+  traceSpan("parse", Context.StartTime);
+  if (document.HasParseError() || !document.IsObject()) {
+    replyWithStatus("invalid_json");
+    return 1;
+  }
+
+  if (Server_.sessionRateLimiter().enabled() && document.HasMember("id") && document["id"].IsString()) {
+    std::string sessionId(document["id"].GetString(), document["id"].GetStringLength());
+    if (!Server_.sessionRateLimiter().consume(sessionClient(sessionId), Context.Endpoint->Cost)) {
+      reply429();
+      return 1;
+    }
+  }
+
+  // Limit number of requests waiting for backends
+  // Cacheable functions parse arguments and look up response cache first, see replyFromCache
+  if (!Context.Endpoint->Cacheable) {
+    if (!Server_.admitRequest()) {
+      reply429();
+      return 1;
     }
+    Context.Admitted = true;
+  }
+
+  Context.HandlerTime = monotonicTimeUs();
+  if (!callHandler(document)) {
+    reply404();
+    return 0;
   }
 
+  traceSpan("handler", Context.HandlerTime);
   return 1;
 }
 
+bool PoolHttpConnection::replyFromCache(const CResponseCache::CKey &parameters)
+{
+  // Batch calls admitted with batch itself, their results are not cached
+  if (Parent_)
+    return false;
+
+  if (Server_.responseCache().enabled()) {
+    Context.CacheKey.assign(reinterpret_cast<const char*>(&Context.function), sizeof(Context.function));
+    Context.CacheKey.push_back(static_cast<char>(Context.Encoding));
+    Context.CacheKey.push_back(static_cast<char>(Context.Format));
+    Context.CacheKey.append(parameters.data());
+    Context.CacheGeneration = Server_.responseCache().generation();
+    if (std::shared_ptr<const std::string> response = Server_.responseCache().get(Context.CacheKey)) {
+      Context.CacheKey.clear();
+      xmstream stream;
+      Context.ReplyTime = Context.WriteTime = monotonicTimeUs();
+      replyStatus200(stream);
+      stream.write(response->data(), response->size());
+      Context.BytesOut += stream.sizeOf();
+      aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+      return true;
+    }
+  }
+
+  // Cached replies are sent even if server is overloaded
+  if (!Server_.admitRequest()) {
+    reply429();
+    return true;
+  }
+  Context.Admitted = true;
+  return false;
+}
+
+bool PoolHttpConnection::callHandler(CRequestDocument &document)
+{
+  switch (Context.function) {
+    case fnUserAction: onUserAction(document); break;
+    case fnUserCreate: onUserCreate(document); break;
+    case fnUserResendEmail: onUserResendEmail(document); break;
+    case fnUserLogin: onUserLogin(document); break;
+    case fnUserLogout: onUserLogout(document); break;
+    case fnUserQueryMonitoringSession: onUserQueryMonitoringSession(document); break;
+    case fnUserChangeEmail: onUserChangeEmail(document); break;
+    case fnUserChangePasswordInitiate: onUserChangePasswordInitiate(document); break;
+    case fnUserChangePasswordForce: onUserChangePasswordForce(document); break;
+    case fnUserGetCredentials: onUserGetCredentials(document); break;
+    case fnUserGetSettings: onUserGetSettings(document); break;
+    case fnUserUpdateCredentials: onUserUpdateCredentials(document); break;
+    case fnUserUpdateSettings: onUserUpdateSettings(document); break;
+    case fnUserEnumerateAll: onUserEnumerateAll(document); break;
+    case fnUserEnumerateFeePlan: onUserEnumerateFeePlan(document); break;
+    case fnUserGetFeePlan: onUserGetFeePlan(document); break;
+    case fnUserUpdateFeePlan: onUserUpdateFeePlan(document); break;
+    case fnUserChangeFeePlan: onUserChangeFeePlan(document); break;
+    case fnUserActivate2faInitiate: onUserActivate2faInitiate(document); break;
+    case fnUserDeactivate2faInitiate: onUserDeactivate2faInitiate(document); break;
+    case fnBackendManualPayout: onBackendManualPayout(document); break;
+    case fnBackendQueryUserBalance: onBackendQueryUserBalance(document); break;
+    case fnBackendQueryUserStats: onBackendQueryUserStats(document); break;
+    case fnBackendQueryUserStatsHistory: onBackendQueryUserStatsHistory(document); break;
+    case fnBackendQueryWorkerStatsHistory: onBackendQueryWorkerStatsHistory(document); break;
+    case fnBackendQueryCoins : onBackendQueryCoins(document); break;
+    case fnBackendQueryFoundBlocks: onBackendQueryFoundBlocks(document); break;
+    case fnBackendQueryPayouts: onBackendQueryPayouts(document); break;
+    case fnBackendQueryPoolBalance: onBackendQueryPoolBalance(document); break;
+    case fnBackendQueryPoolStats: onBackendQueryPoolStats(document); break;
+    case fnBackendQueryPoolStatsHistory : onBackendQueryPoolStatsHistory(document); break;
+    case fnBackendQueryProfitSwitchCoeff : onBackendQueryProfitSwitchCoeff(document); break;
+    case fnBackendQueryPPLNSPayouts : onBackendQueryPPLNSPayouts(document); break;
+    case fnBackendQueryPPLNSAcc : onBackendQueryPPLNSAcc(document); break;
+    case fnBackendUpdateProfitSwitchCoeff : onBackendUpdateProfitSwitchCoeff(document); break;
+    case fnBackendPoolLuck : onBackendPoolLuck(document); break;
+    case fnInstanceEnumerateAll : onInstanceEnumerateAll(document); break;
+    case fnComplexMiningStatsGetInfo : onComplexMiningStatsGetInfo(document); break;
+    case fnEventSubscribe : onEventSubscribe(document); break;
+    case fnBatch : onBatch(document); break;
+    case fnServerStats : onServerStats(document); break;
+    case fnServerTraces : onServerTraces(document); break;
+    case fnMetrics : onMetrics(); break;
+    default:
+      return false;
+  }
+
+  return true;
+}
+
 void PoolHttpConnection::onWrite()
 {
-  // TODO: check keep alive
-  socketShutdown(aioObjectSocket(Socket_), SOCKET_SHUTDOWN_READWRITE);
-  aioRead(Socket_, buffer, sizeof(buffer), afNone, 0, readCb, this);
+  if (++RequestStage_ == 2)
+    finishRequest();
 }
 
 void PoolHttpConnection::onRead(AsyncOpStatus status, size_t bytesRead)
@@ -303,11 +591,29 @@ void PoolHttpConnection::onRead(AsyncOpStatus status, size_t bytesRead)
     return;
   }
 
-  httpRequestSetBuffer(&ParserState, buffer, bytesRead + oldDataSize);
+  httpRequestSetBuffer(&ParserState, Buffer_, bytesRead + oldDataSize);
+  parseRequest();
+}
 
+void PoolHttpConnection::parseRequest()
+{
   switch (httpRequestParse(&ParserState, [](HttpRequestComponent *component, void *arg) -> int { return static_cast<PoolHttpConnection*>(arg)->onParse(component); }, this)) {
     case ParserResultOk : {
-      // TODO: check keep-alive
+      // keep pipelined requests data for next iteration
+      oldDataSize = httpRequestDataRemaining(&ParserState);
+      if (oldDataSize)
+        memmove(Buffer_, httpRequestDataPtr(&ParserState), oldDataSize);
+      // Request without body, only metrics page can be requested this way
+      if (!Context.Dispatched) {
+        if (Context.function == fnMetrics) {
+          Context.Dispatched = true;
+          onMetrics();
+        } else {
+          reply404();
+        }
+      }
+      if (++RequestStage_ == 2)
+        finishRequest();
       break;
     }
 
@@ -315,8 +621,14 @@ void PoolHttpConnection::onRead(AsyncOpStatus status, size_t bytesRead)
       // copy 'tail' to begin of buffer
       oldDataSize = httpRequestDataRemaining(&ParserState);
       if (oldDataSize)
-        memcpy(buffer, httpRequestDataPtr(&ParserState), oldDataSize);
-      aioRead(Socket_, buffer+oldDataSize, sizeof(buffer)-oldDataSize, afNone, 0, readCb, this);
+        memmove(Buffer_, httpRequestDataPtr(&ParserState), oldDataSize);
+      if (oldDataSize == BufferSize_ && !growBuffer()) {
+        // request too large
+        close();
+        break;
+      }
+
+      readNext();
       break;
     }
 
@@ -326,32 +638,151 @@ void PoolHttpConnection::onRead(AsyncOpStatus status, size_t bytesRead)
     }
 
     case ParserResultCancelled : {
-      close();
+      // 404 reply already sent, close connection after write
+      oldDataSize = 0;
+      Context.KeepAlive = false;
+      if (++RequestStage_ == 2)
+        finishRequest();
       break;
     }
   }
 }
 
-void PoolHttpConnection::reply200(xmstream &stream)
+void PoolHttpConnection::finishRequest()
+{
+  if (Context.Endpoint)
+    recordRequestStats();
+
+  if (Context.Trace) {
+    int64_t now = monotonicTimeUs();
+    Context.Trace->span("write", Context.WriteTime, now);
+    Context.Trace->span("request", Context.StartTime, now);
+    Server_.tracer().finish(std::move(Context.Trace));
+  }
+
+  RequestsNum_++;
+  if (!Context.KeepAlive) {
+    oldDataSize = 0;
+    shrinkBuffer();
+    socketShutdown(aioObjectSocket(Socket_), SOCKET_SHUTDOWN_READWRITE);
+    aioRead(Socket_, Buffer_, BufferSize_, afNone, 0, readCb, this);
+    return;
+  }
+
+  if (Context.Admitted)
+    Server_.releaseRequest();
+
+  // Reset request state
+  RequestStage_ = 0;
+  Context.Admitted = false;
+  Context.method = hmUnknown;
+  Context.function = fnUnknown;
+  Context.Endpoint = nullptr;
+  Context.Encoding = ceIdentity;
+  Context.Format = rfJson;
+  Context.KeepAlive = false;
+  Context.Dispatched = false;
+  Context.Request.clear();
+  Context.CacheKey.clear();
+  Context.CacheData.clear();
+  Context.Body = nullptr;
+  Context.StartTime = 0;
+  Context.HandlerTime = 0;
+  Context.ReplyTime = 0;
+  Context.WriteTime = 0;
+  Context.SessionDuration = 0;
+  Context.SerializeDuration = 0;
+  Context.BytesIn = 0;
+  Context.BytesOut = 0;
+  Context.Error = false;
+  httpRequestParserInit(&ParserState);
+  shrinkBuffer();
+
+  if (oldDataSize) {
+    // Next pipelined request already received
+    httpRequestSetBuffer(&ParserState, Buffer_, oldDataSize);
+    parseRequest();
+  } else {
+    readNext();
+  }
+}
+
+void PoolHttpConnection::replyStatus200(xmstream &stream)
+{
+  // Depends on connection state, cached responses start right after it
+  const char status200[] = "HTTP/1.1 200 OK\r\n";
+  const char keepAlive[] = "Connection: keep-alive\r\n";
+  const char connectionClose[] = "Connection: close\r\n";
+  stream.write(status200, sizeof(status200)-1);
+  if (Context.KeepAlive)
+    stream.write(keepAlive, sizeof(keepAlive)-1);
+  else
+    stream.write(connectionClose, sizeof(connectionClose)-1);
+}
+
+void PoolHttpConnection::reply200(xmstream &stream, EContentEncoding encoding)
+{
+  // Handlers start reply serialization here
+  if (!Context.ReplyTime)
+    Context.ReplyTime = monotonicTimeUs();
+  replyStatus200(stream);
+  // Body is compressed by finishChunk, headers are rewritten then
+  Context.Body = &stream;
+  Context.HeadersOffset = stream.offsetOf();
+  reply200Headers(stream, encoding);
+}
+
+void PoolHttpConnection::reply200Headers(xmstream &stream, EContentEncoding encoding)
+{
+  const char headers[] = "Server: bcnode\r\nTransfer-Encoding: chunked\r\n";
+  stream.write(headers, sizeof(headers)-1);
+  if (Context.Format != rfJson) {
+    stream.write("Content-Type: ");
+    stream.write(replyFormatContentType(Context.Format));
+    stream.write("\r\nVary: Accept\r\n");
+  }
+  if (encoding != ceIdentity) {
+    stream.write("Content-Encoding: ");
+    stream.write(contentEncodingName(encoding));
+    stream.write("\r\nVary: Accept-Encoding\r\n");
+  }
+  stream.write("\r\n", 2);
+}
+
+void PoolHttpConnection::reply429()
 {
-  const char reply200[] = "HTTP/1.1 200 OK\r\nServer: bcnode\r\nTransfer-Encoding: chunked\r\n\r\n";
-  stream.write(reply200, sizeof(reply200)-1);
+  const char reply429[] = "HTTP/1.1 429 Too Many Requests\r\nServer: bcnode\r\nRetry-After: 1\r\nContent-Length: 0\r\n";
+  const char keepAlive[] = "Connection: keep-alive\r\n\r\n";
+  const char connectionClose[] = "Connection: close\r\n\r\n";
+
+  char buffer[256];
+  xmstream stream(buffer, sizeof(buffer));
+  Context.CacheKey.clear();
+  Context.Error = true;
+  stream.write(reply429, sizeof(reply429)-1);
+  if (Context.KeepAlive)
+    stream.write(keepAlive, sizeof(keepAlive)-1);
+  else
+    stream.write(connectionClose, sizeof(connectionClose)-1);
+  sendReply(stream);
 }
 
 void PoolHttpConnection::reply404()
 {
-  const char reply404[] = "HTTP/1.1 404 Not Found\r\nServer: bcnode\r\nTransfer-Encoding: chunked\r\n\r\n";
+  const char reply404[] = "HTTP/1.1 404 Not Found\r\nServer: bcnode\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n";
   const char html[] = "<html><head><title>Not Found</title></head><body><h1>404 Not Found</h1></body></html>";
 
   char buffer[4096];
   xmstream stream(buffer, sizeof(buffer));
+  Context.KeepAlive = false;
+  Context.Error = true;
   stream.write(reply404, sizeof(reply404)-1);
 
   size_t offset = startChunk(stream);
   stream.write(html);
   finishChunk(stream, offset);
 
-  aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+  sendReply(stream);
 }
 
 size_t PoolHttpConnection::startChunk(xmstream &stream)
@@ -361,137 +792,456 @@ size_t PoolHttpConnection::startChunk(xmstream &stream)
   return offset;
 }
 
-void PoolHttpConnection::finishChunk(xmstream &stream, size_t offset)
+void PoolHttpConnection::closeChunk(xmstream &stream, size_t offset)
 {
   char hex[16];
-  char finishData[] = "\r\n0\r\n\r\n";
   snprintf(hex, sizeof(hex), "%08x", static_cast<unsigned>(stream.offsetOf() - offset - 10));
   memcpy(stream.data<uint8_t>() + offset, hex, 8);
-  stream.write(finishData, sizeof(finishData));
+  stream.write("\r\n", 2);
 }
 
-void PoolHttpConnection::close()
+void PoolHttpConnection::finishChunk(xmstream &stream, size_t offset)
 {
-  if (Deleted_++ == 0)
-    deleteAioObject(Socket_);
+  char lastChunk[] = "0\r\n\r\n";
+  if (&stream == Context.Body) {
+    Context.Body = nullptr;
+    if (compressBody(stream, offset))
+      return;
+  }
+
+  closeChunk(stream, offset);
+  stream.write(lastChunk, sizeof(lastChunk)-1);
 }
 
-void PoolHttpConnection::onUserAction(rapidjson::Document &document)
+bool PoolHttpConnection::compressBody(xmstream &stream, size_t offset)
 {
-  std::string actionId;
-  std::string newPassword;
-  std::string totp;
-  bool validAcc = true;
-  jsonParseString(document, "actionId", actionId, &validAcc);
-  jsonParseString(document, "newPassword", newPassword, "", &validAcc);
-  jsonParseString(document, "totp", totp, "", &validAcc);
-  if (!validAcc) {
-    replyWithStatus("json_format_error");
+  // Payload follows chunk size placeholder written by startChunk
+  size_t payloadOffset = offset + 10;
+  size_t payloadSize = stream.sizeOf() - payloadOffset;
+  if (Context.Encoding == ceIdentity || payloadSize < Server_.config().HttpCompressionThreshold)
+    return false;
+
+  static thread_local CCompressor compressor;
+  if (!compressor.init(Context.Encoding, Server_.config().HttpCompressionLevel))
+    return false;
+
+  xmstream compressed;
+  compressor.write(compressed, stream.data<uint8_t>() + payloadOffset, payloadSize, true);
+
+  // Status line stays, headers get Content-Encoding, body becomes compressed payload
+  stream.seekSet(Context.HeadersOffset);
+  stream.truncate();
+  reply200Headers(stream, Context.Encoding);
+  size_t chunkOffset = startChunk(stream);
+  stream.write(compressed.data(), compressed.sizeOf());
+  finishChunk(stream, chunkOffset);
+  return true;
+}
+
+void PoolHttpConnection::sendStreamingReply(std::unique_ptr<CStreamingReply> reply)
+{
+  if (Parent_) {
+    // Batch response is assembled in memory anyway
+    xmstream payload;
+    while (reply->next(payload))
+      continue;
+    Parent_->onBatchResult(BatchIndex_, std::string(payload.data<const char>(), payload.sizeOf()));
     return;
   }
 
+  // Keep connection alive until last part written
   objectIncrementReference(aioObjectHandle(Socket_), 1);
-  Server_.userManager().userAction(actionId, newPassword, totp, [this](const char *status) {
-    replyWithStatus(status);
-    objectDecrementReference(aioObjectHandle(Socket_), 1);
-  });
+  StreamingReply_ = std::move(reply);
+  StreamingBuffer_.reset(new xmstream);
+  writeStreamingPart(true);
 }
 
-void PoolHttpConnection::onUserCreate(rapidjson::Document &document)
+void PoolHttpConnection::writeStreamingPart(bool first)
 {
-  bool validAcc = true;
-  std::string sessionId;
-  UserManager::Credentials credentials;
+  const char lastChunk[] = "0\r\n\r\n";
+  int64_t serializeStart = monotonicTimeUs();
+  if (first && !Context.ReplyTime)
+    Context.ReplyTime = serializeStart;
+  xmstream &payload = *StreamingBuffer_;
+  payload.reset();
+  bool hasMore = StreamingReply_->next(payload);
+
+  xmstream stream(payload.sizeOf() + 256);
+  size_t cachedOffset = 0;
+  if (first) {
+    // Compress if response has multiple parts or first part is large enough
+    EContentEncoding encoding = ceIdentity;
+    if (Context.Encoding != ceIdentity && (hasMore || payload.sizeOf() >= Server_.config().HttpCompressionThreshold)) {
+      StreamingCompressor_.reset(new CCompressor);
+      if (StreamingCompressor_->init(Context.Encoding, Server_.config().HttpCompressionLevel))
+        encoding = Context.Encoding;
+      else
+        StreamingCompressor_.reset();
+    }
 
-  jsonParseString(document, "id", sessionId, "", &validAcc);
-  parseUserCredentials(document, credentials, &validAcc);
+    replyStatus200(stream);
+    cachedOffset = stream.sizeOf();
+    reply200Headers(stream, encoding);
+  }
 
-  if (!validAcc) {
-    replyWithStatus("json_format_error");
+  size_t offset = startChunk(stream);
+  if (StreamingCompressor_)
+    StreamingCompressor_->write(stream, payload.data(), payload.sizeOf(), !hasMore);
+  else
+    stream.write(payload.data(), payload.sizeOf());
+  closeChunk(stream, offset);
+  if (!hasMore)
+    stream.write(lastChunk, sizeof(lastChunk)-1);
+
+  if (!Context.CacheKey.empty()) {
+    // Don't cache large responses
+    Context.CacheData.append(stream.data<const char>() + cachedOffset, stream.sizeOf() - cachedOffset);
+    if (Context.CacheData.size() > MaxCachedResponseSize) {
+      Context.CacheKey.clear();
+      Context.CacheData.clear();
+    }
+  }
+
+  Context.BytesOut += stream.sizeOf();
+  Context.SerializeDuration += monotonicTimeUs() - serializeStart;
+  traceSpan("serialize", serializeStart);
+  if (hasMore) {
+    // Backend callback arguments are gone after return, next part can be written from other thread
+    if (first)
+      StreamingReply_->detach();
+    aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, streamWriteCb, this);
     return;
   }
 
-  UserManager::UserWithAccessRights tokenInfo;
-  if (!sessionId.empty()) {
-    if (!Server_.userManager().validateSession(sessionId, "", tokenInfo, false)) {
-      replyWithStatus("unknown_id");
-      return;
-    }
+  Context.WriteTime = monotonicTimeUs();
+
+  if (!Context.CacheKey.empty()) {
+    Server_.responseCache().put(Context.CacheKey, Context.CacheGeneration, std::move(Context.CacheData));
+    Context.CacheKey.clear();
+    Context.CacheData.clear();
   }
 
-  objectIncrementReference(aioObjectHandle(Socket_), 1);
-  Server_.userManager().userCreate(tokenInfo.Login, std::move(credentials), [this](const char *status) {
-    replyWithStatus(status);
+  StreamingReply_.reset();
+  StreamingBuffer_.reset();
+  StreamingCompressor_.reset();
+  aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+  objectDecrementReference(aioObjectHandle(Socket_), 1);
+}
+
+void PoolHttpConnection::onStreamWrite(AsyncOpStatus status)
+{
+  if (status != aosSuccess) {
+    // Client gone, finish request and close connection
+    StreamingReply_.reset();
+    StreamingBuffer_.reset();
+    StreamingCompressor_.reset();
+    Context.KeepAlive = false;
+    Context.CacheKey.clear();
+    Context.CacheData.clear();
+    onWrite();
     objectDecrementReference(aioObjectHandle(Socket_), 1);
-  });
+    return;
+  }
+
+  writeStreamingPart(false);
 }
 
-void PoolHttpConnection::onUserResendEmail(rapidjson::Document &document)
+bool PoolHttpConnection::pushEvent(const CEventFrame &frame)
 {
-  bool validAcc = true;
-  UserManager::Credentials credentials;
-  parseUserCredentials(document, credentials, &validAcc);
+  {
+    std::lock_guard<std::mutex> lock(Events_->Mutex);
+    if (Events_->Closed)
+      return false;
+
+    if (Events_->Current) {
+      // Stats frames are snapshots, next tick replaces dropped ones
+      if (Events_->Queue.size() < MaxQueuedEvents)
+        Events_->Queue.push_back(frame);
+      return true;
+    }
 
-  if (!validAcc) {
-    replyWithStatus("json_format_error");
-    return;
+    Events_->Current = frame;
   }
 
-  objectIncrementReference(aioObjectHandle(Socket_), 1);
-  Server_.userManager().userResendEmail(std::move(credentials), [this](const char *status) {
-    replyWithStatus(status);
-    objectDecrementReference(aioObjectHandle(Socket_), 1);
-  });
+  aioWrite(Socket_, frame->data(), frame->size(), afWaitAll, 0, eventWriteCb, this);
+  return true;
 }
 
-void PoolHttpConnection::onUserLogin(rapidjson::Document &document)
+bool PoolHttpConnection::eventStreamClosed()
 {
-  bool validAcc = true;
-  UserManager::Credentials credentials;
-  parseUserCredentials(document, credentials, &validAcc);
+  {
+    std::lock_guard<std::mutex> lock(Events_->Mutex);
+    if (Events_->Closed)
+      return true;
+  }
 
-  if (!validAcc) {
-    replyWithStatus("json_format_error");
-    return;
+  // Logout or password change ends user statistic stream
+  UserManager::UserWithAccessRights tokenInfo;
+  if (Events_->SessionId.empty() || Server_.validateSession(Events_->SessionId, Events_->TargetLogin, tokenInfo, false))
+    return false;
+
+  {
+    std::lock_guard<std::mutex> lock(Events_->Mutex);
+    Events_->Closed = true;
+    Events_->Queue.clear();
   }
 
-  objectIncrementReference(aioObjectHandle(Socket_), 1);
-  Server_.userManager().userLogin(std::move(credentials), [this](const std::string &sessionId, const char *status, bool isReadOnly) {
-    xmstream stream;
-    reply200(stream);
-    size_t offset = startChunk(stream);
+  close();
+  return true;
+}
 
-    {
-      JSON::Object result(stream);
-      result.addString("status", status);
-      result.addString("sessionid", sessionId);
-      result.addBoolean("isReadOnly", isReadOnly);
-    }
+void PoolHttpConnection::acquireSubscriber()
+{
+  objectIncrementReference(aioObjectHandle(Socket_), 1);
+}
 
-    finishChunk(stream, offset);
-    aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
-    objectDecrementReference(aioObjectHandle(Socket_), 1);
-  });
+void PoolHttpConnection::releaseSubscriber()
+{
+  objectDecrementReference(aioObjectHandle(Socket_), 1);
 }
 
-void PoolHttpConnection::onUserLogout(rapidjson::Document &document)
+void PoolHttpConnection::onEventWrite(AsyncOpStatus status)
 {
-  bool validAcc = true;
-  std::string sessionId;
-  jsonParseString(document, "id", sessionId, &validAcc);
-  if (!validAcc) {
-    replyWithStatus("json_format_error");
-    return;
+  CEventFrame frame;
+  {
+    std::lock_guard<std::mutex> lock(Events_->Mutex);
+    Events_->Current.reset();
+    if (status == aosSuccess && !Events_->Closed && !Events_->Queue.empty()) {
+      frame = std::move(Events_->Queue.front());
+      Events_->Queue.pop_front();
+      Events_->Current = frame;
+    } else if (status != aosSuccess) {
+      Events_->Closed = true;
+      Events_->Queue.clear();
+    }
   }
 
-  objectIncrementReference(aioObjectHandle(Socket_), 1);
-  Server_.userManager().userLogout(sessionId, [this](const char *status) {
-    replyWithStatus(status);
-    objectDecrementReference(aioObjectHandle(Socket_), 1);
-  });
+  if (frame)
+    aioWrite(Socket_, frame->data(), frame->size(), afWaitAll, 0, eventWriteCb, this);
+  else if (status != aosSuccess)
+    close();
 }
 
-void PoolHttpConnection::onUserQueryMonitoringSession(rapidjson::Document &document)
+void PoolHttpConnection::onEventRead()
+{
+  // Client disconnected (or sent unexpected data), registry releases connection on next tick
+  {
+    std::lock_guard<std::mutex> lock(Events_->Mutex);
+    Events_->Closed = true;
+    Events_->Queue.clear();
+  }
+
+  close();
+}
+
+bool PoolHttpConnection::checkBodySize(size_t size)
+{
+  if (!Context.Endpoint) {
+    reply404();
+    return false;
+  }
+
+  if (Context.Request.size() + size <= Context.Endpoint->MaxBodySize)
+    return true;
+
+  // Parser will be cancelled, connection closed after write
+  const char reply413[] = "HTTP/1.1 413 Payload Too Large\r\nServer: bcnode\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+  xmstream stream;
+  Context.KeepAlive = false;
+  Context.Dispatched = true;
+  Context.Error = true;
+  stream.write(reply413, sizeof(reply413)-1);
+  sendReply(stream);
+  return false;
+}
+
+// Headers (without empty line) and chunked body of successful reply built with reply200
+static bool replyBody(std::string_view response, std::string_view &headers, std::string_view &body)
+{
+  const char status200[] = "HTTP/1.1 200 OK\r\n";
+  size_t headersEnd = response.find("\r\n\r\n");
+  if (!response.starts_with(status200) || headersEnd == response.npos)
+    return false;
+
+  headers = response.substr(0, headersEnd + 2);
+  body = response.substr(headersEnd + 4);
+  return true;
+}
+
+template<typename ChunkFn>
+static bool forEachChunk(std::string_view body, ChunkFn chunk)
+{
+  while (!body.empty()) {
+    size_t lineEnd = body.find("\r\n");
+    if (lineEnd == body.npos)
+      return false;
+    size_t chunkSize = strtoul(std::string(body.substr(0, lineEnd)).c_str(), nullptr, 16);
+    if (chunkSize == 0)
+      break;
+    if (body.size() < lineEnd + 2 + chunkSize + 2)
+      return false;
+    chunk(body.data() + lineEnd + 2, chunkSize);
+    body.remove_prefix(lineEnd + 2 + chunkSize + 2);
+  }
+
+  return true;
+}
+
+void PoolHttpConnection::sendReply(xmstream &stream)
+{
+  std::string_view response(stream.data<const char>(), stream.sizeOf());
+  if (Parent_) {
+    Parent_->onBatchReply(BatchIndex_, response);
+    return;
+  }
+
+  Context.WriteTime = monotonicTimeUs();
+  if (!Context.ReplyTime)
+    Context.ReplyTime = Context.WriteTime;
+  Context.SerializeDuration = Context.WriteTime - Context.ReplyTime;
+  Context.BytesOut += response.size();
+  if (Context.Trace)
+    Context.Trace->span("serialize", Context.ReplyTime, Context.WriteTime);
+
+  if (!Context.CacheKey.empty()) {
+    // Store response without status line and 'Connection' header, they depend on connection state
+    size_t statusEnd = response.find("\r\n");
+    size_t connectionEnd = statusEnd != response.npos ? response.find("\r\n", statusEnd + 2) : response.npos;
+    if (connectionEnd != response.npos)
+      Server_.responseCache().put(Context.CacheKey, Context.CacheGeneration, std::string(response.substr(connectionEnd + 2)));
+    Context.CacheKey.clear();
+  }
+
+  aioWrite(Socket_, response.data(), response.size(), afWaitAll, 0, writeCb, this);
+}
+
+void PoolHttpConnection::close()
+{
+  if (Deleted_++ == 0)
+    deleteAioObject(Socket_);
+}
+
+void PoolHttpConnection::onUserAction(CRequestDocument &document)
+{
+  std::string actionId;
+  std::string newPassword;
+  std::string totp;
+  bool validAcc = true;
+  jsonParseString(document, "actionId", actionId, &validAcc);
+  jsonParseString(document, "newPassword", newPassword, "", &validAcc);
+  jsonParseString(document, "totp", totp, "", &validAcc);
+  if (!validAcc) {
+    replyWithStatus("json_format_error");
+    return;
+  }
+
+  objectIncrementReference(aioObjectHandle(Socket_), 1);
+  Server_.userManager().userAction(actionId, newPassword, totp, [this](const char *status) {
+    // Action can change password or activate 2FA
+    if (strcmp(status, "ok") == 0)
+      Server_.sessionCache().invalidate();
+    replyWithStatus(status);
+    objectDecrementReference(aioObjectHandle(Socket_), 1);
+  });
+}
+
+void PoolHttpConnection::onUserCreate(CRequestDocument &document)
+{
+  bool validAcc = true;
+  std::string sessionId;
+  UserManager::Credentials credentials;
+
+  jsonParseString(document, "id", sessionId, "", &validAcc);
+  parseUserCredentials(document, credentials, &validAcc);
+
+  if (!validAcc) {
+    replyWithStatus("json_format_error");
+    return;
+  }
+
+  UserManager::UserWithAccessRights tokenInfo;
+  if (!sessionId.empty()) {
+    if (!validateSession(sessionId, "", tokenInfo, false)) {
+      replyWithStatus("unknown_id");
+      return;
+    }
+  }
+
+  objectIncrementReference(aioObjectHandle(Socket_), 1);
+  Server_.userManager().userCreate(tokenInfo.Login, std::move(credentials), [this](const char *status) {
+    replyWithStatus(status);
+    objectDecrementReference(aioObjectHandle(Socket_), 1);
+  });
+}
+
+void PoolHttpConnection::onUserResendEmail(CRequestDocument &document)
+{
+  bool validAcc = true;
+  UserManager::Credentials credentials;
+  parseUserCredentials(document, credentials, &validAcc);
+
+  if (!validAcc) {
+    replyWithStatus("json_format_error");
+    return;
+  }
+
+  objectIncrementReference(aioObjectHandle(Socket_), 1);
+  Server_.userManager().userResendEmail(std::move(credentials), [this](const char *status) {
+    replyWithStatus(status);
+    objectDecrementReference(aioObjectHandle(Socket_), 1);
+  });
+}
+
+void PoolHttpConnection::onUserLogin(CRequestDocument &document)
+{
+  bool validAcc = true;
+  UserManager::Credentials credentials;
+  parseUserCredentials(document, credentials, &validAcc);
+
+  if (!validAcc) {
+    replyWithStatus("json_format_error");
+    return;
+  }
+
+  objectIncrementReference(aioObjectHandle(Socket_), 1);
+  Server_.userManager().userLogin(std::move(credentials), [this](const std::string &sessionId, const char *status, bool isReadOnly) {
+    xmstream stream;
+    reply200(stream);
+    size_t offset = startChunk(stream);
+
+    {
+      JSON::Object result(stream);
+      result.addString("status", status);
+      result.addString("sessionid", sessionId);
+      result.addBoolean("isReadOnly", isReadOnly);
+    }
+
+    finishChunk(stream, offset);
+    sendReply(stream);
+    objectDecrementReference(aioObjectHandle(Socket_), 1);
+  });
+}
+
+void PoolHttpConnection::onUserLogout(CRequestDocument &document)
+{
+  bool validAcc = true;
+  std::string sessionId;
+  jsonParseString(document, "id", sessionId, &validAcc);
+  if (!validAcc) {
+    replyWithStatus("json_format_error");
+    return;
+  }
+
+  objectIncrementReference(aioObjectHandle(Socket_), 1);
+  Server_.userManager().userLogout(sessionId, [this](const char *status) {
+    if (strcmp(status, "ok") == 0)
+      Server_.sessionCache().invalidate();
+    replyWithStatus(status);
+    objectDecrementReference(aioObjectHandle(Socket_), 1);
+  });
+}
+
+void PoolHttpConnection::onUserQueryMonitoringSession(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -516,22 +1266,22 @@ void PoolHttpConnection::onUserQueryMonitoringSession(rapidjson::Document &docum
     }
 
     finishChunk(stream, offset);
-    aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+    sendReply(stream);
     objectDecrementReference(aioObjectHandle(Socket_), 1);
   });
 }
 
-void PoolHttpConnection::onUserChangeEmail(rapidjson::Document&)
+void PoolHttpConnection::onUserChangeEmail(CRequestDocument&)
 {
   xmstream stream;
   reply200(stream);
   size_t offset = startChunk(stream);
   stream.write("{\"error\": \"not implemented\"}\n");
   finishChunk(stream, offset);
-  aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+  sendReply(stream);
 }
 
-void PoolHttpConnection::onUserChangePasswordInitiate(rapidjson::Document &document)
+void PoolHttpConnection::onUserChangePasswordInitiate(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string login;
@@ -548,7 +1298,7 @@ void PoolHttpConnection::onUserChangePasswordInitiate(rapidjson::Document &docum
   });
 }
 
-void PoolHttpConnection::onUserChangePasswordForce(rapidjson::Document &document)
+void PoolHttpConnection::onUserChangePasswordForce(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string id;
@@ -564,12 +1314,14 @@ void PoolHttpConnection::onUserChangePasswordForce(rapidjson::Document &document
 
   objectIncrementReference(aioObjectHandle(Socket_), 1);
   Server_.userManager().userChangePasswordForce(id, login, newPassword, [this](const char *status) {
+    if (strcmp(status, "ok") == 0)
+      Server_.sessionCache().invalidate();
     replyWithStatus(status);
     objectDecrementReference(aioObjectHandle(Socket_), 1);
   });
 }
 
-void PoolHttpConnection::onUserGetCredentials(rapidjson::Document &document)
+void PoolHttpConnection::onUserGetCredentials(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -587,7 +1339,7 @@ void PoolHttpConnection::onUserGetCredentials(rapidjson::Document &document)
 
   UserManager::UserWithAccessRights tokenInfo;
   UserManager::Credentials credentials;
-  if (Server_.userManager().validateSession(sessionId, targetLogin, tokenInfo, false)) {
+  if (validateSession(sessionId, targetLogin, tokenInfo, false)) {
     JSON::Object result(stream);
     if (Server_.userManager().getUserCredentials(tokenInfo.Login, credentials)) {
       result.addString("status", "ok");
@@ -608,10 +1360,10 @@ void PoolHttpConnection::onUserGetCredentials(rapidjson::Document &document)
   }
 
   finishChunk(stream, offset);
-  aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+  sendReply(stream);
 }
 
-void PoolHttpConnection::onUserGetSettings(rapidjson::Document &document)
+void PoolHttpConnection::onUserGetSettings(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -630,7 +1382,7 @@ void PoolHttpConnection::onUserGetSettings(rapidjson::Document &document)
   {
     JSON::Object object(stream);
     UserManager::UserWithAccessRights tokenInfo;
-    if (Server_.userManager().validateSession(sessionId, targetLogin, tokenInfo, false)) {
+    if (validateSession(sessionId, targetLogin, tokenInfo, false)) {
       object.addString("status", "ok");
       object.addField("coins");
       JSON::Array coins(stream);
@@ -655,10 +1407,10 @@ void PoolHttpConnection::onUserGetSettings(rapidjson::Document &document)
   }
 
   finishChunk(stream, offset);
-  aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+  sendReply(stream);
 }
 
-void PoolHttpConnection::onUserUpdateCredentials(rapidjson::Document &document)
+void PoolHttpConnection::onUserUpdateCredentials(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -676,12 +1428,15 @@ void PoolHttpConnection::onUserUpdateCredentials(rapidjson::Document &document)
 
   objectIncrementReference(aioObjectHandle(Socket_), 1);
   Server_.userManager().updateCredentials(sessionId, targetLogin, std::move(credentials), [this](const char *status) {
+    // Access rights (read-only flag) can be changed
+    if (strcmp(status, "ok") == 0)
+      Server_.sessionCache().invalidate();
     replyWithStatus(status);
     objectDecrementReference(aioObjectHandle(Socket_), 1);
   });
 }
 
-void PoolHttpConnection::onUserUpdateSettings(rapidjson::Document &document)
+void PoolHttpConnection::onUserUpdateSettings(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -719,7 +1474,7 @@ void PoolHttpConnection::onUserUpdateSettings(rapidjson::Document &document)
     return;
   }
 
-  if (!Server_.userManager().validateSession(sessionId, targetLogin, tokenInfo, true)) {
+  if (!validateSession(sessionId, targetLogin, tokenInfo, true)) {
     replyWithStatus("unknown_id");
     return;
   }
@@ -733,7 +1488,7 @@ void PoolHttpConnection::onUserUpdateSettings(rapidjson::Document &document)
   });
 }
 
-void PoolHttpConnection::onUserEnumerateAll(rapidjson::Document &document)
+void PoolHttpConnection::onUserEnumerateAll(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -756,6 +1511,10 @@ void PoolHttpConnection::onUserEnumerateAll(rapidjson::Document &document)
     return;
   }
 
+  uint32_t fields;
+  if (!parseFieldsArgument(document, rtUser, &fields))
+    return;
+
   // sortBy convert
   StatisticDb::CredentialsWithStatistic::EColumns column;
   if (sortBy == "login") {
@@ -779,48 +1538,34 @@ void PoolHttpConnection::onUserEnumerateAll(rapidjson::Document &document)
     return;
   }
 
-  objectIncrementReference(aioObjectHandle(Socket_), 1);
-  Server_.userManager().enumerateUsers(sessionId, [this, statistic, offset, size, column, sortDescending](const char *status, std::vector<UserManager::Credentials> &allUsers) {
-    statistic->queryAllusersStats(std::move(allUsers), [this, status](const std::vector<StatisticDb::CredentialsWithStatistic> &result) {
-      xmstream stream;
-      reply200(stream);
-      size_t offset = startChunk(stream);
-
-      {
-        JSON::Object object(stream);
-        object.addString("status", status);
-        object.addField("users");
-        {
-          JSON::Array usersArray(stream);
-          for (const auto &user: result) {
-            usersArray.addField();
-            {
-              JSON::Object userObject(stream);
-              userObject.addString("login", user.Credentials.Login);
-              userObject.addString("name", user.Credentials.Name);
-              userObject.addString("email", user.Credentials.EMail);
-              userObject.addInt("registrationDate", user.Credentials.RegistrationDate);
-              userObject.addBoolean("isActive", user.Credentials.IsActive);
-              userObject.addBoolean("isReadOnly", user.Credentials.IsReadOnly);
-              userObject.addString("feePlanId", user.Credentials.FeePlan);
-              userObject.addInt("workers", user.WorkersNum);
-              userObject.addDouble("shareRate", user.SharesPerSecond);
-              userObject.addInt("power", user.AveragePower);
-              userObject.addInt("lastShareTime", user.LastShareTime);
-            }
-          }
-        }
-      }
-
-      finishChunk(stream, offset);
-      aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
-      objectDecrementReference(aioObjectHandle(Socket_), 1);
+  CBackendLoad &load = Server_.backendLoad(statistic);
+  if (backendOverloaded(load))
+    return;
 
-    }, offset, size, column, sortDescending);
+  EQueryPriority priority = Context.Endpoint->Priority;
+  int64_t enumerateTime = monotonicTimeUs();
+  objectIncrementReference(aioObjectHandle(Socket_), 1);
+  Server_.userManager().enumerateUsers(sessionId, [this, statistic, &load, priority, offset, size, column, sortDescending, fields, enumerateTime](const char *status, std::vector<UserManager::Credentials> &allUsers) {
+    traceSpan("enumerateUsers", enumerateTime);
+    int64_t submitTime = monotonicTimeUs();
+    load.submit(priority, [this, statistic, status, &load, allUsers = std::move(allUsers), offset, size, column, sortDescending, fields, submitTime](uint64_t ticket) mutable {
+      traceSpan("backendQueue", submitTime);
+      int64_t queryTime = monotonicTimeUs();
+      statistic->queryAllusersStats(std::move(allUsers), [this, status, &load, ticket, fields, queryTime](const std::vector<StatisticDb::CredentialsWithStatistic> &result) {
+        traceSpan("queryAllusersStats", queryTime);
+        load.leave(ticket);
+        sendStreamingReply(arrayStreamingReply(Context.Format, "users", CReplyRows(result), [status](auto &object) {
+          object.addString("status", status);
+        }, [format = Context.Format, fields](xmstream &stream, const StatisticDb::CredentialsWithStatistic &user) {
+          serializeUserRow(stream, format, user, fields);
+        }));
+        objectDecrementReference(aioObjectHandle(Socket_), 1);
+      }, offset, size, column, sortDescending);
+    });
   });
 }
 
-void PoolHttpConnection::onUserUpdateFeePlan(rapidjson::Document &document)
+void PoolHttpConnection::onUserUpdateFeePlan(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -882,7 +1627,7 @@ void PoolHttpConnection::onUserUpdateFeePlan(rapidjson::Document &document)
   });
 }
 
-void PoolHttpConnection::onUserEnumerateFeePlan(rapidjson::Document &document)
+void PoolHttpConnection::onUserEnumerateFeePlan(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -913,13 +1658,13 @@ void PoolHttpConnection::onUserEnumerateFeePlan(rapidjson::Document &document)
     }
 
     finishChunk(stream, offset);
-    aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+    sendReply(stream);
   } else {
     replyWithStatus(status.c_str());
   }
 }
 
-void PoolHttpConnection::onUserGetFeePlan(rapidjson::Document &document)
+void PoolHttpConnection::onUserGetFeePlan(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -946,13 +1691,13 @@ void PoolHttpConnection::onUserGetFeePlan(rapidjson::Document &document)
     }
 
     finishChunk(stream, offset);
-    aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+    sendReply(stream);
   } else {
     replyWithStatus(status.c_str());
   }
 }
 
-void PoolHttpConnection::onUserChangeFeePlan(rapidjson::Document &document)
+void PoolHttpConnection::onUserChangeFeePlan(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -973,7 +1718,7 @@ void PoolHttpConnection::onUserChangeFeePlan(rapidjson::Document &document)
   });
 }
 
-void PoolHttpConnection::onUserActivate2faInitiate(rapidjson::Document &document)
+void PoolHttpConnection::onUserActivate2faInitiate(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -998,12 +1743,12 @@ void PoolHttpConnection::onUserActivate2faInitiate(rapidjson::Document &document
     }
 
     finishChunk(stream, offset);
-    aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+    sendReply(stream);
     objectDecrementReference(aioObjectHandle(Socket_), 1);
   });
 }
 
-void PoolHttpConnection::onUserDeactivate2faInitiate(rapidjson::Document &document)
+void PoolHttpConnection::onUserDeactivate2faInitiate(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -1022,7 +1767,7 @@ void PoolHttpConnection::onUserDeactivate2faInitiate(rapidjson::Document &docume
   });
 }
 
-void PoolHttpConnection::onBackendManualPayout(rapidjson::Document &document)
+void PoolHttpConnection::onBackendManualPayout(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -1038,7 +1783,7 @@ void PoolHttpConnection::onBackendManualPayout(rapidjson::Document &document)
 
   // id -> login
   UserManager::UserWithAccessRights login;
-  if (!Server_.userManager().validateSession(sessionId, targetLogin, login, true)) {
+  if (!validateSession(sessionId, targetLogin, login, true)) {
     replyWithStatus("unknown_id");
     return;
   }
@@ -1056,7 +1801,7 @@ void PoolHttpConnection::onBackendManualPayout(rapidjson::Document &document)
   });
 }
 
-void PoolHttpConnection::onBackendQueryUserBalance(rapidjson::Document &document)
+void PoolHttpConnection::onBackendQueryUserBalance(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -1072,7 +1817,7 @@ void PoolHttpConnection::onBackendQueryUserBalance(rapidjson::Document &document
 
   // id -> login
   UserManager::UserWithAccessRights tokenInfo;
-  if (!Server_.userManager().validateSession(sessionId, targetLogin, tokenInfo, false)) {
+  if (!validateSession(sessionId, targetLogin, tokenInfo, false)) {
     replyWithStatus("unknown_id");
     return;
   }
@@ -1084,33 +1829,40 @@ void PoolHttpConnection::onBackendQueryUserBalance(rapidjson::Document &document
       return;
     }
 
+    CBackendLoad &load = Server_.backendLoad(backend);
+    if (backendOverloaded(load))
+      return;
+
     objectIncrementReference(aioObjectHandle(Socket_), 1);
-    backend->accountingDb()->queryUserBalance(tokenInfo.Login, [this, backend](const AccountingDb::UserBalanceInfo &record) {
-      xmstream stream;
-      reply200(stream);
-      size_t offset = startChunk(stream);
-      const CCoinInfo &coinInfo = backend->getCoinInfo();
-      {
-        JSON::Object object(stream);
-        object.addString("status", "ok");
-        object.addField("balances");
+    load.submit(Context.Endpoint->Priority, [this, backend, &load, login = tokenInfo.Login](uint64_t ticket) {
+      backend->accountingDb()->queryUserBalance(login, [this, backend, &load, ticket](const AccountingDb::UserBalanceInfo &record) {
+        load.leave(ticket);
+        xmstream stream;
+        reply200(stream);
+        size_t offset = startChunk(stream);
+        const CCoinInfo &coinInfo = backend->getCoinInfo();
         {
-          JSON::Array allBalances(stream);
-          allBalances.addField();
+          JSON::Object object(stream);
+          object.addString("status", "ok");
+          object.addField("balances");
           {
-            JSON::Object balance(stream);
-            balance.addString("coin", coinInfo.Name);
-            balance.addString("balance", FormatMoney(record.Data.Balance.getRational(coinInfo.ExtraMultiplier), coinInfo.RationalPartSize));
-            balance.addString("requested", FormatMoney(record.Data.Requested, coinInfo.RationalPartSize));
-            balance.addString("paid", FormatMoney(record.Data.Paid, coinInfo.RationalPartSize));
-            balance.addString("queued", FormatMoney(record.Queued, coinInfo.RationalPartSize));
+            JSON::Array allBalances(stream);
+            allBalances.addField();
+            {
+              JSON::Object balance(stream);
+              balance.addString("coin", coinInfo.Name);
+              balance.addString("balance", FormatMoney(record.Data.Balance.getRational(coinInfo.ExtraMultiplier), coinInfo.RationalPartSize));
+              balance.addString("requested", FormatMoney(record.Data.Requested, coinInfo.RationalPartSize));
+              balance.addString("paid", FormatMoney(record.Data.Paid, coinInfo.RationalPartSize));
+              balance.addString("queued", FormatMoney(record.Queued, coinInfo.RationalPartSize));
+            }
           }
         }
-      }
 
-      finishChunk(stream, offset);
-      aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
-      objectDecrementReference(aioObjectHandle(Socket_), 1);
+        finishChunk(stream, offset);
+        sendReply(stream);
+        objectDecrementReference(aioObjectHandle(Socket_), 1);
+      });
     });
   } else {
     // Ask all backends about balances
@@ -1146,13 +1898,13 @@ void PoolHttpConnection::onBackendQueryUserBalance(rapidjson::Document &document
       }
 
       finishChunk(stream, offset);
-      aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+      sendReply(stream);
       objectDecrementReference(aioObjectHandle(Socket_), 1);
     });
   }
 }
 
-void PoolHttpConnection::onBackendQueryUserStats(rapidjson::Document &document)
+void PoolHttpConnection::onBackendQueryUserStats(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -1175,6 +1927,10 @@ void PoolHttpConnection::onBackendQueryUserStats(rapidjson::Document &document)
     return;
   }
 
+  uint32_t fields;
+  if (!parseFieldsArgument(document, rtWorkerStats, &fields))
+    return;
+
   // sortBy convert
   StatisticDb::EStatsColumn column;
   if (sortBy == "name") {
@@ -1192,7 +1948,7 @@ void PoolHttpConnection::onBackendQueryUserStats(rapidjson::Document &document)
 
   // id -> login
   UserManager::UserWithAccessRights tokenInfo;
-  if (!Server_.userManager().validateSession(sessionId, targetLogin, tokenInfo, false)) {
+  if (!validateSession(sessionId, targetLogin, tokenInfo, false)) {
     replyWithStatus("unknown_id");
     return;
   }
@@ -1203,89 +1959,52 @@ void PoolHttpConnection::onBackendQueryUserStats(rapidjson::Document &document)
     return;
   }
 
+  CBackendLoad &load = Server_.backendLoad(statistic);
+  if (backendOverloaded(load))
+    return;
+
+  int64_t submitTime = monotonicTimeUs();
   objectIncrementReference(aioObjectHandle(Socket_), 1);
-  statistic->queryUserStats(tokenInfo.Login, [this, statistic](const StatisticDb::CStats &aggregate, const std::vector<StatisticDb::CStats> &workers) {
-    xmstream stream;
-    reply200(stream);
-    size_t offset = startChunk(stream);
+  load.submit(Context.Endpoint->Priority, [this, statistic, &load, login = tokenInfo.Login, offset, size, column, sortDescending, fields, submitTime](uint64_t ticket) {
+    traceSpan("backendQueue", submitTime);
+    int64_t queryTime = monotonicTimeUs();
+    statistic->queryUserStats(login, [this, statistic, &load, ticket, fields, queryTime](const StatisticDb::CStats &aggregate, const std::vector<StatisticDb::CStats> &workers) {
+      traceSpan("queryUserStats", queryTime);
+      load.leave(ticket);
+      xmstream stream;
+      reply200(stream);
+      size_t offset = startChunk(stream);
+      serializeUserStats(stream, Context.Format, statistic->getCoinInfo(), time(nullptr), aggregate, workers, fields);
+      finishChunk(stream, offset);
+      sendReply(stream);
+      objectDecrementReference(aioObjectHandle(Socket_), 1);
+    }, offset, size, column, sortDescending);
+  });
+}
 
-    {
-      JSON::Object object(stream);
+void PoolHttpConnection::queryStatsHistory(StatisticDb *statistic, const std::string &login, const std::string &worker, int64_t timeFrom, int64_t timeTo, int64_t groupByInterval, int64_t currentTime, uint32_t fields)
+{
+  // History can be long, read it outside of event loop
+  objectIncrementReference(aioObjectHandle(Socket_), 1);
+  Server_.queryPool().run([this, statistic, login, worker, timeFrom, timeTo, groupByInterval, currentTime, fields]() {
+    std::vector<StatisticDb::CStats> stats;
+    statistic->getHistory(login, worker, timeFrom, timeTo, groupByInterval, stats);
+
+    sendStreamingReply(arrayStreamingReply(Context.Format, "stats", CReplyRows(std::move(stats)), [statistic, currentTime](auto &object) {
       object.addString("status", "ok");
       object.addString("powerUnit", statistic->getCoinInfo().getPowerUnitName());
       object.addInt("powerMultLog10", statistic->getCoinInfo().PowerMultLog10);
-      object.addInt("currentTime", time(nullptr));
-      object.addField("total");
-      {
-        JSON::Object total(stream);
-        total.addInt("clients", aggregate.ClientsNum);
-        total.addInt("workers", aggregate.WorkersNum);
-        total.addDouble("shareRate", aggregate.SharesPerSecond);
-        total.addDouble("shareWork", aggregate.SharesWork);
-        total.addInt("power", aggregate.AveragePower);
-        total.addInt("lastShareTime", aggregate.LastShareTime);
-      }
-
-      object.addField("workers");
-      {
-        JSON::Array workersOutput(stream);
-        for (size_t i = 0, ie = workers.size(); i != ie; ++i) {
-          workersOutput.addField();
-          {
-            JSON::Object workerOutput(stream);
-            workerOutput.addString("name", workers[i].WorkerId);
-            workerOutput.addDouble("shareRate", workers[i].SharesPerSecond);
-            workerOutput.addDouble("shareWork", workers[i].SharesWork);
-            workerOutput.addInt("power", workers[i].AveragePower);
-            workerOutput.addInt("lastShareTime", workers[i].LastShareTime);
-          }
-        }
-      }
-    }
-
-    finishChunk(stream, offset);
-    aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+      object.addInt("currentTime", currentTime);
+    }, [format = Context.Format, fields](xmstream &stream, const StatisticDb::CStats &stats) {
+      serializeStatsHistoryRow(stream, format, stats, fields);
+    }));
     objectDecrementReference(aioObjectHandle(Socket_), 1);
-  }, offset, size, column, sortDescending);
-}
-
-void PoolHttpConnection::queryStatsHistory(StatisticDb *statistic, const std::string &login, const std::string &worker, int64_t timeFrom, int64_t timeTo, int64_t groupByInterval, int64_t currentTime)
-{
-  std::vector<StatisticDb::CStats> stats;
-  statistic->getHistory(login, worker, timeFrom, timeTo, groupByInterval, stats);
-
-  xmstream stream;
-  reply200(stream);
-  size_t offset = startChunk(stream);
-
-  {
-    JSON::Object object(stream);
-    object.addString("status", "ok");
-    object.addString("powerUnit", statistic->getCoinInfo().getPowerUnitName());
-    object.addInt("powerMultLog10", statistic->getCoinInfo().PowerMultLog10);
-    object.addInt("currentTime", currentTime);
-    object.addField("stats");
-    {
-      JSON::Array workersOutput(stream);
-      for (size_t i = 0, ie = stats.size(); i != ie; ++i) {
-        workersOutput.addField();
-        {
-          JSON::Object workerOutput(stream);
-          workerOutput.addString("name", stats[i].WorkerId);
-          workerOutput.addInt("time", stats[i].Time);
-          workerOutput.addDouble("shareRate", stats[i].SharesPerSecond);
-          workerOutput.addDouble("shareWork", stats[i].SharesWork);
-          workerOutput.addInt("power", stats[i].AveragePower);
-        }
-      }
-    }
-  }
-
-  finishChunk(stream, offset);
-  aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+  }, [this]() {
+    objectDecrementReference(aioObjectHandle(Socket_), 1);
+  });
 }
 
-void PoolHttpConnection::onBackendQueryUserStatsHistory(rapidjson::Document &document)
+void PoolHttpConnection::onBackendQueryUserStatsHistory(CRequestDocument &document)
 {
   bool validAcc = true;
   int64_t currentTime = time(nullptr);
@@ -1307,9 +2026,13 @@ void PoolHttpConnection::onBackendQueryUserStatsHistory(rapidjson::Document &doc
     return;
   }
 
+  uint32_t fields;
+  if (!parseFieldsArgument(document, rtStatsHistory, &fields))
+    return;
+
   // id -> login
   UserManager::UserWithAccessRights tokenInfo;
-  if (!Server_.userManager().validateSession(sessionId, targetLogin, tokenInfo, false)) {
+  if (!validateSession(sessionId, targetLogin, tokenInfo, false)) {
     replyWithStatus("unknown_id");
     return;
   }
@@ -1320,10 +2043,10 @@ void PoolHttpConnection::onBackendQueryUserStatsHistory(rapidjson::Document &doc
     return;
   }
 
-  queryStatsHistory(statistic, tokenInfo.Login, "", timeFrom, timeTo, groupByInterval, currentTime);
+  queryStatsHistory(statistic, tokenInfo.Login, "", timeFrom, timeTo, groupByInterval, currentTime, fields);
 }
 
-void PoolHttpConnection::onBackendQueryWorkerStatsHistory(rapidjson::Document &document)
+void PoolHttpConnection::onBackendQueryWorkerStatsHistory(CRequestDocument &document)
 {
   bool validAcc = true;
   int64_t currentTime = time(nullptr);
@@ -1347,9 +2070,13 @@ void PoolHttpConnection::onBackendQueryWorkerStatsHistory(rapidjson::Document &d
     return;
   }
 
+  uint32_t fields;
+  if (!parseFieldsArgument(document, rtStatsHistory, &fields))
+    return;
+
   // id -> login
   UserManager::UserWithAccessRights tokenInfo;
-  if (!Server_.userManager().validateSession(sessionId, targetLogin, tokenInfo, false)) {
+  if (!validateSession(sessionId, targetLogin, tokenInfo, false)) {
     replyWithStatus("unknown_id");
     return;
   }
@@ -1360,11 +2087,14 @@ void PoolHttpConnection::onBackendQueryWorkerStatsHistory(rapidjson::Document &d
     return;
   }
 
-  queryStatsHistory(statistic, tokenInfo.Login, workerId, timeFrom, timeTo, groupByInterval, currentTime);
+  queryStatsHistory(statistic, tokenInfo.Login, workerId, timeFrom, timeTo, groupByInterval, currentTime, fields);
 }
 
-void PoolHttpConnection::onBackendQueryCoins(rapidjson::Document&)
+void PoolHttpConnection::onBackendQueryCoins(CRequestDocument&)
 {
+  if (replyFromCache(CResponseCache::CKey()))
+    return;
+
   xmstream stream;
   reply200(stream);
   size_t offset = startChunk(stream);
@@ -1389,10 +2119,10 @@ void PoolHttpConnection::onBackendQueryCoins(rapidjson::Document&)
   }
 
   finishChunk(stream, offset);
-  aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+  sendReply(stream);
 }
 
-void PoolHttpConnection::onBackendQueryFoundBlocks(rapidjson::Document &document)
+void PoolHttpConnection::onBackendQueryFoundBlocks(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string coin;
@@ -1408,6 +2138,13 @@ void PoolHttpConnection::onBackendQueryFoundBlocks(rapidjson::Document &document
     return;
   }
 
+  uint32_t fields;
+  if (!parseFieldsArgument(document, rtFoundBlock, &fields))
+    return;
+
+  if (replyFromCache(CResponseCache::CKey().add(coin).add(heightFrom).add(hashFrom).add(static_cast<int64_t>(count)).add(static_cast<int64_t>(fields))))
+    return;
+
   PoolBackend *backend = Server_.backend(coin);
   if (!backend) {
     replyWithStatus("invalid_coin");
@@ -1416,39 +2153,28 @@ void PoolHttpConnection::onBackendQueryFoundBlocks(rapidjson::Document &document
 
   const CCoinInfo &coinInfo = backend->getCoinInfo();
 
+  CBackendLoad &load = Server_.backendLoad(backend);
+  if (backendOverloaded(load))
+    return;
+
   objectIncrementReference(aioObjectHandle(Socket_), 1);
-  backend->accountingDb()->queryFoundBlocks(heightFrom, hashFrom, count, [this, &coinInfo](const std::vector<FoundBlockRecord> &blocks, const std::vector<CNetworkClient::GetBlockConfirmationsQuery> &confirmations) {
-    xmstream stream;
-    reply200(stream);
-    size_t offset = startChunk(stream);
-    {
-      JSON::Object response(stream);
-      response.addString("status", "ok");
-      response.addField("blocks");
-      {
-        JSON::Array blocksArray(stream);
-        for (size_t i = 0, ie = blocks.size(); i != ie; ++i) {
-          blocksArray.addField();
-          {
-            JSON::Object block(stream);
-            block.addInt("height", blocks[i].Height);
-            block.addString("hash", !blocks[i].PublicHash.empty() ? blocks[i].PublicHash : blocks[i].Hash);
-            block.addInt("time", blocks[i].Time);
-            block.addInt("confirmations", confirmations[i].Confirmations);
-            block.addString("generatedCoins", FormatMoney(blocks[i].AvailableCoins, coinInfo.RationalPartSize));
-            block.addString("foundBy", blocks[i].FoundBy);
-          }
-        }
-      }
-    }
+  load.submit(Context.Endpoint->Priority, [this, backend, &coinInfo, &load, heightFrom, hashFrom, count, fields](uint64_t ticket) {
+    backend->accountingDb()->queryFoundBlocks(heightFrom, hashFrom, count, [this, backend, &coinInfo, &load, ticket, fields](const std::vector<FoundBlockRecord> &blocks, const std::vector<CNetworkClient::GetBlockConfirmationsQuery> &confirmations) {
+      load.leave(ticket);
+      if (!blocks.empty())
+        Server_.updateLastFoundBlock(backend, blocks.front().Height);
 
-    finishChunk(stream, offset);
-    aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
-    objectDecrementReference(aioObjectHandle(Socket_), 1);
+      sendStreamingReply(arrayStreamingReply(Context.Format, "blocks", CReplyRows(blocks, confirmations), [](auto &object) {
+        object.addString("status", "ok");
+      }, [&coinInfo, format = Context.Format, fields](xmstream &stream, const FoundBlockRecord &block, const CNetworkClient::GetBlockConfirmationsQuery &confirmations) {
+        serializeFoundBlock(stream, format, block, confirmations.Confirmations, coinInfo, fields);
+      }));
+      objectDecrementReference(aioObjectHandle(Socket_), 1);
+    });
   });
 }
 
-void PoolHttpConnection::onBackendQueryPayouts(rapidjson::Document &document)
+void PoolHttpConnection::onBackendQueryPayouts(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -1466,9 +2192,13 @@ void PoolHttpConnection::onBackendQueryPayouts(rapidjson::Document &document)
     return;
   }
 
+  uint32_t fields;
+  if (!parseFieldsArgument(document, rtPayout, &fields))
+    return;
+
   // id -> login
   UserManager::UserWithAccessRights tokenInfo;
-  if (!Server_.userManager().validateSession(sessionId, targetLogin, tokenInfo, false)) {
+  if (!validateSession(sessionId, targetLogin, tokenInfo, false)) {
     replyWithStatus("unknown_id");
     return;
   }
@@ -1479,46 +2209,33 @@ void PoolHttpConnection::onBackendQueryPayouts(rapidjson::Document &document)
     return;
   }
 
-  std::vector<PayoutDbRecord> records;
-  backend->queryPayouts(tokenInfo.Login, timeFrom, count, records);
-  xmstream stream;
-  reply200(stream);
-  size_t offset = startChunk(stream);
-
-  {
-    JSON::Object response(stream);
-    response.addString("status", "ok");
-    response.addField("payouts");
-    {
-      JSON::Array payoutsArray(stream);
-      for (size_t i = 0, ie = records.size(); i != ie; ++i) {
-        payoutsArray.addField();
-        {
-          JSON::Object payout(stream);
-          payout.addInt("time", records[i].Time);
-          payout.addString("txid", records[i].TransactionId);
-          payout.addString("value", FormatMoney(records[i].Value, backend->getCoinInfo().RationalPartSize));
-          payout.addInt("status", records[i].Status);
-        }
-      }
-    }
-  }
-
-  finishChunk(stream, offset);
-  aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+  objectIncrementReference(aioObjectHandle(Socket_), 1);
+  Server_.queryPool().run([this, backend, login = tokenInfo.Login, timeFrom, count, fields]() {
+    std::vector<PayoutDbRecord> records;
+    backend->queryPayouts(login, timeFrom, count, records);
+    xmstream stream;
+    reply200(stream);
+    size_t offset = startChunk(stream);
+    serializePayouts(stream, Context.Format, records, backend->getCoinInfo(), fields);
+    finishChunk(stream, offset);
+    sendReply(stream);
+    objectDecrementReference(aioObjectHandle(Socket_), 1);
+  }, [this]() {
+    objectDecrementReference(aioObjectHandle(Socket_), 1);
+  });
 }
 
-void PoolHttpConnection::onBackendQueryPoolBalance(rapidjson::Document&)
+void PoolHttpConnection::onBackendQueryPoolBalance(CRequestDocument&)
 {
   xmstream stream;
   reply200(stream);
   size_t offset = startChunk(stream);
   stream.write("{\"error\": \"not implemented\"}\n");
   finishChunk(stream, offset);
-  aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+  sendReply(stream);
 }
 
-void PoolHttpConnection::onBackendQueryPoolStats(rapidjson::Document &document)
+void PoolHttpConnection::onBackendQueryPoolStats(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string coin;
@@ -1528,6 +2245,9 @@ void PoolHttpConnection::onBackendQueryPoolStats(rapidjson::Document &document)
     return;
   }
 
+  if (replyFromCache(CResponseCache::CKey().add(coin)))
+    return;
+
   if (!coin.empty()) {
     StatisticDb *statistic = Server_.statisticDb(coin);
     if (!statistic) {
@@ -1535,39 +2255,46 @@ void PoolHttpConnection::onBackendQueryPoolStats(rapidjson::Document &document)
       return;
     }
 
+    CBackendLoad &load = Server_.backendLoad(statistic);
+    if (backendOverloaded(load))
+      return;
+
     objectIncrementReference(aioObjectHandle(Socket_), 1);
-    statistic->queryPoolStats([this, statistic](const StatisticDb::CStats &record) {
-      xmstream stream;
-      reply200(stream);
-      size_t offset = startChunk(stream);
-      const CCoinInfo &coinInfo = statistic->getCoinInfo();
+    load.submit(Context.Endpoint->Priority, [this, statistic, &load](uint64_t ticket) {
+      statistic->queryPoolStats([this, statistic, &load, ticket](const StatisticDb::CStats &record) {
+        load.leave(ticket);
+        xmstream stream;
+        reply200(stream);
+        size_t offset = startChunk(stream);
+        const CCoinInfo &coinInfo = statistic->getCoinInfo();
 
-      {
-        JSON::Object object(stream);
-        object.addString("status", "ok");
-        object.addInt("currentTime", time(nullptr));
-        object.addField("stats");
         {
-          JSON::Array statsArray(stream);
-          statsArray.addField();
+          JSON::Object object(stream);
+          object.addString("status", "ok");
+          object.addInt("currentTime", time(nullptr));
+          object.addField("stats");
           {
-            JSON::Object statsObject(stream);
-            statsObject.addString("coin", coinInfo.Name);
-            statsObject.addString("powerUnit", statistic->getCoinInfo().getPowerUnitName());
-            statsObject.addInt("powerMultLog10", statistic->getCoinInfo().PowerMultLog10);
-            statsObject.addInt("clients", record.ClientsNum);
-            statsObject.addInt("workers", record.WorkersNum);
-            statsObject.addDouble("shareRate", record.SharesPerSecond);
-            statsObject.addDouble("shareWork", record.SharesWork);
-            statsObject.addInt("power", record.AveragePower);
-            statsObject.addInt("lastShareTime", record.LastShareTime);
+            JSON::Array statsArray(stream);
+            statsArray.addField();
+            {
+              JSON::Object statsObject(stream);
+              statsObject.addString("coin", coinInfo.Name);
+              statsObject.addString("powerUnit", statistic->getCoinInfo().getPowerUnitName());
+              statsObject.addInt("powerMultLog10", statistic->getCoinInfo().PowerMultLog10);
+              statsObject.addInt("clients", record.ClientsNum);
+              statsObject.addInt("workers", record.WorkersNum);
+              statsObject.addDouble("shareRate", record.SharesPerSecond);
+              statsObject.addDouble("shareWork", record.SharesWork);
+              statsObject.addInt("power", record.AveragePower);
+              statsObject.addInt("lastShareTime", record.LastShareTime);
+            }
           }
         }
-      }
 
-      finishChunk(stream, offset);
-      aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
-      objectDecrementReference(aioObjectHandle(Socket_), 1);
+        finishChunk(stream, offset);
+        sendReply(stream);
+        objectDecrementReference(aioObjectHandle(Socket_), 1);
+      });
     });
   } else {
     // Ask all backends about stats
@@ -1607,13 +2334,13 @@ void PoolHttpConnection::onBackendQueryPoolStats(rapidjson::Document &document)
       }
 
       finishChunk(stream, offset);
-      aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+      sendReply(stream);
       objectDecrementReference(aioObjectHandle(Socket_), 1);
     });
   }
 }
 
-void PoolHttpConnection::onBackendQueryPoolStatsHistory(rapidjson::Document &document)
+void PoolHttpConnection::onBackendQueryPoolStatsHistory(CRequestDocument &document)
 {
   bool validAcc = true;
   int64_t currentTime = time(nullptr);
@@ -1631,16 +2358,20 @@ void PoolHttpConnection::onBackendQueryPoolStatsHistory(rapidjson::Document &doc
     return;
   }
 
+  uint32_t fields;
+  if (!parseFieldsArgument(document, rtStatsHistory, &fields))
+    return;
+
   StatisticDb *statistic = Server_.statisticDb(coin);
   if (!statistic) {
     replyWithStatus("invalid_coin");
     return;
   }
 
-  queryStatsHistory(statistic, "", "", timeFrom, timeTo, groupByInterval, currentTime);
+  queryStatsHistory(statistic, "", "", timeFrom, timeTo, groupByInterval, currentTime, fields);
 }
 
-void PoolHttpConnection::onBackendQueryProfitSwitchCoeff(rapidjson::Document &document)
+void PoolHttpConnection::onBackendQueryProfitSwitchCoeff(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -1652,7 +2383,7 @@ void PoolHttpConnection::onBackendQueryProfitSwitchCoeff(rapidjson::Document &do
   }
 
   UserManager::UserWithAccessRights tokenInfo;
-  if (!Server_.userManager().validateSession(sessionId, "", tokenInfo, false) || (tokenInfo.Login != "admin" && tokenInfo.Login != "observer")) {
+  if (!validateSession(sessionId, "", tokenInfo, false) || (tokenInfo.Login != "admin" && tokenInfo.Login != "observer")) {
     replyWithStatus("unknown_id");
     return;
   }
@@ -1679,10 +2410,10 @@ void PoolHttpConnection::onBackendQueryProfitSwitchCoeff(rapidjson::Document &do
   }
 
   finishChunk(stream, offset);
-  aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+  sendReply(stream);
 }
 
-void PoolHttpConnection::onBackendQueryPPLNSPayouts(rapidjson::Document &document)
+void PoolHttpConnection::onBackendQueryPPLNSPayouts(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -1703,7 +2434,7 @@ void PoolHttpConnection::onBackendQueryPPLNSPayouts(rapidjson::Document &documen
   }
 
   UserManager::UserWithAccessRights tokenInfo;
-  if (!Server_.userManager().validateSession(sessionId, targetLogin, tokenInfo, false)) {
+  if (!validateSession(sessionId, targetLogin, tokenInfo, false)) {
     replyWithStatus("unknown_id");
     return;
   }
@@ -1714,39 +2445,33 @@ void PoolHttpConnection::onBackendQueryPPLNSPayouts(rapidjson::Document &documen
     return;
   }
 
+  CBackendLoad &load = Server_.backendLoad(backend);
+  if (backendOverloaded(load))
+    return;
+
   objectIncrementReference(aioObjectHandle(Socket_), 1);
-  backend->accountingDb()->queryPPLNSPayouts(tokenInfo.Login, timeFrom, hashFrom, count, [this, backend](const std::vector<CPPLNSPayout>& result) {
-    xmstream stream;
-    reply200(stream);
-    size_t offset = startChunk(stream);
-    {
-      JSON::Object response(stream);
-      response.addString("status", "ok");
-      response.addField("payouts");
-      {
-        JSON::Array payoutArray(stream);
-        for (const auto &payout: result) {
-          payoutArray.addField();
-          {
-            JSON::Object payoutObject(stream);
-            payoutObject.addInt("startTime", payout.RoundStartTime);
-            payoutObject.addInt("endTime", payout.RoundEndTime);
-            payoutObject.addString("hash", payout.BlockHash);
-            payoutObject.addInt("height", payout.BlockHeight);
-            payoutObject.addString("value", FormatMoney(payout.PayoutValue, backend->getCoinInfo().RationalPartSize));
-            payoutObject.addDouble("coinBtcRate", fnormalize(payout.RateToBTC));
-            payoutObject.addDouble("btcUsdRate", fnormalize(payout.RateBTCToUSD));
-          }
-        }
-      }
-    }
-    finishChunk(stream, offset);
-    aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
-    objectDecrementReference(aioObjectHandle(Socket_), 1);
+  load.submit(Context.Endpoint->Priority, [this, backend, &load, login = tokenInfo.Login, timeFrom, hashFrom, count](uint64_t ticket) {
+    backend->accountingDb()->queryPPLNSPayouts(login, timeFrom, hashFrom, count, [this, backend, &load, ticket](const std::vector<CPPLNSPayout>& result) {
+      load.leave(ticket);
+      // Rows are JSON only, endpoint has no binary reply
+      sendStreamingReply(arrayStreamingReply(rfJson, "payouts", CReplyRows(result), [](auto &object) {
+        object.addString("status", "ok");
+      }, [backend](xmstream &stream, const CPPLNSPayout &payout) {
+        JSON::Object payoutObject(stream);
+        payoutObject.addInt("startTime", payout.RoundStartTime);
+        payoutObject.addInt("endTime", payout.RoundEndTime);
+        payoutObject.addString("hash", payout.BlockHash);
+        payoutObject.addInt("height", payout.BlockHeight);
+        payoutObject.addString("value", FormatMoney(payout.PayoutValue, backend->getCoinInfo().RationalPartSize));
+        payoutObject.addDouble("coinBtcRate", fnormalize(payout.RateToBTC));
+        payoutObject.addDouble("btcUsdRate", fnormalize(payout.RateBTCToUSD));
+      }));
+      objectDecrementReference(aioObjectHandle(Socket_), 1);
+    });
   });
 }
 
-void PoolHttpConnection::onBackendQueryPPLNSAcc(rapidjson::Document &document)
+void PoolHttpConnection::onBackendQueryPPLNSAcc(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -1767,7 +2492,7 @@ void PoolHttpConnection::onBackendQueryPPLNSAcc(rapidjson::Document &document)
   }
 
   UserManager::UserWithAccessRights tokenInfo;
-  if (!Server_.userManager().validateSession(sessionId, targetLogin, tokenInfo, false)) {
+  if (!validateSession(sessionId, targetLogin, tokenInfo, false)) {
     replyWithStatus("unknown_id");
     return;
   }
@@ -1787,37 +2512,44 @@ void PoolHttpConnection::onBackendQueryPPLNSAcc(rapidjson::Document &document)
     return;
   }
 
+  CBackendLoad &load = Server_.backendLoad(backend);
+  if (backendOverloaded(load))
+    return;
+
   objectIncrementReference(aioObjectHandle(Socket_), 1);
-  backend->accountingDb()->queryPPLNSAcc(tokenInfo.Login, timeFrom, timeTo, groupByInterval, [this, backend](const std::vector<AccountingDb::CPPLNSPayoutAcc>& result) {
-    xmstream stream;
-    reply200(stream);
-    size_t offset = startChunk(stream);
-    {
-      JSON::Object response(stream);
-      response.addString("status", "ok");
-      response.addField("payouts");
+  load.submit(Context.Endpoint->Priority, [this, backend, &load, login = tokenInfo.Login, timeFrom, timeTo, groupByInterval](uint64_t ticket) {
+    backend->accountingDb()->queryPPLNSAcc(login, timeFrom, timeTo, groupByInterval, [this, backend, &load, ticket](const std::vector<AccountingDb::CPPLNSPayoutAcc>& result) {
+      load.leave(ticket);
+      xmstream stream;
+      reply200(stream);
+      size_t offset = startChunk(stream);
       {
-        JSON::Array payoutArray(stream);
-        for (const auto &payout: result) {
-          payoutArray.addField();
-          {
-            JSON::Object payoutObject(stream);
-            payoutObject.addInt("timeLabel", payout.IntervalEnd);
-            payoutObject.addString("value", FormatMoney(payout.TotalCoin, backend->getCoinInfo().RationalPartSize));
-            payoutObject.addString("valueBTC", FormatMoney(payout.TotalBTC, 100000000));
-            payoutObject.addDouble("valueUSD", fnormalize(payout.TotalUSD));
-            payoutObject.addInt("avghashrate", payout.AvgHashRate);
+        JSON::Object response(stream);
+        response.addString("status", "ok");
+        response.addField("payouts");
+        {
+          JSON::Array payoutArray(stream);
+          for (const auto &payout: result) {
+            payoutArray.addField();
+            {
+              JSON::Object payoutObject(stream);
+              payoutObject.addInt("timeLabel", payout.IntervalEnd);
+              payoutObject.addString("value", FormatMoney(payout.TotalCoin, backend->getCoinInfo().RationalPartSize));
+              payoutObject.addString("valueBTC", FormatMoney(payout.TotalBTC, 100000000));
+              payoutObject.addDouble("valueUSD", fnormalize(payout.TotalUSD));
+              payoutObject.addInt("avghashrate", payout.AvgHashRate);
+            }
           }
         }
       }
-    }
-    finishChunk(stream, offset);
-    aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
-    objectDecrementReference(aioObjectHandle(Socket_), 1);
+      finishChunk(stream, offset);
+      sendReply(stream);
+      objectDecrementReference(aioObjectHandle(Socket_), 1);
+    });
   });
 }
 
-void PoolHttpConnection::onBackendUpdateProfitSwitchCoeff(rapidjson::Document &document)
+void PoolHttpConnection::onBackendUpdateProfitSwitchCoeff(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -1833,7 +2565,7 @@ void PoolHttpConnection::onBackendUpdateProfitSwitchCoeff(rapidjson::Document &d
   }
 
   UserManager::UserWithAccessRights tokenInfo;
-  if (!Server_.userManager().validateSession(sessionId, "", tokenInfo, false) || (tokenInfo.Login != "admin")) {
+  if (!validateSession(sessionId, "", tokenInfo, false) || (tokenInfo.Login != "admin")) {
     replyWithStatus("unknown_id");
     return;
   }
@@ -1848,7 +2580,7 @@ void PoolHttpConnection::onBackendUpdateProfitSwitchCoeff(rapidjson::Document &d
   replyWithStatus("ok");
 }
 
-void PoolHttpConnection::onBackendPoolLuck(rapidjson::Document &document)
+void PoolHttpConnection::onBackendPoolLuck(CRequestDocument &document)
 {
   if (!document.HasMember("coin") || !document["coin"].IsString() ||
       !document.HasMember("intervals") || !document["intervals"].IsArray()) {
@@ -1882,30 +2614,47 @@ void PoolHttpConnection::onBackendPoolLuck(rapidjson::Document &document)
     intervals.push_back(interval);
   }
 
+  CResponseCache::CKey cacheKey;
+  cacheKey.add(coin);
+  for (int64_t interval: intervals)
+    cacheKey.add(interval);
+  if (replyFromCache(cacheKey))
+    return;
+
+  CBackendLoad &load = Server_.backendLoad(backend);
+  if (backendOverloaded(load))
+    return;
+
   objectIncrementReference(aioObjectHandle(Socket_), 1);
-  backend->accountingDb()->poolLuck(std::move(intervals), [this](const std::vector<double> &result) {
-    xmstream stream;
-    reply200(stream);
-    size_t offset = startChunk(stream);
-    {
-      JSON::Object response(stream);
-      response.addString("status", "ok");
-      response.addField("luck");
+  load.submit(Context.Endpoint->Priority, [this, backend, &load, intervals = std::move(intervals)](uint64_t ticket) mutable {
+    backend->accountingDb()->poolLuck(std::move(intervals), [this, &load, ticket](const std::vector<double> &result) {
+      load.leave(ticket);
+      xmstream stream;
+      reply200(stream);
+      size_t offset = startChunk(stream);
       {
-        JSON::Array luckArray(stream);
-        for (const auto &luck: result)
-          luckArray.addDouble(luck);
+        JSON::Object response(stream);
+        response.addString("status", "ok");
+        response.addField("luck");
+        {
+          JSON::Array luckArray(stream);
+          for (const auto &luck: result)
+            luckArray.addDouble(luck);
+        }
       }
-    }
 
-    finishChunk(stream, offset);
-    aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
-    objectDecrementReference(aioObjectHandle(Socket_), 1);
+      finishChunk(stream, offset);
+      sendReply(stream);
+      objectDecrementReference(aioObjectHandle(Socket_), 1);
+    });
   });
 }
 
-void PoolHttpConnection::onInstanceEnumerateAll(rapidjson::Document&)
+void PoolHttpConnection::onInstanceEnumerateAll(CRequestDocument&)
 {
+  if (replyFromCache(CResponseCache::CKey()))
+    return;
+
   xmstream stream;
   reply200(stream);
   size_t offset = startChunk(stream);
@@ -1934,10 +2683,10 @@ void PoolHttpConnection::onInstanceEnumerateAll(rapidjson::Document&)
   }
 
   finishChunk(stream, offset);
-  aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+  sendReply(stream);
 }
 
-void PoolHttpConnection::onComplexMiningStatsGetInfo(rapidjson::Document &document)
+void PoolHttpConnection::onComplexMiningStatsGetInfo(CRequestDocument &document)
 {
   bool validAcc = true;
   std::string sessionId;
@@ -1948,19 +2697,721 @@ void PoolHttpConnection::onComplexMiningStatsGetInfo(rapidjson::Document &docume
   }
 
   UserManager::UserWithAccessRights tokenInfo;
-  if (!Server_.userManager().validateSession(sessionId, "", tokenInfo, false) || (tokenInfo.Login != "admin")) {
+  if (!validateSession(sessionId, "", tokenInfo, false) || (tokenInfo.Login != "admin")) {
     replyWithStatus("unknown_id");
     return;
   }
 
+  // Mining stats interface accepts only default allocator document, admin call so copy is fine
+  rapidjson::Document query;
+  query.CopyFrom(document, query.GetAllocator());
   objectIncrementReference(aioObjectHandle(Socket_), 1);
-  Server_.miningStats().query(document, [this](const char *data, size_t size) {
+  Server_.miningStats().query(query, [this](const char *data, size_t size) {
     xmstream stream;
     reply200(stream);
     size_t offset = startChunk(stream);
     stream.write(data, size);
     finishChunk(stream, offset);
-    aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+    sendReply(stream);
+    objectDecrementReference(aioObjectHandle(Socket_), 1);
+  });
+}
+
+void PoolHttpConnection::onEventSubscribe(CRequestDocument &document)
+{
+  bool validAcc = true;
+  std::string sessionId;
+  std::string targetLogin;
+  jsonParseString(document, "id", sessionId, "", &validAcc);
+  jsonParseString(document, "targetLogin", targetLogin, "", &validAcc);
+  if (!document.HasMember("topics") || !document["topics"].IsArray())
+    validAcc = false;
+  if (document.HasMember("coins") && !document["coins"].IsArray())
+    validAcc = false;
+  if (!validAcc) {
+    replyWithStatus("json_format_error");
+    return;
+  }
+
+  if (!Server_.config().HttpEventStreamInterval) {
+    replyWithStatus("not_available");
+    return;
+  }
+
+  // Subscribe to all coins by default
+  std::vector<std::string> coins;
+  if (document.HasMember("coins")) {
+    for (const auto &coin: document["coins"].GetArray()) {
+      if (!coin.IsString()) {
+        replyWithStatus("json_format_error");
+        return;
+      }
+      coins.emplace_back(coin.GetString(), coin.GetStringLength());
+    }
+  } else {
+    for (PoolBackend *backend: Server_.backends())
+      coins.push_back(backend->getCoinInfo().Name);
+  }
+
+  // Topic key: <kind>/<coin>[/<login>]
+  std::vector<std::string> topics;
+  UserManager::UserWithAccessRights tokenInfo;
+  bool sessionValidated = false;
+  for (const auto &topic: document["topics"].GetArray()) {
+    if (!topic.IsString()) {
+      replyWithStatus("json_format_error");
+      return;
+    }
+
+    std::string_view kind(topic.GetString(), topic.GetStringLength());
+    if (kind == "userStats" && !sessionValidated) {
+      // id -> login
+      if (!validateSession(sessionId, targetLogin, tokenInfo, false)) {
+        replyWithStatus("unknown_id");
+        return;
+      }
+      sessionValidated = true;
+    }
+
+    for (const auto &coin: coins) {
+      if (kind == "poolStats" || kind == "userStats") {
+        if (!Server_.statisticDb(coin)) {
+          replyWithStatus("invalid_coin");
+          return;
+        }
+      } else if (kind == "foundBlocks") {
+        if (!Server_.backend(coin)) {
+          replyWithStatus("invalid_coin");
+          return;
+        }
+      } else {
+        replyWithStatus("request_format_error");
+        return;
+      }
+
+      std::string key(kind);
+      key.push_back('/');
+      key.append(coin);
+      if (kind == "userStats") {
+        key.push_back('/');
+        key.append(tokenInfo.Login);
+      }
+      topics.push_back(std::move(key));
+    }
+  }
+
+  if (topics.empty() || topics.size() > MaxEventTopics) {
+    replyWithStatus("request_format_error");
+    return;
+  }
+
+  // Stream is not a request waiting for backend, don't hold in-flight slot
+  Server_.releaseRequest();
+  Context.Admitted = false;
+  Context.KeepAlive = false;
+
+  const char headers[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Connection: keep-alive\r\n"
+    "Server: bcnode\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "\r\n";
+  Events_.reset(new CEventSubscription);
+  if (sessionValidated) {
+    Events_->SessionId = sessionId;
+    Events_->TargetLogin = targetLogin;
+  }
+  pushEvent(std::make_shared<const std::string>(headers, sizeof(headers)-1));
+
+  // Registry reference, released after client disconnect
+  objectIncrementReference(aioObjectHandle(Socket_), 1);
+  Server_.eventStream().subscribe(this, topics);
+  aioRead(Socket_, Events_->ReadBuffer, sizeof(Events_->ReadBuffer), afNone, 0, eventReadCb, this);
+}
+
+void PoolHttpConnection::onBatch(CRequestDocument &document)
+{
+  bool validAcc = true;
+  std::string sessionId;
+  jsonParseString(document, "id", sessionId, "", &validAcc);
+  if (!validAcc || !document.HasMember("calls") || !document["calls"].IsArray()) {
+    replyWithStatus("json_format_error");
+    return;
+  }
+
+  auto calls = document["calls"].GetArray();
+  size_t callsNum = calls.Size();
+  if (callsNum == 0 || callsNum > MaxBatchCalls) {
+    replyWithStatus("request_format_error");
+    return;
+  }
+
+  // Check all calls before running any of them
+  const CEndpoint *endpoints[MaxBatchCalls];
+  unsigned cost = 0;
+  for (size_t i = 0; i < callsNum; i++) {
+    rapidjson::Value &call = calls[i];
+    if (!call.IsObject() ||
+        !call.HasMember("function") || !call["function"].IsString() ||
+        (call.HasMember("params") && !call["params"].IsObject())) {
+      replyWithStatus("json_format_error");
+      return;
+    }
+
+    // Long-lived streams can't be a part of batch
+    endpoints[i] = findEndpoint(std::string_view(call["function"].GetString(), call["function"].GetStringLength()));
+    if (!endpoints[i] || endpoints[i]->Function == fnBatch || endpoints[i]->Function == fnEventSubscribe) {
+      replyWithStatus("request_format_error");
+      return;
+    }
+
+    cost += endpoints[i]->Cost;
+  }
+
+  // Batch call cost already taken by dispatcher
+  if (cost > Context.Endpoint->Cost) {
+    if (!Server_.ipRateLimiter().consume(ClientId_, cost - Context.Endpoint->Cost) ||
+        (!sessionId.empty() && !Server_.sessionRateLimiter().consume(sessionClient(sessionId), cost - Context.Endpoint->Cost))) {
+      reply429();
+      return;
+    }
+  }
+
+  if (!Batch_)
+    Batch_.reset(new CBatchRequest);
+  CBatchRequest &batch = *Batch_;
+  while (batch.Calls.size() < callsNum)
+    batch.Calls.emplace_back(new PoolHttpConnection(*this));
+  batch.Results.assign(callsNum, std::string());
+  batch.Sessions.clear();
+  // Extra unit is released after all calls started
+  batch.Remaining = callsNum + 1;
+
+  // Handlers run in parallel, backend queries of each one are asynchronous
+  CRequestArena &arena = requestArena();
+  for (size_t i = 0; i < callsNum; i++) {
+    PoolHttpConnection &connection = *batch.Calls[i];
+    connection.BatchIndex_ = i;
+    connection.Context.function = endpoints[i]->Function;
+    connection.Context.Endpoint = endpoints[i];
+    connection.Context.HandlerTime = monotonicTimeUs();
+    connection.Context.Error = false;
+    connection.Context.Trace = Context.Trace;
+
+    CRequestDocument params(&arena.ValueAllocator, 1024, &arena.StackAllocator);
+    if (calls[i].HasMember("params"))
+      params.CopyFrom(calls[i]["params"], params.GetAllocator());
+    else
+      params.SetObject();
+
+    // Session id passed once for all calls which require it
+    if (!sessionId.empty() && endpoints[i]->AuthLevel != alNone && !params.HasMember("id"))
+      params.AddMember(rapidjson::Value("id", params.GetAllocator()), rapidjson::Value(sessionId.data(), sessionId.size(), params.GetAllocator()), params.GetAllocator());
+
+    connection.callHandler(params);
+  }
+
+  finishBatchCall();
+}
+
+void PoolHttpConnection::onBatchReply(size_t index, std::string_view response)
+{
+  std::string result;
+  std::string_view headers;
+  std::string_view body;
+  if (!replyBody(response, headers, body) || !forEachChunk(body, [&result](const char *data, size_t size) { result.append(data, size); }))
+    result = "{\"status\": \"internal_error\"}";
+  onBatchResult(index, std::move(result));
+}
+
+void PoolHttpConnection::onBatchResult(size_t index, std::string &&result)
+{
+  // Calls bypass HTTP parsing and response cache, their statistic has handler time only
+  const PoolHttpConnection &call = *Batch_->Calls[index];
+  int64_t now = monotonicTimeUs();
+  CRequestStats &stats = Server_.requestStats(call.Context.function);
+  stats.Requests.fetch_add(1, std::memory_order_relaxed);
+  if (call.Context.Error)
+    stats.Errors.fetch_add(1, std::memory_order_relaxed);
+  stats.BytesOut.fetch_add(result.size(), std::memory_order_relaxed);
+  stats.Latency[rpTotal].record(now - call.Context.HandlerTime);
+  stats.Latency[rpBackend].record(now - call.Context.HandlerTime);
+  if (Context.Trace)
+    Context.Trace->span(call.Context.Endpoint->Name.data(), call.Context.HandlerTime, now);
+
+  // Every call writes only its own slot
+  Batch_->Results[index] = std::move(result);
+  finishBatchCall();
+}
+
+void PoolHttpConnection::finishBatchCall()
+{
+  CBatchRequest &batch = *Batch_;
+  if (batch.Remaining.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    return;
+
+  xmstream stream;
+  reply200(stream);
+  size_t offset = startChunk(stream);
+
+  {
+    JSON::Object object(stream);
+    object.addString("status", "ok");
+    object.addField("results");
+    {
+      JSON::Array results(stream);
+      for (const auto &result: batch.Results) {
+        results.addField();
+        stream.write(result.data(), result.size());
+      }
+    }
+  }
+
+  finishChunk(stream, offset);
+  sendReply(stream);
+}
+
+bool PoolHttpConnection::validateSession(const std::string &id, const std::string &targetLogin, UserManager::UserWithAccessRights &tokenInfo, bool needWriteAccess)
+{
+  if (!Parent_) {
+    int64_t startTime = monotonicTimeUs();
+    bool valid = Server_.validateSession(id, targetLogin, tokenInfo, needWriteAccess);
+    Context.SessionDuration += monotonicTimeUs() - startTime;
+    traceSpan("validateSession", startTime);
+    return valid;
+  }
+
+  // Calls of one batch share session lookups
+  CBatchRequest &batch = *Parent_->Batch_;
+  std::lock_guard<std::mutex> lock(batch.SessionsMutex);
+  for (const auto &session: batch.Sessions) {
+    if (session.Id == id && session.TargetLogin == targetLogin && session.NeedWriteAccess == needWriteAccess) {
+      tokenInfo = session.TokenInfo;
+      return session.Valid;
+    }
+  }
+
+  bool valid = Server_.validateSession(id, targetLogin, tokenInfo, needWriteAccess);
+  batch.Sessions.push_back(CBatchRequest::CSession{id, targetLogin, needWriteAccess, valid, tokenInfo});
+  return valid;
+}
+
+uint64_t PoolHttpConnection::sessionClient(const std::string &sessionId)
+{
+  // Client can't get new bucket by sending random ids
+  UserManager::UserWithAccessRights tokenInfo;
+  if (!validateSession(sessionId, "", tokenInfo, false))
+    return UnknownSessionClient;
+  uint64_t client = std::hash<std::string>()(tokenInfo.Login);
+  return client != UnknownSessionClient ? client : client + 1;
+}
+
+void PoolHttpConnection::recordRequestStats()
+{
+  int64_t now = monotonicTimeUs();
+  int64_t writeTime = Context.WriteTime ? Context.WriteTime : now;
+  int64_t replyTime = Context.ReplyTime ? Context.ReplyTime : writeTime;
+  // Requests rejected before handler have only parse and write phases
+  int64_t handlerTime = Context.HandlerTime ? Context.HandlerTime : replyTime;
+
+  CRequestStats &stats = Server_.requestStats(Context.function);
+  stats.Requests.fetch_add(1, std::memory_order_relaxed);
+  if (Context.Error)
+    stats.Errors.fetch_add(1, std::memory_order_relaxed);
+  stats.BytesIn.fetch_add(Context.BytesIn, std::memory_order_relaxed);
+  stats.BytesOut.fetch_add(Context.BytesOut, std::memory_order_relaxed);
+
+  stats.Latency[rpTotal].record(now - Context.StartTime);
+  stats.Latency[rpParse].record(handlerTime - Context.StartTime);
+  stats.Latency[rpSession].record(Context.SessionDuration);
+  stats.Latency[rpBackend].record(replyTime - handlerTime - Context.SessionDuration);
+  stats.Latency[rpSerialize].record(Context.SerializeDuration);
+  stats.Latency[rpWrite].record(now - replyTime - Context.SerializeDuration);
+}
+
+static void addBackendLoad(JSON::Array &array, xmstream &stream, const std::string &coin, CBackendLoad &load)
+{
+  array.addField();
+  JSON::Object object(stream);
+  object.addString("coin", coin);
+  object.addInt("queueDepth", load.queueDepth());
+  object.addInt("oldestAge", load.oldestAge());
+  object.addInt("shed", load.shed());
+  object.addInt("eventsSkipped", load.eventsSkipped());
+  object.addInt("timedOut", load.timedOut());
+}
+
+void PoolHttpConnection::onServerStats(CRequestDocument &document)
+{
+  bool validAcc = true;
+  std::string sessionId;
+  jsonParseString(document, "id", sessionId, &validAcc);
+  if (!validAcc) {
+    replyWithStatus("json_format_error");
+    return;
+  }
+
+  UserManager::UserWithAccessRights tokenInfo;
+  if (!validateSession(sessionId, "", tokenInfo, false) || (tokenInfo.Login != "admin")) {
+    replyWithStatus("unknown_id");
+    return;
+  }
+
+  xmstream stream;
+  reply200(stream);
+  size_t offset = startChunk(stream);
+
+  {
+    JSON::Object object(stream);
+    object.addString("status", "ok");
+    object.addInt("uptime", (monotonicTimeUs() - Server_.startTime()) / 1000000);
+    object.addInt("inFlightRequests", Server_.inFlightRequests());
+    object.addField("endpoints");
+    {
+      JSON::Array endpoints(stream);
+      for (const auto &endpoint: Endpoints_) {
+        CRequestStats &stats = Server_.requestStats(endpoint.Function);
+        if (!stats.Requests.load(std::memory_order_relaxed))
+          continue;
+
+        endpoints.addField();
+        JSON::Object endpointObject(stream);
+        endpointObject.addString("name", std::string(endpoint.Name));
+        endpointObject.addInt("requests", stats.Requests.load(std::memory_order_relaxed));
+        endpointObject.addInt("errors", stats.Errors.load(std::memory_order_relaxed));
+        endpointObject.addInt("bytesIn", stats.BytesIn.load(std::memory_order_relaxed));
+        endpointObject.addInt("bytesOut", stats.BytesOut.load(std::memory_order_relaxed));
+        // Microseconds
+        endpointObject.addField("latency");
+        {
+          JSON::Object latency(stream);
+          for (unsigned phase = 0; phase < rpPhasesNum; phase++) {
+            const CLatencyHistogram &histogram = stats.Latency[phase];
+            latency.addField(requestPhaseName(static_cast<ERequestPhase>(phase)));
+            JSON::Object phaseObject(stream);
+            phaseObject.addInt("p50", histogram.percentile(0.5));
+            phaseObject.addInt("p99", histogram.percentile(0.99));
+            phaseObject.addInt("p999", histogram.percentile(0.999));
+            phaseObject.addInt("max", histogram.max());
+          }
+        }
+      }
+    }
+
+    object.addField("accountingLoops");
+    {
+      JSON::Array loops(stream);
+      for (PoolBackend *backend: Server_.backends())
+        addBackendLoad(loops, stream, backend->getCoinInfo().Name, Server_.backendLoad(backend));
+    }
+
+    object.addField("statisticLoops");
+    {
+      JSON::Array loops(stream);
+      for (StatisticDb *statistic: Server_.statistics())
+        addBackendLoad(loops, stream, statistic->getCoinInfo().Name, Server_.backendLoad(statistic));
+    }
+
+    object.addField("rejected");
+    {
+      JSON::Object rejected(stream);
+      rejected.addInt("perIp", Server_.ipRateLimiter().rejected());
+      rejected.addInt("perSession", Server_.sessionRateLimiter().rejected());
+      rejected.addInt("inFlightLimit", Server_.rejectedRequests());
+    }
+
+    object.addField("responseCache");
+    {
+      JSON::Object cache(stream);
+      cache.addInt("hits", Server_.responseCache().hits());
+      cache.addInt("misses", Server_.responseCache().misses());
+      cache.addInt("evictions", Server_.responseCache().evictions());
+      cache.addInt("size", Server_.responseCache().size());
+    }
+
+    object.addField("sessionCache");
+    {
+      JSON::Object cache(stream);
+      cache.addInt("hits", Server_.sessionCache().hits());
+      cache.addInt("misses", Server_.sessionCache().misses());
+      cache.addInt("invalidations", Server_.sessionCache().invalidations());
+    }
+
+    object.addField("objectPools");
+    {
+      const CPoolCounters &connections = PoolHttpConnection::poolCounters();
+      const CPoolCounters &buffers = Server_.bufferPool().counters();
+      JSON::Object pools(stream);
+      pools.addField("connections");
+      {
+        JSON::Object pool(stream);
+        pool.addInt("hits", connections.Hits.load(std::memory_order_relaxed));
+        pool.addInt("misses", connections.Misses.load(std::memory_order_relaxed));
+      }
+      pools.addField("buffers");
+      {
+        JSON::Object pool(stream);
+        pool.addInt("hits", buffers.Hits.load(std::memory_order_relaxed));
+        pool.addInt("misses", buffers.Misses.load(std::memory_order_relaxed));
+      }
+    }
+
+    object.addField("eventStream");
+    {
+      JSON::Object events(stream);
+      events.addInt("subscribers", Server_.eventStream().subscribersNum());
+      events.addInt("framesSent", Server_.eventStream().framesSent());
+    }
+
+    // Percents of wall time spent on CPU
+    object.addField("threadGroups");
+    {
+      JSON::Array groups(stream);
+      for (const auto &group: Server_.threadUsage().groups()) {
+        groups.addField();
+        JSON::Object groupObject(stream);
+        groupObject.addString("name", group.Name);
+        groupObject.addInt("threads", group.ThreadsNum);
+        groupObject.addDouble("utilization10s", group.Utilization[0]);
+        groupObject.addDouble("utilization60s", group.Utilization[1]);
+      }
+    }
+
+    object.addField("threads");
+    {
+      JSON::Array threads(stream);
+      for (const auto &thread: Server_.threadUsage().threads()) {
+        threads.addField();
+        JSON::Object threadObject(stream);
+        threadObject.addString("name", thread.Name);
+        threadObject.addString("group", thread.Group);
+        threadObject.addDouble("cpuTime", thread.CpuTime / 1000000.0);
+        threadObject.addDouble("utilization10s", thread.Utilization[0]);
+        threadObject.addDouble("utilization60s", thread.Utilization[1]);
+      }
+    }
+  }
+
+  finishChunk(stream, offset);
+  sendReply(stream);
+}
+
+static void addLoadMetrics(CMetricsWriter &metrics, const char *name, const char *loop, const std::string &coin, double value)
+{
+  metrics.sample(name, {{"coin", coin}, {"loop", loop}}, value);
+}
+
+void PoolHttpConnection::onServerTraces(CRequestDocument &document)
+{
+  bool validAcc = true;
+  std::string sessionId;
+  uint64_t limit = 0;
+  jsonParseString(document, "id", sessionId, &validAcc);
+  jsonParseUInt64(document, "limit", &limit, 16, &validAcc);
+  if (!validAcc) {
+    replyWithStatus("json_format_error");
+    return;
+  }
+
+  UserManager::UserWithAccessRights tokenInfo;
+  if (!validateSession(sessionId, "", tokenInfo, false) || (tokenInfo.Login != "admin")) {
+    replyWithStatus("unknown_id");
+    return;
+  }
+
+  xmstream stream;
+  reply200(stream);
+  size_t offset = startChunk(stream);
+
+  {
+    // Chrome trace event format, reply body can be loaded into viewer as is
+    JSON::Object object(stream);
+    object.addString("status", "ok");
+    object.addInt("sampled", Server_.tracer().sampled());
+    object.addString("displayTimeUnit", "ms");
+    object.addField("traceEvents");
+    Server_.tracer().dump(stream, limit);
+  }
+
+  finishChunk(stream, offset);
+  sendReply(stream);
+}
+
+void PoolHttpConnection::onMetrics()
+{
+  std::vector<StatisticDb*> statisticDbs(Server_.backends().size());
+  for (size_t i = 0, ie = Server_.backends().size(); i != ie; ++i)
+    statisticDbs[i] = Server_.backend(i)->statisticDb();
+
+  objectIncrementReference(aioObjectHandle(Socket_), 1);
+  StatisticDb::queryPoolStatsMulti(statisticDbs.data(), statisticDbs.size(), [this](const StatisticDb::CStats *stats, size_t backendsNum) {
+    xmstream stream;
+    replyStatus200(stream);
+    stream.write("Server: bcnode\r\nTransfer-Encoding: chunked\r\nContent-Type: text/plain; version=0.0.4\r\n\r\n");
+    size_t offset = startChunk(stream);
+    CMetricsWriter metrics(stream);
+
+    metrics.family("pool_clients", "gauge", "Connected clients");
+    for (size_t i = 0; i < backendsNum; i++)
+      metrics.sample("pool_clients", {{"coin", Server_.backend(i)->getCoinInfo().Name}}, stats[i].ClientsNum);
+    metrics.family("pool_workers", "gauge", "Connected workers");
+    for (size_t i = 0; i < backendsNum; i++)
+      metrics.sample("pool_workers", {{"coin", Server_.backend(i)->getCoinInfo().Name}}, stats[i].WorkersNum);
+    metrics.family("pool_share_rate", "gauge", "Shares per second");
+    for (size_t i = 0; i < backendsNum; i++)
+      metrics.sample("pool_share_rate", {{"coin", Server_.backend(i)->getCoinInfo().Name}}, stats[i].SharesPerSecond);
+    metrics.family("pool_power", "gauge", "Pool power in coin units (see backendQueryPoolStats)");
+    for (size_t i = 0; i < backendsNum; i++)
+      metrics.sample("pool_power", {{"coin", Server_.backend(i)->getCoinInfo().Name}}, stats[i].AveragePower);
+    metrics.family("pool_last_share_time_seconds", "gauge", "Unix time of last share");
+    for (size_t i = 0; i < backendsNum; i++)
+      metrics.sample("pool_last_share_time_seconds", {{"coin", Server_.backend(i)->getCoinInfo().Name}}, stats[i].LastShareTime);
+    metrics.family("pool_last_found_block_height", "gauge", "Height of last found block seen by API and event stream");
+    for (PoolBackend *backend: Server_.backends()) {
+      if (uint64_t height = Server_.lastFoundBlock(backend))
+        metrics.sample("pool_last_found_block_height", {{"coin", backend->getCoinInfo().Name}}, height);
+    }
+
+    metrics.family("pool_backend_queue_depth", "gauge", "API queries submitted to and waiting for backend event loop");
+    for (PoolBackend *backend: Server_.backends())
+      addLoadMetrics(metrics, "pool_backend_queue_depth", "accounting", backend->getCoinInfo().Name, Server_.backendLoad(backend).queueDepth());
+    for (StatisticDb *statistic: Server_.statistics())
+      addLoadMetrics(metrics, "pool_backend_queue_depth", "statistic", statistic->getCoinInfo().Name, Server_.backendLoad(statistic).queueDepth());
+    metrics.family("pool_backend_queue_oldest_age_seconds", "gauge", "Age of oldest API query not started by backend loop");
+    for (PoolBackend *backend: Server_.backends())
+      addLoadMetrics(metrics, "pool_backend_queue_oldest_age_seconds", "accounting", backend->getCoinInfo().Name, Server_.backendLoad(backend).oldestAge() / 1000000.0);
+    for (StatisticDb *statistic: Server_.statistics())
+      addLoadMetrics(metrics, "pool_backend_queue_oldest_age_seconds", "statistic", statistic->getCoinInfo().Name, Server_.backendLoad(statistic).oldestAge() / 1000000.0);
+    metrics.family("pool_backend_shed_total", "counter", "API queries rejected because of backend event loop overload");
+    for (PoolBackend *backend: Server_.backends())
+      addLoadMetrics(metrics, "pool_backend_shed_total", "accounting", backend->getCoinInfo().Name, Server_.backendLoad(backend).shed());
+    for (StatisticDb *statistic: Server_.statistics())
+      addLoadMetrics(metrics, "pool_backend_shed_total", "statistic", statistic->getCoinInfo().Name, Server_.backendLoad(statistic).shed());
+    metrics.family("pool_backend_event_skipped_total", "counter", "Event stream updates not queried because of backend event loop overload");
+    for (PoolBackend *backend: Server_.backends())
+      addLoadMetrics(metrics, "pool_backend_event_skipped_total", "accounting", backend->getCoinInfo().Name, Server_.backendLoad(backend).eventsSkipped());
+    for (StatisticDb *statistic: Server_.statistics())
+      addLoadMetrics(metrics, "pool_backend_event_skipped_total", "statistic", statistic->getCoinInfo().Name, Server_.backendLoad(statistic).eventsSkipped());
+    metrics.family("pool_backend_timed_out_total", "counter", "API queries not answered by backend event loop in timeout");
+    for (PoolBackend *backend: Server_.backends())
+      addLoadMetrics(metrics, "pool_backend_timed_out_total", "accounting", backend->getCoinInfo().Name, Server_.backendLoad(backend).timedOut());
+    for (StatisticDb *statistic: Server_.statistics())
+      addLoadMetrics(metrics, "pool_backend_timed_out_total", "statistic", statistic->getCoinInfo().Name, Server_.backendLoad(statistic).timedOut());
+
+    metrics.family("pool_http_connections", "gauge", "Open HTTP connections");
+    metrics.sample("pool_http_connections", Server_.connectionsNum());
+    metrics.family("pool_http_in_flight_requests", "gauge", "HTTP requests waiting for reply");
+    metrics.sample("pool_http_in_flight_requests", Server_.inFlightRequests());
+
+    metrics.family("pool_http_requests_total", "counter", "HTTP API requests");
+    for (const auto &endpoint: Endpoints_)
+      metrics.sample("pool_http_requests_total", {{"function", endpoint.Name}}, Server_.requestStats(endpoint.Function).Requests.load(std::memory_order_relaxed));
+    metrics.sample("pool_http_requests_total", {{"function", MetricsEndpoint_.Name}}, Server_.requestStats(fnMetrics).Requests.load(std::memory_order_relaxed));
+    metrics.family("pool_http_request_errors_total", "counter", "HTTP API requests with error reply");
+    for (const auto &endpoint: Endpoints_)
+      metrics.sample("pool_http_request_errors_total", {{"function", endpoint.Name}}, Server_.requestStats(endpoint.Function).Errors.load(std::memory_order_relaxed));
+    metrics.family("pool_http_request_bytes_total", "counter", "HTTP API request and response bytes");
+    for (const auto &endpoint: Endpoints_) {
+      CRequestStats &requestStats = Server_.requestStats(endpoint.Function);
+      metrics.sample("pool_http_request_bytes_total", {{"function", endpoint.Name}, {"direction", "in"}}, requestStats.BytesIn.load(std::memory_order_relaxed));
+      metrics.sample("pool_http_request_bytes_total", {{"function", endpoint.Name}, {"direction", "out"}}, requestStats.BytesOut.load(std::memory_order_relaxed));
+    }
+    metrics.family("pool_http_request_duration_seconds", "summary", "HTTP API request latency quantiles since start by phase");
+    for (const auto &endpoint: Endpoints_) {
+      CRequestStats &requestStats = Server_.requestStats(endpoint.Function);
+      if (!requestStats.Requests.load(std::memory_order_relaxed))
+        continue;
+      for (unsigned phase = 0; phase < rpPhasesNum; phase++) {
+        const CLatencyHistogram &histogram = requestStats.Latency[phase];
+        const char *phaseName = requestPhaseName(static_cast<ERequestPhase>(phase));
+        metrics.sample("pool_http_request_duration_seconds", {{"function", endpoint.Name}, {"phase", phaseName}, {"quantile", "0.5"}}, histogram.percentile(0.5) / 1000000.0);
+        metrics.sample("pool_http_request_duration_seconds", {{"function", endpoint.Name}, {"phase", phaseName}, {"quantile", "0.99"}}, histogram.percentile(0.99) / 1000000.0);
+        metrics.sample("pool_http_request_duration_seconds", {{"function", endpoint.Name}, {"phase", phaseName}, {"quantile", "0.999"}}, histogram.percentile(0.999) / 1000000.0);
+        metrics.sample("pool_http_request_duration_seconds_sum", {{"function", endpoint.Name}, {"phase", phaseName}}, histogram.sum() / 1000000.0);
+        metrics.sample("pool_http_request_duration_seconds_count", {{"function", endpoint.Name}, {"phase", phaseName}}, histogram.count());
+      }
+    }
+
+    metrics.family("pool_http_rejected_requests_total", "counter", "HTTP requests rejected by limits");
+    metrics.sample("pool_http_rejected_requests_total", {{"reason", "ip_rate"}}, Server_.ipRateLimiter().rejected());
+    metrics.sample("pool_http_rejected_requests_total", {{"reason", "session_rate"}}, Server_.sessionRateLimiter().rejected());
+    metrics.sample("pool_http_rejected_requests_total", {{"reason", "in_flight"}}, Server_.rejectedRequests());
+    metrics.family("pool_http_response_cache_requests_total", "counter", "Response cache lookups");
+    metrics.sample("pool_http_response_cache_requests_total", {{"result", "hit"}}, Server_.responseCache().hits());
+    metrics.sample("pool_http_response_cache_requests_total", {{"result", "miss"}}, Server_.responseCache().misses());
+    metrics.family("pool_http_response_cache_evictions_total", "counter", "Unexpired responses evicted by cache size limit");
+    metrics.sample("pool_http_response_cache_evictions_total", Server_.responseCache().evictions());
+    metrics.family("pool_http_response_cache_bytes", "gauge", "Size of cached responses and their keys");
+    metrics.sample("pool_http_response_cache_bytes", Server_.responseCache().size());
+    metrics.family("pool_http_session_cache_requests_total", "counter", "Session cache lookups");
+    metrics.sample("pool_http_session_cache_requests_total", {{"result", "hit"}}, Server_.sessionCache().hits());
+    metrics.sample("pool_http_session_cache_requests_total", {{"result", "miss"}}, Server_.sessionCache().misses());
+    metrics.family("pool_http_session_cache_invalidations_total", "counter", "Session cache invalidations (logout, password change)");
+    metrics.sample("pool_http_session_cache_invalidations_total", Server_.sessionCache().invalidations());
+    const CPoolCounters &connections = PoolHttpConnection::poolCounters();
+    const CPoolCounters &buffers = Server_.bufferPool().counters();
+    metrics.family("pool_http_object_pool_requests_total", "counter", "Connection object and receive buffer allocations, hit is reuse of released one");
+    metrics.sample("pool_http_object_pool_requests_total", {{"pool", "connection"}, {"result", "hit"}}, connections.Hits.load(std::memory_order_relaxed));
+    metrics.sample("pool_http_object_pool_requests_total", {{"pool", "connection"}, {"result", "miss"}}, connections.Misses.load(std::memory_order_relaxed));
+    metrics.sample("pool_http_object_pool_requests_total", {{"pool", "buffer"}, {"result", "hit"}}, buffers.Hits.load(std::memory_order_relaxed));
+    metrics.sample("pool_http_object_pool_requests_total", {{"pool", "buffer"}, {"result", "miss"}}, buffers.Misses.load(std::memory_order_relaxed));
+    metrics.family("pool_http_event_stream_subscribers", "gauge", "Server-Sent Events subscribers");
+    metrics.sample("pool_http_event_stream_subscribers", Server_.eventStream().subscribersNum());
+    metrics.family("pool_http_event_stream_frames_total", "counter", "Server-Sent Events frames sent");
+    metrics.sample("pool_http_event_stream_frames_total", Server_.eventStream().framesSent());
+
+    CQueryThreadPool &queryPool = Server_.queryPool();
+    metrics.family("pool_query_queue_depth", "gauge", "Database reads waiting for query thread");
+    metrics.sample("pool_query_queue_depth", queryPool.queueDepth());
+    metrics.family("pool_query_thread_busy_seconds_total", "counter", "Time spent by query thread in database reads");
+    for (size_t i = 0; i < queryPool.threadsNum(); i++) {
+      char threadName[16];
+      snprintf(threadName, sizeof(threadName), "query%zu", i);
+      metrics.sample("pool_query_thread_busy_seconds_total", {{"thread", threadName}}, queryPool.busyTime(i) / 1000000.0);
+    }
+
+    std::vector<CThreadUsage::CThreadStats> threads = Server_.threadUsage().threads();
+    metrics.family("pool_thread_cpu_seconds_total", "counter", "CPU time of process thread");
+    for (const auto &thread: threads)
+      metrics.sample("pool_thread_cpu_seconds_total", {{"thread", thread.Name}, {"group", thread.Group}}, thread.CpuTime / 1000000.0);
+    metrics.family("pool_thread_group_utilization_percent", "gauge", "CPU utilization of thread group: average share of wall time its threads ran on CPU (not event loop occupancy)");
+    for (const auto &group: Server_.threadUsage().groups()) {
+      for (size_t i = 0; i < CThreadUsage::WindowsNum; i++) {
+        char window[16];
+        snprintf(window, sizeof(window), "%us", CThreadUsage::Windows[i]);
+        metrics.sample("pool_thread_group_utilization_percent", {{"group", group.Name}, {"window", window}}, group.Utilization[i]);
+      }
+    }
+
+    std::vector<CLoopWatchdog::CLoopStats> loops = Server_.loopWatchdog().stats();
+    metrics.family("pool_event_loop_stalls_total", "counter", "Event loop stalls longer than 'eventLoopStallThreshold'");
+    for (const auto &loop: loops)
+      metrics.sample("pool_event_loop_stalls_total", {{"loop", loop.Name}}, loop.Stalls);
+    metrics.family("pool_event_loop_max_stall_seconds", "gauge", "Longest event loop stall since start");
+    for (const auto &loop: loops)
+      metrics.sample("pool_event_loop_max_stall_seconds", {{"loop", loop.Name}}, loop.MaxStall / 1000000.0);
+
+#if defined(OS_LINUX)
+    // Refresh jemalloc statistics snapshot
+    uint64_t epoch = 1;
+    size_t epochSize = sizeof(epoch);
+    if (mallctl("epoch", &epoch, &epochSize, &epoch, epochSize) == 0) {
+      metrics.family("pool_memory_bytes", "gauge", "jemalloc memory statistics");
+      for (const char *name: {"allocated", "active", "resident", "mapped"}) {
+        char key[32];
+        size_t value = 0;
+        size_t valueSize = sizeof(value);
+        snprintf(key, sizeof(key), "stats.%s", name);
+        if (mallctl(key, &value, &valueSize, nullptr, 0) == 0)
+          metrics.sample("pool_memory_bytes", {{"type", name}}, value);
+      }
+    }
+#endif
+
+    finishChunk(stream, offset);
+    sendReply(stream);
     objectDecrementReference(aioObjectHandle(Socket_), 1);
   });
 }
@@ -1970,15 +3421,33 @@ PoolHttpServer::PoolHttpServer(uint16_t port,
                                std::vector<std::unique_ptr<PoolBackend>> &backends,
                                std::vector<std::unique_ptr<StatisticServer>> &algoMetaStatistic,
                                ComplexMiningStats &complexMiningStats,
+                               CLoopWatchdog &loopWatchdog,
                                const CPoolFrontendConfig &config,
                                size_t threadsNum) :
   Port_(port),
   UserMgr_(userMgr),
   MiningStats_(complexMiningStats),
+  LoopWatchdog_(loopWatchdog),
   Config_(config),
-  ThreadsNum_(threadsNum)
+  ThreadsNum_(threadsNum),
+  BufferPool_(65536, 256),
+  QueryPool_(config.HttpQueryThreadsNum),
+  ResponseCache_(config.HttpCacheTTL, 65536, MaxCacheSize),
+  IpRateLimiter_(config.HttpRateLimitPerIp, config.HttpRateLimitBurst, 1u << 20),
+  SessionRateLimiter_(config.HttpRateLimitPerSession, config.HttpRateLimitBurst, 1u << 20),
+  SessionCache_(config.HttpSessionCacheTTL, 16384),
+  Tracer_(config.HttpTraceSampleInterval, config.HttpTraceBufferSize),
+  StartTime_(monotonicTimeUs())
 {
-  Base_ = createAsyncBase(amOSDefault);
+#ifdef SO_REUSEPORT
+  for (size_t i = 0; i < ThreadsNum_; i++)
+    Bases_.push_back(createAsyncBase(amOSDefault));
+#else
+  Bases_.push_back(createAsyncBase(amOSDefault));
+#endif
+  for (size_t i = 0; i < Bases_.size(); i++)
+    LoopWatchdog_.add(Bases_[i], "http" + std::to_string(i));
+
   for (size_t i = 0, ie = backends.size(); i != ie; ++i) {
     Backends_.push_back(backends[i].get());
     Statistic_.push_back(backends[i]->statisticDb());
@@ -1987,11 +3456,30 @@ PoolHttpServer::PoolHttpServer(uint16_t port,
   for (size_t  i = 0, ie = algoMetaStatistic.size(); i != ie; ++i)
     Statistic_.push_back(algoMetaStatistic[i]->statisticDb());
 
+  // Map is not modified after construction, lookups don't need lock
+  int64_t agingTime = config.HttpBulkQueryAgingTime * 1000LL;
+  int64_t queryTimeout = config.HttpBackendQueryTimeout * 1000LL;
+  for (PoolBackend *backend: Backends_)
+    BackendLoad_.emplace(backend, new CBackendLoad(config.HttpBackendMaxConcurrency, agingTime, queryTimeout));
+  for (StatisticDb *statistic: Statistic_)
+    BackendLoad_.emplace(statistic, new CBackendLoad(config.HttpBackendMaxConcurrency, agingTime, queryTimeout));
+
   std::sort(Backends_.begin(), Backends_.end(), [](const auto &l, const auto &r) { return l->getCoinInfo().Name < r->getCoinInfo().Name; });
   std::sort(Statistic_.begin(), Statistic_.end(), [](const auto &l, const auto &r) { return l->getCoinInfo().Name < r->getCoinInfo().Name; });
 }
 
-bool PoolHttpServer::start()
+static bool socketReusePort(socketTy hSocket)
+{
+#ifdef SO_REUSEPORT
+  int value = 1;
+  return setsockopt(hSocket, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<const char*>(&value), sizeof(value)) == 0;
+#else
+  (void)hSocket;
+  return false;
+#endif
+}
+
+bool PoolHttpServer::createListener(asyncBase *base, bool reusePort)
 {
   HostAddress address;
   address.family = AF_INET;
@@ -1999,6 +3487,10 @@ bool PoolHttpServer::start()
   address.port = htons(Port_);
   socketTy hSocket = socketCreate(AF_INET, SOCK_STREAM, IPPROTO_TCP, 1);
   socketReuseAddr(hSocket);
+  if (reusePort && !socketReusePort(hSocket)) {
+    LOG_F(ERROR, "PoolHttpServer: can't set SO_REUSEPORT for port %u\n", static_cast<unsigned>(Port_));
+    return false;
+  }
 
   if (socketBind(hSocket, &address) != 0) {
     LOG_F(ERROR, "PoolHttpServer: can't bind port %u\n", static_cast<unsigned>(Port_));
@@ -2010,9 +3502,34 @@ bool PoolHttpServer::start()
     return false;
   }
 
-  ListenerSocket_ = newSocketIo(Base_, hSocket);
-  aioAccept(ListenerSocket_, 0, acceptCb, this);
+  aioObject *listener = newSocketIo(base, hSocket);
+  ListenerSockets_.push_back(listener);
+  aioAccept(listener, 0, acceptCb, this);
+  return true;
+}
 
+bool PoolHttpServer::start()
+{
+  // Every event loop accepts connections on its own SO_REUSEPORT socket,
+  // kernel balances incoming connections between them
+  bool reusePort = Bases_.size() > 1;
+  for (asyncBase *base: Bases_) {
+    if (!createListener(base, reusePort))
+      return false;
+  }
+
+  if (Config_.HttpEventStreamInterval) {
+    EventTimer_ = newUserEvent(Bases_[0], 0, eventTimerCb, this);
+    userEventStartTimer(EventTimer_, Config_.HttpEventStreamInterval * 1000000ULL, -1);
+  }
+
+  if (Config_.HttpBackendQueryTimeout) {
+    LoadTimer_ = newUserEvent(Bases_[0], 0, loadTimerCb, this);
+    userEventStartTimer(LoadTimer_, 1000000, -1);
+  }
+
+  QueryPool_.start();
+  ThreadUsage_.start();
   Threads_.reset(new std::thread[ThreadsNum_]);
   for (size_t i = 0; i < ThreadsNum_; i++) {
     Threads_[i] = std::thread([i](PoolHttpServer *server) {
@@ -2021,7 +3538,7 @@ bool PoolHttpServer::start()
       loguru::set_thread_name(threadName);
       InitializeWorkerThread();
       LOG_F(INFO, "http server started tid=%u", GetGlobalThreadId());
-      asyncLoop(server->Base_);
+      asyncLoop(server->Bases_[i % server->Bases_.size()]);
     }, this);
   }
 
@@ -2030,19 +3547,298 @@ bool PoolHttpServer::start()
 
 void PoolHttpServer::stop()
 {
-  postQuitOperation(Base_);
+  // Query threads send replies through HTTP loops, stop them while loops are running
+  QueryPool_.stop();
+  for (asyncBase *base: Bases_)
+    postQuitOperation(base);
+
   for (size_t i = 0; i < ThreadsNum_; i++) {
     LOG_F(INFO, "http worker %zu finishing", i);
     Threads_[i].join();
   }
+
+  ThreadUsage_.stop();
+
+  const CPoolCounters &connections = PoolHttpConnection::poolCounters();
+  const CPoolCounters &buffers = BufferPool_.counters();
+  LOG_F(INFO,
+        "http connection pool hits: %" PRIu64 " misses: %" PRIu64 "; buffer pool hits: %" PRIu64 " misses: %" PRIu64,
+        connections.Hits.load(),
+        connections.Misses.load(),
+        buffers.Hits.load(),
+        buffers.Misses.load());
+  LOG_F(INFO,
+        "http rejected requests per ip: %" PRIu64 " per session: %" PRIu64 " in-flight limit: %" PRIu64,
+        IpRateLimiter_.rejected(),
+        SessionRateLimiter_.rejected(),
+        RejectedRequests_.load());
+  LOG_F(INFO,
+        "http session cache hits: %" PRIu64 " misses: %" PRIu64 " invalidations: %" PRIu64,
+        SessionCache_.hits(),
+        SessionCache_.misses(),
+        SessionCache_.invalidations());
+  LOG_F(INFO,
+        "http event stream subscribers: %zu frames sent: %" PRIu64,
+        EventStream_.subscribersNum(),
+        EventStream_.framesSent());
+  for (const auto &group: ThreadUsage_.groups())
+    LOG_F(INFO, "threads %s (%u): %.1f%% CPU utilization in last minute", group.Name.c_str(), group.ThreadsNum, group.Utilization[1]);
+}
+
+
+bool PoolHttpServer::admitRequest()
+{
+  unsigned limit = Config_.HttpMaxInFlightRequests;
+  if (InFlightRequests_.fetch_add(1, std::memory_order_relaxed) >= limit && limit) {
+    InFlightRequests_.fetch_sub(1, std::memory_order_relaxed);
+    RejectedRequests_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  return true;
+}
+
+void PoolHttpServer::releaseRequest()
+{
+  InFlightRequests_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+uint64_t PoolHttpServer::lastFoundBlock(PoolBackend *backend)
+{
+  std::lock_guard<std::mutex> lock(LastFoundBlockMutex_);
+  auto It = LastFoundBlock_.find(backend);
+  return It != LastFoundBlock_.end() ? It->second : 0;
+}
+
+bool PoolHttpServer::validateSession(const std::string &id, const std::string &targetLogin, UserManager::UserWithAccessRights &tokenInfo, bool needWriteAccess)
+{
+  if (!SessionCache_.enabled())
+    return UserMgr_.validateSession(id, targetLogin, tokenInfo, needWriteAccess);
+
+  if (SessionCache_.get(id, targetLogin, needWriteAccess, tokenInfo))
+    return true;
+
+  uint64_t epoch = SessionCache_.epoch();
+  if (!UserMgr_.validateSession(id, targetLogin, tokenInfo, needWriteAccess))
+    return false;
+
+  SessionCache_.put(id, targetLogin, needWriteAccess, epoch, tokenInfo);
+  return true;
+}
+
+void PoolHttpServer::updateLastFoundBlock(PoolBackend *backend, uint64_t height)
+{
+  bool newBlock = false;
+  {
+    std::lock_guard<std::mutex> lock(LastFoundBlockMutex_);
+    uint64_t &lastHeight = LastFoundBlock_[backend];
+    if (height > lastHeight) {
+      newBlock = lastHeight != 0;
+      lastHeight = height;
+    }
+  }
+
+  // Found blocks list and pool luck changed
+  if (newBlock)
+    ResponseCache_.invalidate();
+}
+
+void PoolHttpServer::onLoadTimer()
+{
+  for (auto &load: BackendLoad_)
+    load.second->expire();
+}
+
+void PoolHttpServer::onEventTimer()
+{
+  EventStream_.collect();
+  unsigned keepAliveTicks = std::max(1u, EventKeepAliveInterval / Config_.HttpEventStreamInterval);
+  if (++EventTicks_ % keepAliveTicks == 0)
+    EventStream_.publishAll(CEventStream::makeComment("keepalive"));
+
+  uint64_t tick;
+  {
+    // Backends didn't answer previous tick queries yet, don't pile up more
+    // Queries not answered in timeout are abandoned (callback can be lost), their answers don't affect new tick
+    std::lock_guard<std::mutex> lock(EventQueriesMutex_);
+    int64_t now = monotonicTimeUs();
+    if (EventQueries_ && (!Config_.HttpBackendQueryTimeout || now - EventTickTime_ < Config_.HttpBackendQueryTimeout * 1000LL))
+      return;
+    tick = ++EventTick_;
+    EventQueries_ = 0;
+    EventTickTime_ = now;
+  }
+
+  for (const std::string &topic: EventStream_.topics()) {
+    size_t kindEnd = topic.find('/');
+    size_t coinEnd = topic.find('/', kindEnd + 1);
+    std::string_view kind(topic.data(), kindEnd);
+    std::string coin = topic.substr(kindEnd + 1, coinEnd != topic.npos ? coinEnd - kindEnd - 1 : topic.npos);
+    if (kind == "poolStats") {
+      if (StatisticDb *statistic = statisticDb(coin))
+        publishPoolStats(topic, statistic, tick);
+    } else if (kind == "userStats") {
+      if (StatisticDb *statistic = statisticDb(coin); statistic && coinEnd != topic.npos)
+        publishUserStats(topic, statistic, topic.substr(coinEnd + 1), tick);
+    } else if (kind == "foundBlocks") {
+      if (PoolBackend *backend = this->backend(coin))
+        publishFoundBlocks(topic, backend, tick);
+    }
+  }
+}
+
+bool PoolHttpServer::eventQueryAllowed(CBackendLoad &load)
+{
+  // Pushed updates are less important than API requests
+  if (load.overloaded(Config_.HttpBackendMaxQueueDepth, Config_.HttpBackendMaxQueueAge * 1000LL)) {
+    load.eventSkipped();
+    return false;
+  }
+
+  // Called from event timer only, so tick can't change here
+  std::lock_guard<std::mutex> lock(EventQueriesMutex_);
+  EventQueries_++;
+  return true;
+}
+
+void PoolHttpServer::eventQueryDone(uint64_t tick)
+{
+  std::lock_guard<std::mutex> lock(EventQueriesMutex_);
+  if (tick == EventTick_)
+    EventQueries_--;
+}
+
+void PoolHttpServer::publishPoolStats(const std::string &topic, StatisticDb *statistic, uint64_t tick)
+{
+  CBackendLoad &load = backendLoad(statistic);
+  if (!eventQueryAllowed(load))
+    return;
+
+  load.submit(qpInteractive, [this, topic, statistic, &load, tick](uint64_t ticket) {
+    statistic->queryPoolStats([this, topic, statistic, &load, tick, ticket](const StatisticDb::CStats &record) {
+      load.leave(ticket);
+      const CCoinInfo &coinInfo = statistic->getCoinInfo();
+      xmstream stream;
+      {
+        JSON::Object object(stream);
+        object.addString("coin", coinInfo.Name);
+        object.addInt("currentTime", time(nullptr));
+        object.addString("powerUnit", coinInfo.getPowerUnitName());
+        object.addInt("powerMultLog10", coinInfo.PowerMultLog10);
+        object.addInt("clients", record.ClientsNum);
+        object.addInt("workers", record.WorkersNum);
+        object.addDouble("shareRate", record.SharesPerSecond);
+        object.addDouble("shareWork", record.SharesWork);
+        object.addInt("power", record.AveragePower);
+        object.addInt("lastShareTime", record.LastShareTime);
+      }
+
+      EventStream_.publish(topic, CEventStream::makeFrame("poolStats", stream.data(), stream.sizeOf()));
+      eventQueryDone(tick);
+    });
+  });
 }
 
+void PoolHttpServer::publishUserStats(const std::string &topic, StatisticDb *statistic, const std::string &login, uint64_t tick)
+{
+  CBackendLoad &load = backendLoad(statistic);
+  if (!eventQueryAllowed(load))
+    return;
+
+  load.submit(qpInteractive, [this, topic, statistic, &load, login, tick](uint64_t ticket) {
+    statistic->queryUserStats(login, [this, topic, statistic, &load, tick, ticket](const StatisticDb::CStats &aggregate, const std::vector<StatisticDb::CStats> &workers) {
+      load.leave(ticket);
+      const CCoinInfo &coinInfo = statistic->getCoinInfo();
+      xmstream stream;
+      {
+        JSON::Object object(stream);
+        object.addString("coin", coinInfo.Name);
+        object.addInt("currentTime", time(nullptr));
+        object.addString("powerUnit", coinInfo.getPowerUnitName());
+        object.addInt("powerMultLog10", coinInfo.PowerMultLog10);
+        object.addField("total");
+        {
+          JSON::Object total(stream);
+          total.addInt("clients", aggregate.ClientsNum);
+          total.addInt("workers", aggregate.WorkersNum);
+          total.addDouble("shareRate", aggregate.SharesPerSecond);
+          total.addDouble("shareWork", aggregate.SharesWork);
+          total.addInt("power", aggregate.AveragePower);
+          total.addInt("lastShareTime", aggregate.LastShareTime);
+        }
+
+        object.addField("workers");
+        {
+          JSON::Array workersOutput(stream);
+          for (const auto &worker: workers) {
+            workersOutput.addField();
+            {
+              JSON::Object workerOutput(stream);
+              workerOutput.addString("name", worker.WorkerId);
+              workerOutput.addDouble("shareRate", worker.SharesPerSecond);
+              workerOutput.addDouble("shareWork", worker.SharesWork);
+              workerOutput.addInt("power", worker.AveragePower);
+              workerOutput.addInt("lastShareTime", worker.LastShareTime);
+            }
+          }
+        }
+      }
+
+      EventStream_.publish(topic, CEventStream::makeFrame("userStats", stream.data(), stream.sizeOf()));
+      eventQueryDone(tick);
+    }, 0, 4096, StatisticDb::EStatsColumnName, false);
+  });
+}
 
-void PoolHttpServer::acceptCb(AsyncOpStatus status, aioObject *object, HostAddress, socketTy socketFd, void *arg)
+void PoolHttpServer::publishFoundBlocks(const std::string &topic, PoolBackend *backend, uint64_t tick)
+{
+  CBackendLoad &load = backendLoad(backend);
+  if (!eventQueryAllowed(load))
+    return;
+
+  load.submit(qpInteractive, [this, topic, backend, &load, tick](uint64_t ticket) {
+    backend->accountingDb()->queryFoundBlocks(-1, "", 1, [this, topic, backend, &load, tick, ticket](const std::vector<FoundBlockRecord> &blocks, const std::vector<CNetworkClient::GetBlockConfirmationsQuery> &confirmations) {
+      load.leave(ticket);
+      bool newBlock = false;
+      if (!blocks.empty()) {
+        updateLastFoundBlock(backend, blocks.front().Height);
+        // First query only remembers last block, it is not new
+        std::lock_guard<std::mutex> lock(LastFoundBlockMutex_);
+        auto It = LastPublishedBlock_.find(backend);
+        newBlock = It != LastPublishedBlock_.end() && blocks.front().Height > It->second;
+        LastPublishedBlock_[backend] = blocks.front().Height;
+      }
+
+      if (newBlock) {
+        const CCoinInfo &coinInfo = backend->getCoinInfo();
+        const FoundBlockRecord &block = blocks.front();
+        xmstream stream;
+        {
+          JSON::Object object(stream);
+          object.addString("coin", coinInfo.Name);
+          object.addInt("height", block.Height);
+          object.addString("hash", !block.PublicHash.empty() ? block.PublicHash : block.Hash);
+          object.addInt("time", block.Time);
+          object.addInt("confirmations", confirmations.front().Confirmations);
+          object.addString("generatedCoins", FormatMoney(block.AvailableCoins, coinInfo.RationalPartSize));
+          object.addString("foundBy", block.FoundBy);
+        }
+
+        EventStream_.publish(topic, CEventStream::makeFrame("foundBlock", stream.data(), stream.sizeOf()));
+      }
+
+      eventQueryDone(tick);
+    });
+  });
+}
+
+void PoolHttpServer::acceptCb(AsyncOpStatus status, aioObject *object, HostAddress address, socketTy socketFd, void *arg)
 {
   if (status == aosSuccess) {
     aioObject *connectionSocket = newSocketIo(aioGetBase(object), socketFd);
-    PoolHttpConnection *connection = new PoolHttpConnection(*static_cast<PoolHttpServer*>(arg), connectionSocket);
+    PoolHttpServer *server = static_cast<PoolHttpServer*>(arg);
+    server->connectionOpened();
+    PoolHttpConnection *connection = new PoolHttpConnection(*server, connectionSocket, clientId(address));
     connection->run();
   } else {
     LOG_F(ERROR, "HTTP api accept connection failed");
@@ -2051,17 +3847,64 @@ void PoolHttpServer::acceptCb(AsyncOpStatus status, aioObject *object, HostAddre
   aioAccept(object, 0, acceptCb, arg);
 }
 
+bool PoolHttpConnection::backendOverloaded(CBackendLoad &load)
+{
+  const CPoolFrontendConfig &config = Server_.config();
+  if (!load.overloaded(config.HttpBackendMaxQueueDepth, config.HttpBackendMaxQueueAge * 1000LL))
+    return false;
+
+  load.queryShed();
+  replyWithStatus("busy");
+  return true;
+}
+
+bool PoolHttpConnection::parseFieldsArgument(CRequestDocument &document, ERowType type, uint32_t *fields)
+{
+  *fields = AllFields;
+  if (!document.HasMember("fields"))
+    return true;
+
+  if (!document["fields"].IsArray()) {
+    replyWithStatus("json_format_error");
+    return false;
+  }
+
+  *fields = 0;
+  for (const auto &field: document["fields"].GetArray()) {
+    if (!field.IsString()) {
+      replyWithStatus("json_format_error");
+      return false;
+    }
+
+    uint32_t bit = rowFieldBit(type, std::string_view(field.GetString(), field.GetStringLength()));
+    if (!bit) {
+      replyWithStatus("unknown_field_name");
+      return false;
+    }
+    *fields |= bit;
+  }
+
+  return true;
+}
+
 void PoolHttpConnection::replyWithStatus(const char *status)
 {
+  // Cache only complete responses
+  Context.CacheKey.clear();
+  if (strcmp(status, "ok") != 0)
+    Context.Error = true;
   xmstream stream;
   reply200(stream);
   size_t offset = startChunk(stream);
 
-  {
+  if (Context.Format == rfCbor) {
+    CBOR::Object object(stream);
+    object.addString("status", status);
+  } else {
     JSON::Object object(stream);
     object.addString("status", status);
   }
 
   finishChunk(stream, offset);
-  aioWrite(Socket_, stream.data(), stream.sizeOf(), afWaitAll, 0, writeCb, this);
+  sendReply(stream);
 }
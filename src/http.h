@@ -1,80 +1,168 @@
 #pragma once
 
+#include "backendLoad.h"
+#include "compression.h"
 #include "config.h"
+#include "eventStream.h"
+#include "loopWatchdog.h"
+#include "objectPool.h"
+#include "queryThreadPool.h"
+#include "rateLimiter.h"
+#include "requestStats.h"
+#include "responseCache.h"
+#include "serializers.h"
+#include "sessionCache.h"
+#include "threadUsage.h"
+#include "streamingReply.h"
+#include "tracing.h"
 #include "poolcore/backend.h"
 #include "poolcore/complexMiningStats.h"
+#include "rapidjson/document.h"
 #include <p2putils/HttpRequestParse.h>
+#include <deque>
+#include <mutex>
+#include <string_view>
 
 class PoolHttpServer;
 
-class PoolHttpConnection {
+// Request values and parser stack both live in per-thread arena
+typedef rapidjson::GenericDocument<rapidjson::UTF8<>, rapidjson::MemoryPoolAllocator<>, rapidjson::MemoryPoolAllocator<>> CRequestDocument;
+
+class PoolHttpConnection : public CEventSubscriber {
 public:
-  PoolHttpConnection(PoolHttpServer &server, aioObject *socket) : Server_(server), Socket_(socket) {
+  PoolHttpConnection(PoolHttpServer &server, aioObject *socket, uint64_t clientId) : Server_(server), Socket_(socket), ClientId_(clientId) {
     httpRequestParserInit(&ParserState);
     objectSetDestructorCb(aioObjectHandle(Socket_), [](aioObjectRoot*, void *arg) {
       delete static_cast<PoolHttpConnection*>(arg);
     }, this);
   }
+  // Call of batch request, reply goes to parent connection
+  PoolHttpConnection(PoolHttpConnection &parent) : Server_(parent.Server_), Socket_(parent.Socket_), ClientId_(parent.ClientId_), Parent_(&parent) {}
+  ~PoolHttpConnection();
+
+  // Connection objects allocated from per-thread slab
+  static void *operator new(size_t size);
+  static void operator delete(void *object);
+  static const CPoolCounters &poolCounters();
+
   void run();
+  // Rate limiter burst must be enough for any single call
+  static unsigned maxEndpointCost();
+
+  // Event stream subscriber
+  bool pushEvent(const CEventFrame &frame) override;
+  bool eventStreamClosed() override;
+  void acquireSubscriber() override;
+  void releaseSubscriber() override;
 
 private:
   static void readCb(AsyncOpStatus status, aioObject*, size_t size, void *arg) { static_cast<PoolHttpConnection*>(arg)->onRead(status, size); }
   static void writeCb(AsyncOpStatus, aioObject*, size_t, void *arg) { static_cast<PoolHttpConnection*>(arg)->onWrite(); }
+  static void streamWriteCb(AsyncOpStatus status, aioObject*, size_t, void *arg) { static_cast<PoolHttpConnection*>(arg)->onStreamWrite(status); }
+  static void eventWriteCb(AsyncOpStatus status, aioObject*, size_t, void *arg) { static_cast<PoolHttpConnection*>(arg)->onEventWrite(status); }
+  static void eventReadCb(AsyncOpStatus, aioObject*, size_t, void *arg) { static_cast<PoolHttpConnection*>(arg)->onEventRead(); }
 
   void onWrite();
+  void onStreamWrite(AsyncOpStatus status);
+  void onEventWrite(AsyncOpStatus status);
+  void onEventRead();
   void onRead(AsyncOpStatus status, size_t);
   int onParse(HttpRequestComponent *component);
+  void parseRequest();
+  void finishRequest();
+  void recordRequestStats();
+  void readNext();
+  bool growBuffer();
+  void shrinkBuffer();
   void close();
 
-  void reply200(xmstream &stream);
+  void replyStatus200(xmstream &stream);
+  void reply200(xmstream &stream, EContentEncoding encoding = ceIdentity);
+  void reply200Headers(xmstream &stream, EContentEncoding encoding);
   void reply404();
+  void reply429();
   size_t startChunk(xmstream &stream);
+  void closeChunk(xmstream &stream, size_t offset);
   void finishChunk(xmstream &stream, size_t offset);
+  void sendReply(xmstream &stream);
+  void sendStreamingReply(std::unique_ptr<CStreamingReply> reply);
+  void writeStreamingPart(bool first);
+  // Compresses body of reply200 reply finished at chunk 'offset' if client accepts it and body is large enough
+  bool compressBody(xmstream &stream, size_t offset);
+  bool checkBodySize(size_t size);
+  int dispatchRequest(char *body);
+  bool callHandler(CRequestDocument &document);
+  bool validateSession(const std::string &id, const std::string &targetLogin, UserManager::UserWithAccessRights &tokenInfo, bool needWriteAccess);
+  // Session rate limiter key: login of validated session
+  uint64_t sessionClient(const std::string &sessionId);
+  // Span from 'begin' to now, if request is sampled
+  void traceSpan(const char *name, int64_t begin) {
+    if (Context.Trace)
+      Context.Trace->span(name, begin, monotonicTimeUs());
+  }
+
+  void onUserAction(CRequestDocument &document);
+  void onUserCreate(CRequestDocument &document);
+  void onUserResendEmail(CRequestDocument &document);
+  void onUserLogin(CRequestDocument &document);
+  void onUserLogout(CRequestDocument &document);
+  void onUserQueryMonitoringSession(CRequestDocument &document);
+  void onUserChangeEmail(CRequestDocument &document);
+  void onUserChangePasswordInitiate(CRequestDocument &document);
+  void onUserChangePasswordForce(CRequestDocument &document);
+  void onUserGetCredentials(CRequestDocument &document);
+  void onUserGetSettings(CRequestDocument &document);
+  void onUserUpdateCredentials(CRequestDocument &document);
+  void onUserUpdateSettings(CRequestDocument &document);
+  void onUserEnumerateAll(CRequestDocument &document);
+  void onUserEnumerateFeePlan(CRequestDocument &document);
+  void onUserGetFeePlan(CRequestDocument &document);
+  void onUserUpdateFeePlan(CRequestDocument &document);
+  void onUserChangeFeePlan(CRequestDocument &document);
+  void onUserActivate2faInitiate(CRequestDocument &document);
+  void onUserDeactivate2faInitiate(CRequestDocument &document);
+
+  void onBackendManualPayout(CRequestDocument &document);
+  void onBackendQueryUserBalance(CRequestDocument &document);
+  void onBackendQueryUserStats(CRequestDocument &document);
+  void onBackendQueryUserStatsHistory(CRequestDocument &document);
+  void onBackendQueryWorkerStatsHistory(CRequestDocument &document);
+  void onBackendQueryCoins(CRequestDocument &document);
+  void onBackendQueryFoundBlocks(CRequestDocument &document);
+  void onBackendQueryPayouts(CRequestDocument &document);
+  void onBackendQueryPoolBalance(CRequestDocument &document);
+  void onBackendQueryPoolStats(CRequestDocument &document);
+  void onBackendQueryPoolStatsHistory(CRequestDocument &document);
+  void onBackendQueryProfitSwitchCoeff(CRequestDocument &document);
+  void onBackendQueryPPLNSPayouts(CRequestDocument &document);
+  void onBackendQueryPPLNSAcc(CRequestDocument &document);
+  void onBackendUpdateProfitSwitchCoeff(CRequestDocument &document);
+  void onBackendPoolLuck(CRequestDocument &document);
+
+  void onInstanceEnumerateAll(CRequestDocument &document);
 
-  void onUserAction(rapidjson::Document &document);
-  void onUserCreate(rapidjson::Document &document);
-  void onUserResendEmail(rapidjson::Document &document);
-  void onUserLogin(rapidjson::Document &document);
-  void onUserLogout(rapidjson::Document &document);
-  void onUserQueryMonitoringSession(rapidjson::Document &document);
-  void onUserChangeEmail(rapidjson::Document &document);
-  void onUserChangePasswordInitiate(rapidjson::Document &document);
-  void onUserChangePasswordForce(rapidjson::Document &document);
-  void onUserGetCredentials(rapidjson::Document &document);
-  void onUserGetSettings(rapidjson::Document &document);
-  void onUserUpdateCredentials(rapidjson::Document &document);
-  void onUserUpdateSettings(rapidjson::Document &document);
-  void onUserEnumerateAll(rapidjson::Document &document);
-  void onUserEnumerateFeePlan(rapidjson::Document &document);
-  void onUserGetFeePlan(rapidjson::Document &document);
-  void onUserUpdateFeePlan(rapidjson::Document &document);
-  void onUserChangeFeePlan(rapidjson::Document &document);
-  void onUserActivate2faInitiate(rapidjson::Document &document);
-  void onUserDeactivate2faInitiate(rapidjson::Document &document);
-
-  void onBackendManualPayout(rapidjson::Document &document);
-  void onBackendQueryUserBalance(rapidjson::Document &document);
-  void onBackendQueryUserStats(rapidjson::Document &document);
-  void onBackendQueryUserStatsHistory(rapidjson::Document &document);
-  void onBackendQueryWorkerStatsHistory(rapidjson::Document &document);
-  void onBackendQueryCoins(rapidjson::Document &document);
-  void onBackendQueryFoundBlocks(rapidjson::Document &document);
-  void onBackendQueryPayouts(rapidjson::Document &document);
-  void onBackendQueryPoolBalance(rapidjson::Document &document);
-  void onBackendQueryPoolStats(rapidjson::Document &document);
-  void onBackendQueryPoolStatsHistory(rapidjson::Document &document);
-  void onBackendQueryProfitSwitchCoeff(rapidjson::Document &document);
-  void onBackendQueryPPLNSPayouts(rapidjson::Document &document);
-  void onBackendQueryPPLNSAcc(rapidjson::Document &document);
-  void onBackendUpdateProfitSwitchCoeff(rapidjson::Document &document);
-  void onBackendPoolLuck(rapidjson::Document &document);
-
-  void onInstanceEnumerateAll(rapidjson::Document &document);
-
-  void onComplexMiningStatsGetInfo(rapidjson::Document &document);
-
-  void queryStatsHistory(StatisticDb *statistic, const std::string &login, const std::string &worker, int64_t timeFrom, int64_t timeTo, int64_t groupByInterval, int64_t currentTime);
+  void onComplexMiningStatsGetInfo(CRequestDocument &document);
+
+  void onEventSubscribe(CRequestDocument &document);
+
+  void onBatch(CRequestDocument &document);
+  void onBatchReply(size_t index, std::string_view response);
+  void onBatchResult(size_t index, std::string &&result);
+  void finishBatchCall();
+
+  void onServerStats(CRequestDocument &document);
+  void onServerTraces(CRequestDocument &document);
+  void onMetrics();
+
+  void queryStatsHistory(StatisticDb *statistic, const std::string &login, const std::string &worker, int64_t timeFrom, int64_t timeTo, int64_t groupByInterval, int64_t currentTime, uint32_t fields);
   void replyWithStatus(const char *status);
+  // Reply 'busy' if backend loop queue is too long
+  bool backendOverloaded(CBackendLoad &load);
+  // Parse optional 'fields' argument (all row fields by default), reply with error status if it's invalid
+  bool parseFieldsArgument(CRequestDocument &document, ERowType type, uint32_t *fields);
+  // Reply from response cache, otherwise remember key to store reply; takes in-flight slot on cache miss
+  // Returns true if request finished (cache hit or in-flight limit reached)
+  bool replyFromCache(const CResponseCache::CKey &parameters);
 
 private:
   enum FunctionTy {
@@ -124,23 +212,145 @@ private:
     fnInstanceEnumerateAll,
 
     // Complex mining stats functions
-    fnComplexMiningStatsGetInfo
+    fnComplexMiningStatsGetInfo,
+
+    // Event stream functions
+    fnEventSubscribe,
+
+    // Multiple calls in one request
+    fnBatch,
+
+    // Administration functions
+    fnServerStats,
+    fnServerTraces,
+    fnMetrics,
+
+    fnFunctionsNum
   };
 
-  static std::unordered_map<std::string, std::pair<int, PoolHttpConnection::FunctionTy>> FunctionNameMap_;
+public:
+  // Size of per-function statistic tables
+  static constexpr size_t FunctionsNum = fnFunctionsNum;
+
+private:
+
+  // Minimal session required by endpoint, handlers still check it
+  enum EAuthLevel {
+    alNone = 0,
+    alUser,
+    alObserver,
+    alAdmin
+  };
+
+  struct CEndpoint {
+    std::string_view Name;
+    int Method;
+    FunctionTy Function;
+    EAuthLevel AuthLevel;
+    bool Cacheable;
+    size_t MaxBodySize;
+    // Rate limiter tokens per call
+    unsigned Cost;
+    // Backend queue lane
+    EQueryPriority Priority;
+    // Reply can be encoded in CBOR, if client prefers it in Accept header
+    bool BinaryReply;
+  };
+
+  // Sorted by name for binary search
+  static const CEndpoint Endpoints_[];
+  // Prometheus scrape page, outside of JSON API
+  static const CEndpoint MetricsEndpoint_;
+  static constexpr bool endpointsSorted();
+  static const CEndpoint *findEndpoint(std::string_view name);
+
+  // Server-Sent Events connection state, frames written one by one
+  struct CEventSubscription {
+    std::mutex Mutex;
+    std::deque<CEventFrame> Queue;
+    CEventFrame Current;
+    bool Closed = false;
+    // Session of 'userStats' subscription, checked on every tick
+    std::string SessionId;
+    std::string TargetLogin;
+    // Client never sends anything, read only detects disconnect
+    char ReadBuffer[64];
+  };
+
+  // Calls of batch request; connection objects are reused by next batches of connection
+  // and destroyed with it, after all calls released their socket references
+  struct CBatchRequest {
+    struct CSession {
+      std::string Id;
+      std::string TargetLogin;
+      bool NeedWriteAccess;
+      bool Valid;
+      UserManager::UserWithAccessRights TokenInfo;
+    };
+
+    std::vector<std::unique_ptr<PoolHttpConnection>> Calls;
+    std::vector<std::string> Results;
+    std::atomic<size_t> Remaining = 0;
+    std::mutex SessionsMutex;
+    std::vector<CSession> Sessions;
+  };
+
+private:
 
   PoolHttpServer &Server_;
   aioObject *Socket_;
+  // Rate limiter key (IPv4 address or IPv6 prefix)
+  uint64_t ClientId_;
+  // Batch request owning this call
+  PoolHttpConnection *Parent_ = nullptr;
+  size_t BatchIndex_ = 0;
 
-  char buffer[65536];
+  // Small requests fit into inline buffer, large ones use buffer from server pool
+  char InlineBuffer_[4096];
+  char *Buffer_ = InlineBuffer_;
+  size_t BufferSize_ = sizeof(InlineBuffer_);
   HttpRequestParserState ParserState;
   size_t oldDataSize = 0;
   std::atomic<unsigned> Deleted_ = 0;
+  // Request is complete when both parser and reply writer reached their end
+  std::atomic<unsigned> RequestStage_ = 0;
+  unsigned RequestsNum_ = 0;
+  // Reply in progress and buffer for its current part
+  std::unique_ptr<CStreamingReply> StreamingReply_;
+  std::unique_ptr<xmstream> StreamingBuffer_;
+  std::unique_ptr<CCompressor> StreamingCompressor_;
+  std::unique_ptr<CEventSubscription> Events_;
+  std::unique_ptr<CBatchRequest> Batch_;
 
   struct {
     int method = hmUnknown;
     FunctionTy function = fnUnknown;
+    const CEndpoint *Endpoint = nullptr;
+    EContentEncoding Encoding = ceIdentity;
+    EReplyFormat Format = rfJson;
+    bool KeepAlive = false;
+    bool Dispatched = false;
+    // Counted in server in-flight requests
+    bool Admitted = false;
     std::string Request;
+    std::string CacheKey;
+    uint64_t CacheGeneration = 0;
+    std::string CacheData;
+    // Reply started by reply200 and offset of its headers
+    xmstream *Body = nullptr;
+    size_t HeadersOffset = 0;
+    // Request timing, microseconds
+    int64_t StartTime = 0;
+    int64_t HandlerTime = 0;
+    int64_t ReplyTime = 0;
+    int64_t WriteTime = 0;
+    int64_t SessionDuration = 0;
+    int64_t SerializeDuration = 0;
+    size_t BytesIn = 0;
+    size_t BytesOut = 0;
+    bool Error = false;
+    // Sampled requests only
+    std::shared_ptr<CTrace> Trace;
   } Context;
 };
 
@@ -151,6 +361,7 @@ public:
                  std::vector<std::unique_ptr<PoolBackend>> &backends,
                  std::vector<std::unique_ptr<StatisticServer>> &algoMetaStatistic,
                  ComplexMiningStats &complexMiningStats,
+                 CLoopWatchdog &loopWatchdog,
                  const CPoolFrontendConfig &config,
                  size_t threadsNum);
 
@@ -179,22 +390,90 @@ public:
   std::vector<PoolBackend*> &backends() { return Backends_; }
   std::vector<StatisticDb*> &statistics() { return Statistic_; }
   ComplexMiningStats &miningStats() { return MiningStats_; }
+  CLoopWatchdog &loopWatchdog() { return LoopWatchdog_; }
+  CBufferPool &bufferPool() { return BufferPool_; }
+  CQueryThreadPool &queryPool() { return QueryPool_; }
+  CResponseCache &responseCache() { return ResponseCache_; }
+  CRateLimiter &ipRateLimiter() { return IpRateLimiter_; }
+  CRateLimiter &sessionRateLimiter() { return SessionRateLimiter_; }
+  CSessionCache &sessionCache() { return SessionCache_; }
+  CTracer &tracer() { return Tracer_; }
+  CThreadUsage &threadUsage() { return ThreadUsage_; }
+  CRequestStats &requestStats(int function) { return RequestStats_[function]; }
+  int64_t startTime() const { return StartTime_; }
+  unsigned inFlightRequests() const { return InFlightRequests_.load(std::memory_order_relaxed); }
+  uint64_t rejectedRequests() const { return RejectedRequests_.load(std::memory_order_relaxed); }
+  CBackendLoad &backendLoad(const void *loop) { return *BackendLoad_.find(loop)->second; }
+  CEventStream &eventStream() { return EventStream_; }
+  // UserManager::validateSession with per-thread cache of valid sessions
+  bool validateSession(const std::string &id, const std::string &targetLogin, UserManager::UserWithAccessRights &tokenInfo, bool needWriteAccess);
+  bool admitRequest();
+  void connectionOpened() { Connections_.fetch_add(1, std::memory_order_relaxed); }
+  void connectionClosed() { Connections_.fetch_sub(1, std::memory_order_relaxed); }
+  unsigned connectionsNum() const { return Connections_.load(std::memory_order_relaxed); }
+  void releaseRequest();
+  void updateLastFoundBlock(PoolBackend *backend, uint64_t height);
+  uint64_t lastFoundBlock(PoolBackend *backend);
 
 private:
   static void acceptCb(AsyncOpStatus status, aioObject *object, HostAddress, socketTy socketFd, void *arg);
+  static void eventTimerCb(aioUserEvent*, void *arg) { static_cast<PoolHttpServer*>(arg)->onEventTimer(); }
+  static void loadTimerCb(aioUserEvent*, void *arg) { static_cast<PoolHttpServer*>(arg)->onLoadTimer(); }
 
   void onAccept(AsyncOpStatus status, aioObject *object);
+  bool createListener(asyncBase *base, bool reusePort);
+  // Releases backend loop slots of lost queries
+  void onLoadTimer();
+  // Event stream updates, one backend query per topic per tick
+  void onEventTimer();
+  bool eventQueryAllowed(CBackendLoad &load);
+  void eventQueryDone(uint64_t tick);
+  void publishPoolStats(const std::string &topic, StatisticDb *statistic, uint64_t tick);
+  void publishUserStats(const std::string &topic, StatisticDb *statistic, const std::string &login, uint64_t tick);
+  void publishFoundBlocks(const std::string &topic, PoolBackend *backend, uint64_t tick);
 
 private:
-  asyncBase *Base_;
+  // One event loop per HTTP thread; with SO_REUSEPORT every loop owns its listener,
+  // otherwise all threads share first loop
+  std::vector<asyncBase*> Bases_;
   uint16_t Port_;
   UserManager &UserMgr_;
   ComplexMiningStats &MiningStats_;
+  CLoopWatchdog &LoopWatchdog_;
   const CPoolFrontendConfig &Config_;
   size_t ThreadsNum_;
   std::vector<PoolBackend*> Backends_;
   std::vector<StatisticDb*> Statistic_;
+  CBufferPool BufferPool_;
+  CQueryThreadPool QueryPool_;
+  CResponseCache ResponseCache_;
+  CRateLimiter IpRateLimiter_;
+  CRateLimiter SessionRateLimiter_;
+  CSessionCache SessionCache_;
+  CTracer Tracer_;
+  CThreadUsage ThreadUsage_;
+  // Indexed by PoolHttpConnection function id
+  CRequestStats RequestStats_[PoolHttpConnection::FunctionsNum];
+  int64_t StartTime_;
+  std::atomic<unsigned> Connections_ = 0;
+  std::atomic<unsigned> InFlightRequests_ = 0;
+  std::atomic<uint64_t> RejectedRequests_ = 0;
+  std::mutex LastFoundBlockMutex_;
+  std::unordered_map<PoolBackend*, uint64_t> LastFoundBlock_;
+  // Key is PoolBackend (accounting loop) or StatisticDb
+  std::unordered_map<const void*, std::unique_ptr<CBackendLoad>> BackendLoad_;
+  aioUserEvent *LoadTimer_ = nullptr;
+  CEventStream EventStream_;
+  aioUserEvent *EventTimer_ = nullptr;
+  uint64_t EventTicks_ = 0;
+  // Tick which backend queries are tracked, its start time and updates not published yet
+  std::mutex EventQueriesMutex_;
+  uint64_t EventTick_ = 0;
+  int64_t EventTickTime_ = 0;
+  unsigned EventQueries_ = 0;
+  // Last block sent to 'foundBlocks' subscribers, protected by LastFoundBlockMutex_
+  std::unordered_map<PoolBackend*, uint64_t> LastPublishedBlock_;
 
   std::unique_ptr<std::thread[]> Threads_;
-  aioObject *ListenerSocket_;
+  std::vector<aioObject*> ListenerSockets_;
 };
@@ -0,0 +1,703 @@
+#include "requestStats.h"
+#include "asyncio/asyncio.h"
+#include "asyncio/socket.h"
+#include "loguru.hpp"
+#include "rapidjson/document.h"
+#include <algorithm>
+#include <atomic>
+#include <ctype.h>
+#include <inttypes.h>
+#include <memory>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <getopt.h>
+#if !defined(OS_WINDOWS)
+#include <netdb.h>
+#endif
+
+enum CmdLineOptsTy {
+  clOptHelp = 1,
+  clOptAddress,
+  clOptConnections,
+  clOptThreads,
+  clOptDuration,
+  clOptRate,
+  clOptMix,
+  clOptLogin,
+  clOptPassword,
+  clOptSession,
+  clOptCoin
+};
+
+static option cmdLineOpts[] = {
+  {"help", no_argument, nullptr, clOptHelp},
+  {"address", required_argument, nullptr, clOptAddress},
+  {"connections", required_argument, nullptr, clOptConnections},
+  {"threads", required_argument, nullptr, clOptThreads},
+  {"duration", required_argument, nullptr, clOptDuration},
+  {"rate", required_argument, nullptr, clOptRate},
+  {"mix", required_argument, nullptr, clOptMix},
+  {"login", required_argument, nullptr, clOptLogin},
+  {"password", required_argument, nullptr, clOptPassword},
+  {"session", required_argument, nullptr, clOptSession},
+  {"coin", required_argument, nullptr, clOptCoin},
+  {nullptr, 0, nullptr, 0}
+};
+
+// Calls of test/poolfrontend.py used by web interface
+static const char DefaultMix[] = "userLogin=1,backendQueryUserBalance=10,backendQueryUserStats=10,backendQueryUserStatsHistory=3,backendQueryFoundBlocks=5";
+
+static constexpr uint64_t ConnectTimeout = 5000000;
+static constexpr uint64_t ReadTimeout = 30000000;
+static constexpr size_t MaxHeadersSize = 65536;
+
+struct CEndpoint {
+  std::string Name;
+  unsigned Weight;
+  // Complete HTTP request
+  std::string Request;
+  CLatencyHistogram Latency;
+  std::atomic<uint64_t> Requests = 0;
+  // HTTP errors, transport errors and replies with non-'ok' status
+  std::atomic<uint64_t> Errors = 0;
+  // 429 Too Many Requests
+  std::atomic<uint64_t> Rejected = 0;
+  std::atomic<uint64_t> BytesIn = 0;
+};
+
+struct CBenchConfig {
+  HostAddress Address;
+  std::string Host;
+  unsigned Connections = 16;
+  unsigned Threads = 1;
+  unsigned Duration = 30;
+  // Requests per second for all connections, 0 means closed loop (next request right after reply)
+  double Rate = 0.0;
+  std::string Login;
+  std::string Password;
+  std::string SessionId;
+  std::string Coin = "BTC";
+};
+
+struct CResponse {
+  int Status = 0;
+  bool Close = false;
+  std::string Body;
+};
+
+enum EParseResult {
+  prIncomplete = 0,
+  prComplete,
+  prError
+};
+
+static bool headerIs(std::string_view line, std::string_view name)
+{
+  if (line.size() < name.size())
+    return false;
+  for (size_t i = 0; i < name.size(); i++) {
+    if (tolower(static_cast<unsigned char>(line[i])) != name[i])
+      return false;
+  }
+  return true;
+}
+
+static bool headerContains(std::string_view line, std::string_view value)
+{
+  std::string lower(line);
+  std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+  return lower.find(value) != lower.npos;
+}
+
+// Replies of pool frontend are chunked or have Content-Length; pipelining not used
+static EParseResult parseResponse(const std::string &data, CResponse &response)
+{
+  size_t headersEnd = data.find("\r\n\r\n");
+  if (headersEnd == data.npos)
+    return data.size() > MaxHeadersSize ? prError : prIncomplete;
+  if (data.compare(0, 9, "HTTP/1.1 ") != 0 && data.compare(0, 9, "HTTP/1.0 ") != 0)
+    return prError;
+
+  response.Status = atoi(data.c_str() + 9);
+  response.Close = data.compare(0, 9, "HTTP/1.0 ") == 0;
+  response.Body.clear();
+  bool chunked = false;
+  size_t contentLength = 0;
+  size_t lineStart = data.find("\r\n") + 2;
+  while (lineStart < headersEnd) {
+    size_t lineEnd = data.find("\r\n", lineStart);
+    std::string_view line(data.data() + lineStart, lineEnd - lineStart);
+    if (headerIs(line, "transfer-encoding:"))
+      chunked = headerContains(line, "chunked");
+    else if (headerIs(line, "content-length:"))
+      contentLength = strtoul(std::string(line.substr(15)).c_str(), nullptr, 10);
+    else if (headerIs(line, "connection:"))
+      response.Close = headerContains(line, "close");
+    lineStart = lineEnd + 2;
+  }
+
+  size_t position = headersEnd + 4;
+  if (!chunked) {
+    if (data.size() < position + contentLength)
+      return prIncomplete;
+    response.Body.assign(data, position, contentLength);
+    return prComplete;
+  }
+
+  for (;;) {
+    size_t lineEnd = data.find("\r\n", position);
+    if (lineEnd == data.npos)
+      return prIncomplete;
+    size_t chunkSize = strtoul(data.c_str() + position, nullptr, 16);
+    if (data.size() < lineEnd + 2 + chunkSize + 2)
+      return prIncomplete;
+    if (chunkSize == 0)
+      return prComplete;
+    response.Body.append(data, lineEnd + 2, chunkSize);
+    position = lineEnd + 2 + chunkSize + 2;
+  }
+}
+
+static std::string jsonString(const std::string &value)
+{
+  std::string result = "\"";
+  for (char c: value) {
+    if (c == '"' || c == '\\') {
+      result.push_back('\\');
+      result.push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+      result.append(escaped);
+    } else {
+      result.push_back(c);
+    }
+  }
+  result.push_back('"');
+  return result;
+}
+
+static std::string buildRequest(const CBenchConfig &config, const std::string &function)
+{
+  std::string body;
+  if (function == "userLogin")
+    body = "{\"login\": " + jsonString(config.Login) + ", \"password\": " + jsonString(config.Password) + "}";
+  else if (function == "backendQueryFoundBlocks")
+    body = "{\"coin\": " + jsonString(config.Coin) + ", \"count\": 20}";
+  else
+    body = "{\"id\": " + jsonString(config.SessionId) + ", \"coin\": " + jsonString(config.Coin) + "}";
+
+  char contentLength[32];
+  snprintf(contentLength, sizeof(contentLength), "%zu", body.size());
+  return "POST /api/" + function + " HTTP/1.1\r\n"
+         "Host: " + config.Host + "\r\n"
+         "Content-Type: application/json\r\n"
+         "Content-Length: " + contentLength + "\r\n\r\n" + body;
+}
+
+class CWorker;
+
+// Keep-alive connection sending one request at a time
+// In open loop mode requests are scheduled with fixed interval and latency is measured from scheduled time,
+// so server stalls are not hidden by requests which were not sent (coordinated omission)
+class CConnection {
+public:
+  CConnection(CWorker &worker, int64_t interval, int64_t firstTime) : Worker_(worker), Interval_(interval), NextTime_(firstTime) {}
+  void start() { connect(); }
+
+private:
+  static void connectCb(AsyncOpStatus status, aioObject*, void *arg) { static_cast<CConnection*>(arg)->onConnect(status); }
+  static void writeCb(AsyncOpStatus status, aioObject*, size_t, void *arg) { static_cast<CConnection*>(arg)->onWrite(status); }
+  static void readCb(AsyncOpStatus status, aioObject*, size_t size, void *arg) { static_cast<CConnection*>(arg)->onRead(status, size); }
+  static void timerCb(aioUserEvent*, void *arg) { static_cast<CConnection*>(arg)->send(); }
+
+  void connect();
+  void reconnect();
+  void onConnect(AsyncOpStatus status);
+  void scheduleNext();
+  void send();
+  void onWrite(AsyncOpStatus status);
+  void onRead(AsyncOpStatus status, size_t size);
+  void finishRequest(const CResponse *response);
+
+private:
+  CWorker &Worker_;
+  aioObject *Socket_ = nullptr;
+  aioUserEvent *Timer_ = nullptr;
+  int64_t Interval_;
+  int64_t NextTime_;
+  int64_t ScheduledTime_ = 0;
+  CEndpoint *Endpoint_ = nullptr;
+  std::string Response_;
+  char ReadBuffer_[65536];
+};
+
+class CWorker {
+public:
+  CWorker(const CBenchConfig &config, std::vector<std::unique_ptr<CEndpoint>> &endpoints, int64_t endTime, uint64_t seed) :
+    Config_(config), Endpoints_(endpoints), EndTime_(endTime), Random_(seed), Base_(createAsyncBase(amOSDefault)) {
+    for (const auto &endpoint: Endpoints_)
+      TotalWeight_ += endpoint->Weight;
+  }
+
+  asyncBase *base() { return Base_; }
+  const CBenchConfig &config() { return Config_; }
+  int64_t endTime() const { return EndTime_; }
+
+  void addConnection(int64_t interval, int64_t firstTime) {
+    Connections_.emplace_back(new CConnection(*this, interval, firstTime));
+  }
+
+  void run() {
+    Active_ = Connections_.size();
+    for (auto &connection: Connections_)
+      connection->start();
+    asyncLoop(Base_);
+  }
+
+  CEndpoint *nextEndpoint() {
+    uint64_t value = Random_() % TotalWeight_;
+    for (const auto &endpoint: Endpoints_) {
+      if (value < endpoint->Weight)
+        return endpoint.get();
+      value -= endpoint->Weight;
+    }
+    return Endpoints_.back().get();
+  }
+
+  void connectionFinished() {
+    if (--Active_ == 0)
+      postQuitOperation(Base_);
+  }
+
+private:
+  const CBenchConfig &Config_;
+  std::vector<std::unique_ptr<CEndpoint>> &Endpoints_;
+  int64_t EndTime_;
+  std::mt19937_64 Random_;
+  uint64_t TotalWeight_ = 0;
+  asyncBase *Base_;
+  std::vector<std::unique_ptr<CConnection>> Connections_;
+  size_t Active_ = 0;
+};
+
+void CConnection::connect()
+{
+  socketTy socketFd = socketCreate(AF_INET, SOCK_STREAM, IPPROTO_TCP, 1);
+  HostAddress localAddress;
+  localAddress.family = AF_INET;
+  localAddress.ipv4 = INADDR_ANY;
+  localAddress.port = 0;
+  socketBind(socketFd, &localAddress);
+  Socket_ = newSocketIo(Worker_.base(), socketFd);
+  aioConnect(Socket_, &Worker_.config().Address, ConnectTimeout, connectCb, this);
+}
+
+void CConnection::reconnect()
+{
+  deleteAioObject(Socket_);
+  Socket_ = nullptr;
+  Response_.clear();
+  connect();
+}
+
+void CConnection::onConnect(AsyncOpStatus status)
+{
+  if (status != aosSuccess) {
+    LOG_F(ERROR, "can't connect to %s", Worker_.config().Host.c_str());
+    deleteAioObject(Socket_);
+    Socket_ = nullptr;
+    Worker_.connectionFinished();
+    return;
+  }
+
+  scheduleNext();
+}
+
+void CConnection::scheduleNext()
+{
+  int64_t now = monotonicTimeUs();
+  if (now >= Worker_.endTime()) {
+    deleteAioObject(Socket_);
+    Socket_ = nullptr;
+    Worker_.connectionFinished();
+    return;
+  }
+
+  if (!Interval_) {
+    ScheduledTime_ = now;
+    send();
+    return;
+  }
+
+  // Late requests are sent immediately, their latency includes waiting time
+  ScheduledTime_ = NextTime_;
+  NextTime_ += Interval_;
+  if (ScheduledTime_ <= now) {
+    send();
+    return;
+  }
+
+  if (!Timer_)
+    Timer_ = newUserEvent(Worker_.base(), 0, timerCb, this);
+  userEventStartTimer(Timer_, ScheduledTime_ - now, 1);
+}
+
+void CConnection::send()
+{
+  Endpoint_ = Worker_.nextEndpoint();
+  aioWrite(Socket_, Endpoint_->Request.data(), Endpoint_->Request.size(), afWaitAll, 0, writeCb, this);
+  aioRead(Socket_, ReadBuffer_, sizeof(ReadBuffer_), afNone, ReadTimeout, readCb, this);
+}
+
+void CConnection::onWrite(AsyncOpStatus status)
+{
+  // Read fails too, error handled there
+  (void)status;
+}
+
+void CConnection::onRead(AsyncOpStatus status, size_t size)
+{
+  if (status != aosSuccess) {
+    finishRequest(nullptr);
+    return;
+  }
+
+  Response_.append(ReadBuffer_, size);
+  CResponse response;
+  switch (parseResponse(Response_, response)) {
+    case prIncomplete :
+      aioRead(Socket_, ReadBuffer_, sizeof(ReadBuffer_), afNone, ReadTimeout, readCb, this);
+      break;
+    case prComplete :
+      finishRequest(&response);
+      break;
+    case prError :
+      finishRequest(nullptr);
+      break;
+  }
+}
+
+void CConnection::finishRequest(const CResponse *response)
+{
+  CEndpoint &endpoint = *Endpoint_;
+  endpoint.Latency.record(monotonicTimeUs() - ScheduledTime_);
+  endpoint.Requests.fetch_add(1, std::memory_order_relaxed);
+  endpoint.BytesIn.fetch_add(Response_.size(), std::memory_order_relaxed);
+  Response_.clear();
+
+  if (!response) {
+    endpoint.Errors.fetch_add(1, std::memory_order_relaxed);
+    reconnect();
+    return;
+  }
+
+  if (response->Status == 429) {
+    endpoint.Rejected.fetch_add(1, std::memory_order_relaxed);
+  } else if (response->Status != 200) {
+    endpoint.Errors.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    rapidjson::Document document;
+    document.Parse(response->Body.c_str());
+    if (document.HasParseError() ||
+        !document.IsObject() ||
+        !document.HasMember("status") ||
+        !document["status"].IsString() ||
+        strcmp(document["status"].GetString(), "ok") != 0)
+      endpoint.Errors.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Server closes connection after 'httpMaxRequestsPerConnection' requests
+  if (response->Close)
+    reconnect();
+  else
+    scheduleNext();
+}
+
+static bool resolveAddress(const char *address, CBenchConfig &config)
+{
+  const char *colonPos = strchr(address, ':');
+  if (!colonPos)
+    return false;
+
+  std::string host(address, colonPos);
+  hostent *hostEntry = gethostbyname(host.c_str());
+  if (!hostEntry || !hostEntry->h_addr)
+    return false;
+
+  config.Host = address;
+  config.Address.family = AF_INET;
+  config.Address.ipv4 = *reinterpret_cast<uint32_t*>(hostEntry->h_addr);
+  config.Address.port = htons(atoi(colonPos + 1));
+  return true;
+}
+
+static bool parseMix(const char *mix, const CBenchConfig &config, std::vector<std::unique_ptr<CEndpoint>> &endpoints)
+{
+  const char *p = mix;
+  while (p && *p) {
+    const char *commaPtr = strchr(p, ',');
+    std::string item(p, commaPtr ? commaPtr - p : strlen(p));
+    p = commaPtr ? commaPtr + 1 : nullptr;
+
+    size_t equalPos = item.find('=');
+    CEndpoint *endpoint = new CEndpoint;
+    endpoints.emplace_back(endpoint);
+    endpoint->Name = item.substr(0, equalPos);
+    endpoint->Weight = equalPos != item.npos ? atoi(item.c_str() + equalPos + 1) : 1;
+    if (endpoint->Name.empty() || endpoint->Weight == 0)
+      return false;
+    endpoint->Request = buildRequest(config, endpoint->Name);
+  }
+
+  return !endpoints.empty();
+}
+
+// Single userLogin request before benchmark, stores session id
+class CLoginRequest {
+public:
+  CLoginRequest(CBenchConfig &config) : Config_(config), Base_(createAsyncBase(amOSDefault)), Request_(buildRequest(config, "userLogin")) {}
+
+  bool run() {
+    socketTy socketFd = socketCreate(AF_INET, SOCK_STREAM, IPPROTO_TCP, 1);
+    HostAddress localAddress;
+    localAddress.family = AF_INET;
+    localAddress.ipv4 = INADDR_ANY;
+    localAddress.port = 0;
+    socketBind(socketFd, &localAddress);
+    Socket_ = newSocketIo(Base_, socketFd);
+    aioConnect(Socket_, &Config_.Address, ConnectTimeout, connectCb, this);
+    asyncLoop(Base_);
+    return Success_;
+  }
+
+private:
+  static void connectCb(AsyncOpStatus status, aioObject*, void *arg) { static_cast<CLoginRequest*>(arg)->onConnect(status); }
+  static void readCb(AsyncOpStatus status, aioObject*, size_t size, void *arg) { static_cast<CLoginRequest*>(arg)->onRead(status, size); }
+
+  void onConnect(AsyncOpStatus status) {
+    if (status != aosSuccess) {
+      LOG_F(ERROR, "can't connect to %s", Config_.Host.c_str());
+      finish();
+      return;
+    }
+
+    aioWrite(Socket_, Request_.data(), Request_.size(), afWaitAll, 0, nullptr, nullptr);
+    aioRead(Socket_, ReadBuffer_, sizeof(ReadBuffer_), afNone, ReadTimeout, readCb, this);
+  }
+
+  void onRead(AsyncOpStatus status, size_t size) {
+    if (status != aosSuccess) {
+      LOG_F(ERROR, "login failed: no response");
+      finish();
+      return;
+    }
+
+    Response_.append(ReadBuffer_, size);
+    CResponse response;
+    EParseResult result = parseResponse(Response_, response);
+    if (result == prIncomplete) {
+      aioRead(Socket_, ReadBuffer_, sizeof(ReadBuffer_), afNone, ReadTimeout, readCb, this);
+      return;
+    }
+
+    rapidjson::Document document;
+    if (result == prComplete)
+      document.Parse(response.Body.c_str());
+    if (result == prComplete &&
+        response.Status == 200 &&
+        !document.HasParseError() &&
+        document.IsObject() &&
+        document.HasMember("sessionid") &&
+        document["sessionid"].IsString()) {
+      Config_.SessionId = document["sessionid"].GetString();
+      Success_ = true;
+    } else {
+      LOG_F(ERROR, "login failed: %s", response.Body.c_str());
+    }
+
+    finish();
+  }
+
+  void finish() {
+    deleteAioObject(Socket_);
+    postQuitOperation(Base_);
+  }
+
+private:
+  CBenchConfig &Config_;
+  asyncBase *Base_;
+  aioObject *Socket_ = nullptr;
+  std::string Request_;
+  std::string Response_;
+  char ReadBuffer_[4096];
+  bool Success_ = false;
+};
+
+static void printReport(std::vector<std::unique_ptr<CEndpoint>> &endpoints, double duration, bool openLoop)
+{
+  printf("\n%-32s %10s %8s %8s %10s %9s %9s %9s %9s %9s\n", "endpoint", "requests", "errors", "429", "req/s", "p50", "p90", "p99", "p99.9", "max");
+  uint64_t totalRequests = 0;
+  uint64_t totalErrors = 0;
+  uint64_t totalRejected = 0;
+  uint64_t totalBytes = 0;
+  for (const auto &endpoint: endpoints) {
+    uint64_t requests = endpoint->Requests.load();
+    const CLatencyHistogram &latency = endpoint->Latency;
+    printf("%-32s %10" PRIu64 " %8" PRIu64 " %8" PRIu64 " %10.1f %9.2f %9.2f %9.2f %9.2f %9.2f\n",
+           endpoint->Name.c_str(),
+           requests,
+           endpoint->Errors.load(),
+           endpoint->Rejected.load(),
+           requests / duration,
+           latency.percentile(0.5) / 1000.0,
+           latency.percentile(0.9) / 1000.0,
+           latency.percentile(0.99) / 1000.0,
+           latency.percentile(0.999) / 1000.0,
+           latency.max() / 1000.0);
+    totalRequests += requests;
+    totalErrors += endpoint->Errors.load();
+    totalRejected += endpoint->Rejected.load();
+    totalBytes += endpoint->BytesIn.load();
+  }
+
+  printf("%-32s %10" PRIu64 " %8" PRIu64 " %8" PRIu64 " %10.1f\n", "total", totalRequests, totalErrors, totalRejected, totalRequests / duration);
+  printf("\nlatency in milliseconds, %s; received %.1f MB/s\n",
+         openLoop ? "measured from scheduled send time (coordinated omission corrected)" : "closed loop, measured from actual send time",
+         totalBytes / duration / 1048576.0);
+}
+
+void printHelpMessage()
+{
+  printf("httpbench usage:\n");
+  printf("  --address <host:port>     pool frontend HTTP address, default 127.0.0.1:18880\n");
+  printf("  --connections <n>         keep-alive connections, default 16\n");
+  printf("  --threads <n>             event loop threads, default 1\n");
+  printf("  --duration <seconds>      default 30\n");
+  printf("  --rate <requests/s>       total request rate; without it every connection sends next request right after reply\n");
+  printf("  --mix <function=weight,...>\n");
+  printf("                            default %s\n", DefaultMix);
+  printf("  --login, --password       user for session (calls with 'id' parameter)\n");
+  printf("  --session <id>            use existing session instead of login\n");
+  printf("  --coin <name>             coin for statistic calls, default BTC\n");
+  printf("Disable rate limiter of tested server: httpRateLimitPerIp and httpRateLimitPerSession equal to 0\n");
+}
+
+int main(int argc, char **argv)
+{
+  loguru::g_stderr_verbosity = loguru::Verbosity_OFF;
+  loguru::g_preamble_thread = false;
+  loguru::g_preamble_file = true;
+  loguru::g_flush_interval_ms = 100;
+  loguru::init(argc, argv);
+  loguru::g_stderr_verbosity = 1;
+  loguru::set_thread_name("main");
+
+  CBenchConfig config;
+  const char *address = "127.0.0.1:18880";
+  const char *mix = DefaultMix;
+
+  // Parsing command line
+  int res;
+  int index = 0;
+  while ((res = getopt_long(argc, argv, "", cmdLineOpts, &index)) != -1) {
+    switch (res) {
+      case clOptHelp :
+        printHelpMessage();
+        return 0;
+      case clOptAddress :
+        address = optarg;
+        break;
+      case clOptConnections :
+        config.Connections = atoi(optarg);
+        break;
+      case clOptThreads :
+        config.Threads = atoi(optarg);
+        break;
+      case clOptDuration :
+        config.Duration = atoi(optarg);
+        break;
+      case clOptRate :
+        config.Rate = atof(optarg);
+        break;
+      case clOptMix :
+        mix = optarg;
+        break;
+      case clOptLogin :
+        config.Login = optarg;
+        break;
+      case clOptPassword :
+        config.Password = optarg;
+        break;
+      case clOptSession :
+        config.SessionId = optarg;
+        break;
+      case clOptCoin :
+        config.Coin = optarg;
+        break;
+      case ':' :
+        fprintf(stderr, "Error: option %s missing argument\n", cmdLineOpts[index].name);
+        break;
+      case '?' :
+        exit(1);
+      default :
+        break;
+    }
+  }
+
+  if (config.Connections == 0 || config.Threads == 0 || config.Duration == 0 || config.Rate < 0.0) {
+    fprintf(stderr, "Error: --connections, --threads and --duration must be positive\n");
+    exit(1);
+  }
+
+  initializeSocketSubsystem();
+  if (!resolveAddress(address, config)) {
+    fprintf(stderr, "Error: invalid address %s, it must have host:port format\n", address);
+    exit(1);
+  }
+
+  if (config.SessionId.empty() && !config.Login.empty()) {
+    if (!CLoginRequest(config).run())
+      return 1;
+    LOG_F(INFO, "logged in as %s", config.Login.c_str());
+  }
+
+  std::vector<std::unique_ptr<CEndpoint>> endpoints;
+  if (!parseMix(mix, config, endpoints)) {
+    fprintf(stderr, "Error: invalid request mix %s\n", mix);
+    exit(1);
+  }
+
+  // Connections start with offset, scheduled requests are spread evenly
+  int64_t startTime = monotonicTimeUs();
+  int64_t endTime = startTime + config.Duration * 1000000LL;
+  int64_t interval = config.Rate > 0.0 ? static_cast<int64_t>(config.Connections * 1000000.0 / config.Rate) : 0;
+  std::vector<std::unique_ptr<CWorker>> workers;
+  for (unsigned i = 0; i < config.Threads; i++)
+    workers.emplace_back(new CWorker(config, endpoints, endTime, i + 1));
+  for (unsigned i = 0; i < config.Connections; i++)
+    workers[i % config.Threads]->addConnection(interval, startTime + interval * i / config.Connections);
+
+  LOG_F(INFO, "%u connections, %u threads, %u seconds, %s", config.Connections, config.Threads, config.Duration, config.Rate > 0.0 ? "open loop" : "closed loop");
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < config.Threads; i++) {
+    threads.emplace_back([i](CWorker *worker) {
+      char threadName[16];
+      snprintf(threadName, sizeof(threadName), "bench%u", i);
+      loguru::set_thread_name(threadName);
+      worker->run();
+    }, workers[i].get());
+  }
+
+  for (auto &thread: threads)
+    thread.join();
+
+  printReport(endpoints, (monotonicTimeUs() - startTime) / 1000000.0, config.Rate > 0.0);
+  return 0;
+}
@@ -0,0 +1,165 @@
+#include "loopWatchdog.h"
+#include "requestStats.h"
+#include "loguru.hpp"
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <inttypes.h>
+
+#if defined(OS_LINUX)
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+
+static constexpr int BacktraceSignal = SIGUSR2;
+static constexpr int MaxBacktraceFrames = 64;
+static void *BacktraceFrames[MaxBacktraceFrames];
+static std::atomic<int> BacktraceFramesNum = -1;
+
+static void backtraceSignalHandler(int)
+{
+  // backtrace() primed in start(), doesn't allocate memory here
+  BacktraceFramesNum.store(backtrace(BacktraceFrames, MaxBacktraceFrames), std::memory_order_release);
+}
+#endif
+
+void CLoopWatchdog::add(asyncBase *base, const std::string &name)
+{
+  if (!enabled())
+    return;
+
+  CLoop *loop = new CLoop;
+  loop->Name = name;
+  loop->Timer = newUserEvent(base, 0, heartbeatCb, loop);
+  userEventStartTimer(loop->Timer, heartbeatInterval(), -1);
+  Loops_.emplace_back(loop);
+}
+
+void CLoopWatchdog::start()
+{
+  if (!enabled())
+    return;
+
+#if defined(OS_LINUX)
+  void *frames[4];
+  backtrace(frames, 4);
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = backtraceSignalHandler;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(BacktraceSignal, &action, nullptr);
+#endif
+
+  // Loops can be started long before watchdog
+  int64_t now = monotonicTimeUs();
+  for (auto &loop: Loops_)
+    loop->LastTick.store(now, std::memory_order_relaxed);
+
+  LOG_F(INFO, "event loop watchdog started: %zu loops, threshold %" PRIi64 " ms", Loops_.size(), Threshold_ / 1000);
+  Thread_ = std::thread([this]() { run(); });
+}
+
+void CLoopWatchdog::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    Stopped_ = true;
+  }
+
+  StopCv_.notify_all();
+  if (Thread_.joinable())
+    Thread_.join();
+}
+
+std::vector<CLoopWatchdog::CLoopStats> CLoopWatchdog::stats()
+{
+  std::vector<CLoopStats> result;
+  result.reserve(Loops_.size());
+  for (const auto &loop: Loops_)
+    result.push_back(CLoopStats{loop->Name, loop->Stalls.load(std::memory_order_relaxed), loop->MaxStall.load(std::memory_order_relaxed)});
+  return result;
+}
+
+void CLoopWatchdog::heartbeatCb(aioUserEvent*, void *arg)
+{
+  CLoop *loop = static_cast<CLoop*>(arg);
+  loop->LastTick.store(monotonicTimeUs(), std::memory_order_relaxed);
+#if defined(OS_LINUX)
+  loop->Thread.store(static_cast<uint64_t>(pthread_self()), std::memory_order_relaxed);
+#endif
+}
+
+void CLoopWatchdog::run()
+{
+  loguru::set_thread_name("loop_watchdog");
+  std::unique_lock<std::mutex> lock(Mutex_);
+  while (!StopCv_.wait_for(lock, std::chrono::microseconds(heartbeatInterval()), [this]() { return Stopped_; })) {
+    int64_t now = monotonicTimeUs();
+    for (auto &loop: Loops_)
+      check(*loop, now);
+  }
+}
+
+void CLoopWatchdog::check(CLoop &loop, int64_t now)
+{
+  // Heartbeat of idle loop can be one interval old
+  int64_t stall = now - loop.LastTick.load(std::memory_order_relaxed) - heartbeatInterval();
+  if (stall < Threshold_) {
+    if (loop.Stalled) {
+      loop.Stalled = false;
+      LOG_F(WARNING, "event loop %s recovered after %" PRIi64 " ms stall", loop.Name.c_str(), loop.CurrentStall / 1000);
+    }
+    return;
+  }
+
+  loop.CurrentStall = stall;
+  if (stall > loop.MaxStall.load(std::memory_order_relaxed))
+    loop.MaxStall.store(stall, std::memory_order_relaxed);
+  if (loop.Stalled)
+    return;
+
+  loop.Stalled = true;
+  loop.Stalls.fetch_add(1, std::memory_order_relaxed);
+  char threadName[32] = "unknown";
+#if defined(OS_LINUX)
+  if (uint64_t thread = loop.Thread.load(std::memory_order_relaxed))
+    pthread_getname_np(static_cast<pthread_t>(thread), threadName, sizeof(threadName));
+#endif
+  LOG_F(WARNING, "event loop %s (thread %s) stalled: no heartbeat for %" PRIi64 " ms", loop.Name.c_str(), threadName, stall / 1000);
+  logBacktrace(loop);
+}
+
+void CLoopWatchdog::logBacktrace(CLoop &loop)
+{
+#if defined(OS_LINUX)
+  // Thread handled last heartbeat; for loop shared by several threads it can be not the stalled one
+  uint64_t thread = loop.Thread.load(std::memory_order_relaxed);
+  if (!thread)
+    return;
+
+  BacktraceFramesNum.store(-1, std::memory_order_relaxed);
+  if (pthread_kill(static_cast<pthread_t>(thread), BacktraceSignal) != 0)
+    return;
+
+  int framesNum = -1;
+  for (unsigned i = 0; i < 100 && (framesNum = BacktraceFramesNum.load(std::memory_order_acquire)) < 0; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  if (framesNum <= 0) {
+    LOG_F(WARNING, "  backtrace of %s not available", loop.Name.c_str());
+    return;
+  }
+
+  char **symbols = backtrace_symbols(BacktraceFrames, framesNum);
+  if (!symbols)
+    return;
+
+  // Skip signal handler and signal trampoline
+  for (int i = 2; i < framesNum; i++)
+    LOG_F(WARNING, "  #%d %s", i - 2, symbols[i]);
+  free(symbols);
+#else
+  (void)loop;
+#endif
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "asyncio/asyncio.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+// Detects event loops blocked by slow callbacks (monitor, backends, statistic servers, HTTP)
+// Every loop runs periodic heartbeat timer; watchdog thread reports loop which heartbeat is late
+// by more than threshold, with backtrace of thread running the loop (Linux only)
+// libp2p event loops have no hooks for callback entry and exit, so loops are observed from outside:
+// by heartbeat lateness here and by thread CPU time in CThreadUsage
+class CLoopWatchdog {
+public:
+  struct CLoopStats {
+    std::string Name;
+    uint64_t Stalls;
+    // Microseconds
+    int64_t MaxStall;
+  };
+
+public:
+  // threshold in milliseconds, 0 disables watchdog
+  CLoopWatchdog(unsigned threshold) : Threshold_(threshold * 1000LL) {}
+  ~CLoopWatchdog() { stop(); }
+
+  bool enabled() const { return Threshold_ != 0; }
+  // All loops must be added before watchdog start, each one before loop start
+  void add(asyncBase *base, const std::string &name);
+  void start();
+  void stop();
+
+  std::vector<CLoopStats> stats();
+
+private:
+  struct CLoop {
+    std::string Name;
+    aioUserEvent *Timer = nullptr;
+    std::atomic<int64_t> LastTick = 0;
+    // Thread handled last heartbeat
+    std::atomic<uint64_t> Thread = 0;
+    std::atomic<uint64_t> Stalls = 0;
+    std::atomic<int64_t> MaxStall = 0;
+    // Watchdog thread only
+    bool Stalled = false;
+    int64_t CurrentStall = 0;
+  };
+
+private:
+  static void heartbeatCb(aioUserEvent*, void *arg);
+  int64_t heartbeatInterval() const { return std::max<int64_t>(Threshold_ / 4, 5000); }
+  void run();
+  void check(CLoop &loop, int64_t now);
+  void logBacktrace(CLoop &loop);
+
+private:
+  int64_t Threshold_;
+  std::mutex Mutex_;
+  std::condition_variable StopCv_;
+  bool Stopped_ = false;
+  std::vector<std::unique_ptr<CLoop>> Loops_;
+  std::thread Thread_;
+};
@@ -59,6 +59,7 @@ struct PoolContext {
   std::unique_ptr<UserManager> UserMgr;
   std::unique_ptr<PoolHttpServer> HttpServer;
   std::unique_ptr<ComplexMiningStats> MiningStats;
+  std::unique_ptr<CLoopWatchdog> LoopWatchdog;
 };
 
 std::filesystem::path userHomeDir()
@@ -91,6 +92,7 @@ int main(int argc, char *argv[])
   unsigned totalThreadsNum = 0;
   unsigned workerThreadsNum = 0;
   unsigned httpThreadsNum = 0;
+  unsigned httpQueryThreadsNum = 0;
 
   initializeSocketSubsystem();
   asyncBase *monitorBase = createAsyncBase(amOSDefault);
@@ -147,6 +149,19 @@ int main(int argc, char *argv[])
       workerThreadsNum = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() / 4 : 2;
     if (httpThreadsNum == 0)
       httpThreadsNum = 1;
+    httpQueryThreadsNum = config.HttpQueryThreadsNum;
+    if (httpQueryThreadsNum == 0) {
+      LOG_F(ERROR, "httpQueryThreadsNum must be at least 1");
+      return 1;
+    }
+    if ((config.HttpRateLimitPerIp > 0.0 || config.HttpRateLimitPerSession > 0.0) && config.HttpRateLimitBurst < PoolHttpConnection::maxEndpointCost()) {
+      LOG_F(ERROR, "httpRateLimitBurst must be at least %u (cost of most expensive API call)", PoolHttpConnection::maxEndpointCost());
+      return 1;
+    }
+
+    // Heartbeat timers added to event loops before their start
+    poolContext.LoopWatchdog.reset(new CLoopWatchdog(config.EventLoopStallThreshold));
+    poolContext.LoopWatchdog->add(monitorBase, "monitor");
 
     // Calculate total threads num
     unsigned backendsNum = static_cast<unsigned>(config.Coins.size());
@@ -155,6 +170,7 @@ int main(int argc, char *argv[])
       workerThreadsNum +    // Share checkers
       backendsNum*2 +       // Backends & metastatistic algorithm servers
       httpThreadsNum +      // HTTP server
+      httpQueryThreadsNum + // HTTP blocking database queries
       1;                    // Complex mining stats service
     LOG_F(INFO, "Worker threads: %u; total pool threads: %u", workerThreadsNum, totalThreadsNum);
 
@@ -306,7 +322,9 @@ int main(int argc, char *argv[])
       }
 
       // Initialize backend
-      PoolBackend *backend = new PoolBackend(createAsyncBase(amOSDefault), std::move(backendConfig), coinInfo, *poolContext.UserMgr, *dispatcher, *poolContext.PriceFetcher);
+      asyncBase *backendBase = createAsyncBase(amOSDefault);
+      poolContext.LoopWatchdog->add(backendBase, coinInfo.Name);
+      PoolBackend *backend = new PoolBackend(backendBase, std::move(backendConfig), coinInfo, *poolContext.UserMgr, *dispatcher, *poolContext.PriceFetcher);
 
       if (coinConfig.ProfitSwitchCoeff != 0.0)
         backend->setProfitSwitchCoeff(coinConfig.ProfitSwitchCoeff);
@@ -326,7 +344,9 @@ int main(int argc, char *argv[])
 
         PoolBackendConfig algoConfig;
         algoConfig.dbPath = poolContext.DatabasePath / algoInfo.Name;
-        StatisticServer *server = new StatisticServer(createAsyncBase(amOSDefault), algoConfig, algoInfo);
+        asyncBase *algoBase = createAsyncBase(amOSDefault);
+        poolContext.LoopWatchdog->add(algoBase, algoInfo.Name);
+        StatisticServer *server = new StatisticServer(algoBase, algoConfig, algoInfo);
         poolContext.AlgoMetaStatistic.emplace_back(server);
         AlgoIt = knownAlgo.insert(AlgoIt, std::make_pair(coinInfo.Algorithm, server));
       }
@@ -407,8 +427,9 @@ int main(int argc, char *argv[])
     dispatcher->poll();
   }
 
-  poolContext.HttpServer.reset(new PoolHttpServer(poolContext.HttpPort, *poolContext.UserMgr, poolContext.Backends, poolContext.AlgoMetaStatistic, *poolContext.MiningStats, config, httpThreadsNum));
+  poolContext.HttpServer.reset(new PoolHttpServer(poolContext.HttpPort, *poolContext.UserMgr, poolContext.Backends, poolContext.AlgoMetaStatistic, *poolContext.MiningStats, *poolContext.LoopWatchdog, config, httpThreadsNum));
   poolContext.HttpServer->start();
+  poolContext.LoopWatchdog->start();
 
   // Start monitor thread
   std::thread monitorThread([](asyncBase *base) {
@@ -435,6 +456,7 @@ int main(int argc, char *argv[])
       std::this_thread::sleep_for(std::chrono::seconds(1));
     }
     LOG_F(INFO, "Interrupted by user");
+    poolContext.LoopWatchdog->stop();
     // Stop HTTP server
     poolContext.HttpServer->stop();
     // Stop workers
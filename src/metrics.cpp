@@ -0,0 +1,54 @@
+#include "metrics.h"
+#include <stdio.h>
+#include <string.h>
+
+void CMetricsWriter::family(const char *name, const char *type, const char *help)
+{
+  Stream_.write("# HELP ");
+  Stream_.write(name);
+  Stream_.write(' ');
+  Stream_.write(help);
+  Stream_.write("\n# TYPE ");
+  Stream_.write(name);
+  Stream_.write(' ');
+  Stream_.write(type);
+  Stream_.write('\n');
+}
+
+void CMetricsWriter::sample(const char *name, Labels labels, double value)
+{
+  Stream_.write(name);
+  if (labels.size()) {
+    bool first = true;
+    Stream_.write('{');
+    for (const auto &label: labels) {
+      if (!first)
+        Stream_.write(',');
+      Stream_.write(label.first);
+      Stream_.write("=\"");
+      writeLabelValue(label.second);
+      Stream_.write('"');
+      first = false;
+    }
+    Stream_.write('}');
+  }
+
+  // Integer counters up to 2^53 printed exactly
+  char buffer[64];
+  int size = snprintf(buffer, sizeof(buffer), " %.17g\n", value);
+  Stream_.write(buffer, size);
+}
+
+void CMetricsWriter::writeLabelValue(std::string_view value)
+{
+  for (char c: value) {
+    if (c == '\\')
+      Stream_.write("\\\\", 2);
+    else if (c == '"')
+      Stream_.write("\\\"", 2);
+    else if (c == '\n')
+      Stream_.write("\\n", 2);
+    else
+      Stream_.write(c);
+  }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "p2putils/xmstream.h"
+#include <initializer_list>
+#include <string_view>
+#include <utility>
+
+// Prometheus text exposition format (version 0.0.4)
+class CMetricsWriter {
+public:
+  typedef std::initializer_list<std::pair<const char*, std::string_view>> Labels;
+
+public:
+  CMetricsWriter(xmstream &stream) : Stream_(stream) {}
+
+  // Metric family header, must precede its samples
+  void family(const char *name, const char *type, const char *help);
+  void sample(const char *name, double value) { sample(name, {}, value); }
+  void sample(const char *name, Labels labels, double value);
+
+private:
+  void writeLabelValue(std::string_view value);
+
+private:
+  xmstream &Stream_;
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <cstddef>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+struct CPoolCounters {
+  std::atomic<uint64_t> Hits = 0;
+  std::atomic<uint64_t> Misses = 0;
+};
+
+// Per-thread free lists for objects of fixed size
+// Object remembers thread allocated it and goes back to that thread's free list when released:
+// by owner directly, by other threads (backend and query threads finishing requests) through lock-free stack
+template<size_t ObjectSize, size_t CacheSize>
+class CThreadLocalSlab {
+public:
+  static void *allocate() {
+    COwner &owner = threadOwner();
+    if (owner.Objects.empty())
+      owner.takeRemote();
+
+    CHeader *header;
+    if (!owner.Objects.empty()) {
+      header = owner.Objects.back();
+      owner.Objects.pop_back();
+      Counters_.Hits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      header = static_cast<CHeader*>(::operator new(sizeof(CHeader) + ObjectSize));
+      Counters_.Misses.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    owner.References.fetch_add(1, std::memory_order_relaxed);
+    header->Owner = &owner;
+    return header + 1;
+  }
+
+  static void release(void *object) {
+    CHeader *header = static_cast<CHeader*>(object) - 1;
+    COwner *owner = header->Owner;
+    if (owner == CurrentOwner_) {
+      if (owner->Objects.size() < CacheSize)
+        owner->Objects.push_back(header);
+      else
+        ::operator delete(header);
+      owner->References.fetch_sub(1, std::memory_order_relaxed);
+      return;
+    }
+
+    header->Next = owner->Remote.load(std::memory_order_relaxed);
+    while (!owner->Remote.compare_exchange_weak(header->Next, header, std::memory_order_release, std::memory_order_relaxed))
+      continue;
+    owner->release();
+  }
+
+  static const CPoolCounters &counters() { return Counters_; }
+
+private:
+  struct COwner;
+  struct alignas(alignof(std::max_align_t)) CHeader {
+    // Owner while object is in use, next object in remote stack after release
+    union {
+      COwner *Owner;
+      CHeader *Next;
+    };
+  };
+
+  // Free lists of one thread; lives while thread runs or its objects are in use
+  struct COwner {
+    std::vector<CHeader*> Objects;
+    std::atomic<CHeader*> Remote = nullptr;
+    // Thread and objects in use
+    std::atomic<size_t> References = 1;
+
+    void takeRemote() {
+      CHeader *header = Remote.exchange(nullptr, std::memory_order_acquire);
+      while (header) {
+        CHeader *next = header->Next;
+        if (Objects.size() < CacheSize)
+          Objects.push_back(header);
+        else
+          ::operator delete(header);
+        header = next;
+      }
+    }
+
+    void release() {
+      if (References.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+      for (CHeader *header: Objects)
+        ::operator delete(header);
+      Objects.clear();
+      takeRemote();
+      for (CHeader *header: Objects)
+        ::operator delete(header);
+      delete this;
+    }
+  };
+
+  struct COwnerHolder {
+    COwner *Owner = new COwner;
+    COwnerHolder() { CurrentOwner_ = Owner; }
+    ~COwnerHolder() {
+      // Objects released after thread exit go to remote stack, last one deletes owner
+      CurrentOwner_ = nullptr;
+      Owner->release();
+    }
+  };
+
+  static COwner &threadOwner() {
+    static thread_local COwnerHolder holder;
+    return *holder.Owner;
+  }
+
+private:
+  static inline CPoolCounters Counters_;
+  static inline thread_local COwner *CurrentOwner_ = nullptr;
+};
+
+// Shared pool of large buffers
+class CBufferPool {
+public:
+  CBufferPool(size_t bufferSize, size_t cacheSize) : BufferSize_(bufferSize), CacheSize_(cacheSize) {}
+  ~CBufferPool() {
+    for (void *buffer: Buffers_)
+      ::operator delete(buffer);
+  }
+
+  size_t bufferSize() const { return BufferSize_; }
+
+  void *acquire() {
+    {
+      std::lock_guard<std::mutex> lock(Mutex_);
+      if (!Buffers_.empty()) {
+        void *buffer = Buffers_.back();
+        Buffers_.pop_back();
+        Counters_.Hits.fetch_add(1, std::memory_order_relaxed);
+        return buffer;
+      }
+    }
+
+    Counters_.Misses.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(BufferSize_);
+  }
+
+  void release(void *buffer) {
+    {
+      std::lock_guard<std::mutex> lock(Mutex_);
+      if (Buffers_.size() < CacheSize_) {
+        Buffers_.push_back(buffer);
+        return;
+      }
+    }
+
+    ::operator delete(buffer);
+  }
+
+  const CPoolCounters &counters() const { return Counters_; }
+
+private:
+  size_t BufferSize_;
+  size_t CacheSize_;
+  std::mutex Mutex_;
+  std::vector<void*> Buffers_;
+  CPoolCounters Counters_;
+};
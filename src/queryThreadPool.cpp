@@ -0,0 +1,77 @@
+#include "queryThreadPool.h"
+#include "poolcore/thread.h"
+#include "loguru.hpp"
+#include <chrono>
+
+void CQueryThreadPool::start()
+{
+  Threads_.reset(new std::thread[ThreadsNum_]);
+  BusyTime_.reset(new std::atomic<uint64_t>[ThreadsNum_]);
+  for (size_t i = 0; i < ThreadsNum_; i++)
+    BusyTime_[i] = 0;
+  for (size_t i = 0; i < ThreadsNum_; i++) {
+    Threads_[i] = std::thread([i](CQueryThreadPool *pool) {
+      char threadName[16];
+      snprintf(threadName, sizeof(threadName), "query%zu", i);
+      loguru::set_thread_name(threadName);
+      InitializeWorkerThread();
+      LOG_F(INFO, "query thread started tid=%u", GetGlobalThreadId());
+      pool->worker(i);
+    }, this);
+  }
+}
+
+void CQueryThreadPool::stop()
+{
+  std::deque<CTask> cancelled;
+  {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    Stopped_ = true;
+    cancelled.swap(Queue_);
+  }
+
+  CondVar_.notify_all();
+  for (auto &task: cancelled)
+    task.Cancel();
+  for (size_t i = 0; i < ThreadsNum_; i++)
+    Threads_[i].join();
+}
+
+void CQueryThreadPool::run(std::function<void()> &&task, std::function<void()> &&cancel)
+{
+  {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    if (!Stopped_) {
+      Queue_.emplace_back(CTask{std::move(task), std::move(cancel)});
+      CondVar_.notify_one();
+      return;
+    }
+  }
+
+  cancel();
+}
+
+size_t CQueryThreadPool::queueDepth()
+{
+  std::lock_guard<std::mutex> lock(Mutex_);
+  return Queue_.size();
+}
+
+void CQueryThreadPool::worker(size_t index)
+{
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(Mutex_);
+      CondVar_.wait(lock, [this]() { return Stopped_ || !Queue_.empty(); });
+      if (Stopped_)
+        return;
+      task = std::move(Queue_.front().Run);
+      Queue_.pop_front();
+    }
+
+    auto beginTime = std::chrono::steady_clock::now();
+    task();
+    BusyTime_[index].fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - beginTime).count(), std::memory_order_relaxed);
+  }
+}
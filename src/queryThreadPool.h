@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Thread pool for synchronous (blocking) database reads issued by HTTP handlers
+class CQueryThreadPool {
+public:
+  CQueryThreadPool(size_t threadsNum) : ThreadsNum_(threadsNum) {}
+  void start();
+  // Cancels queued tasks, waits for running ones and joins threads
+  void stop();
+  // cancel runs instead of task if pool is stopped before task started
+  void run(std::function<void()> &&task, std::function<void()> &&cancel);
+
+  size_t threadsNum() const { return ThreadsNum_; }
+  size_t queueDepth();
+  // Time spent in tasks by worker, microseconds
+  uint64_t busyTime(size_t worker) const { return BusyTime_[worker].load(std::memory_order_relaxed); }
+
+private:
+  struct CTask {
+    std::function<void()> Run;
+    std::function<void()> Cancel;
+  };
+
+private:
+  void worker(size_t index);
+
+private:
+  size_t ThreadsNum_;
+  std::unique_ptr<std::thread[]> Threads_;
+  std::unique_ptr<std::atomic<uint64_t>[]> BusyTime_;
+  std::mutex Mutex_;
+  std::condition_variable CondVar_;
+  std::deque<CTask> Queue_;
+  bool Stopped_ = false;
+};
@@ -0,0 +1,43 @@
+#include "rateLimiter.h"
+#include <algorithm>
+#include <chrono>
+
+bool CRateLimiter::consume(uint64_t client, double cost)
+{
+  if (!enabled())
+    return true;
+
+  int64_t currentTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  CShard &shard = Shards_[(client ^ (client >> 32)) % ShardsNum];
+  std::lock_guard<std::mutex> lock(shard.Mutex);
+
+  CBucket *bucketPtr;
+  auto It = shard.Buckets.find(client);
+  if (It != shard.Buckets.end()) {
+    shard.Order.splice(shard.Order.end(), shard.Order, It->second);
+    bucketPtr = &*It->second;
+  } else if (shard.Buckets.size() >= std::max<size_t>(MaxClients_ / ShardsNum, 1)) {
+    // Reuse least recently seen entry for new client
+    auto Oldest = shard.Order.begin();
+    shard.Buckets.erase(Oldest->Client);
+    shard.Order.splice(shard.Order.end(), shard.Order, Oldest);
+    *Oldest = CBucket{client, Burst_, currentTime};
+    shard.Buckets.emplace(client, Oldest);
+    bucketPtr = &*Oldest;
+  } else {
+    auto Inserted = shard.Order.insert(shard.Order.end(), CBucket{client, Burst_, currentTime});
+    shard.Buckets.emplace(client, Inserted);
+    bucketPtr = &*Inserted;
+  }
+
+  CBucket &bucket = *bucketPtr;
+  bucket.Tokens = std::min(Burst_, bucket.Tokens + (currentTime - bucket.LastTime) * Rate_ / 1000000.0);
+  bucket.LastTime = currentTime;
+  if (bucket.Tokens < cost) {
+    Rejected_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  bucket.Tokens -= cost;
+  return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+
+// Token buckets for many clients (IP addresses, sessions)
+// Every client gets 'burst' tokens which refilled with 'rate' tokens per second
+// Number of clients is bounded, least recently seen client is forgotten when limit reached
+class CRateLimiter {
+public:
+  CRateLimiter(double rate, double burst, size_t maxClients) : Rate_(rate), Burst_(burst), MaxClients_(maxClients) {}
+
+  bool enabled() const { return Rate_ > 0.0; }
+  // Take 'cost' tokens from client bucket, returns false if not enough tokens
+  bool consume(uint64_t client, double cost);
+
+  uint64_t rejected() const { return Rejected_.load(std::memory_order_relaxed); }
+
+private:
+  struct CBucket {
+    uint64_t Client;
+    double Tokens;
+    int64_t LastTime;
+  };
+
+  struct alignas(64) CShard {
+    std::mutex Mutex;
+    // Least recently seen first
+    std::list<CBucket> Order;
+    std::unordered_map<uint64_t, std::list<CBucket>::iterator> Buckets;
+  };
+
+  static constexpr size_t ShardsNum = 16;
+
+private:
+  double Rate_;
+  double Burst_;
+  size_t MaxClients_;
+  CShard Shards_[ShardsNum];
+  std::atomic<uint64_t> Rejected_ = 0;
+};
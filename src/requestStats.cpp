@@ -0,0 +1,73 @@
+#include "requestStats.h"
+#include <algorithm>
+#include <cmath>
+
+unsigned CLatencyHistogram::bucketIndex(uint64_t value)
+{
+  if (value < SubBuckets)
+    return static_cast<unsigned>(value);
+
+  unsigned exponent = 63 - __builtin_clzll(value);
+  if (exponent >= MaxExponent)
+    return BucketsNum - 1;
+  unsigned subBucket = static_cast<unsigned>(value >> (exponent - SubBucketsLog2)) - SubBuckets;
+  return SubBuckets + (exponent - SubBucketsLog2) * SubBuckets + subBucket;
+}
+
+uint64_t CLatencyHistogram::bucketUpperBound(unsigned index)
+{
+  if (index < SubBuckets)
+    return index;
+
+  unsigned shift = (index - SubBuckets) / SubBuckets;
+  uint64_t subBucket = SubBuckets + (index - SubBuckets) % SubBuckets;
+  return ((subBucket + 1) << shift) - 1;
+}
+
+void CLatencyHistogram::record(int64_t value)
+{
+  uint64_t v = value > 0 ? static_cast<uint64_t>(value) : 0;
+  Buckets_[bucketIndex(v)].fetch_add(1, std::memory_order_relaxed);
+  Sum_.fetch_add(v, std::memory_order_relaxed);
+  uint64_t max = Max_.load(std::memory_order_relaxed);
+  while (v > max && !Max_.compare_exchange_weak(max, v, std::memory_order_relaxed))
+    continue;
+}
+
+uint64_t CLatencyHistogram::count() const
+{
+  uint64_t result = 0;
+  for (const auto &bucket: Buckets_)
+    result += bucket.load(std::memory_order_relaxed);
+  return result;
+}
+
+uint64_t CLatencyHistogram::percentile(double q) const
+{
+  uint64_t total = count();
+  if (!total)
+    return 0;
+
+  uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * total)));
+  uint64_t accumulated = 0;
+  for (unsigned i = 0; i < BucketsNum; i++) {
+    accumulated += Buckets_[i].load(std::memory_order_relaxed);
+    if (accumulated >= target)
+      return std::min(bucketUpperBound(i), max());
+  }
+
+  return max();
+}
+
+const char *requestPhaseName(ERequestPhase phase)
+{
+  switch (phase) {
+    case rpTotal : return "total";
+    case rpParse : return "parse";
+    case rpSession : return "session";
+    case rpBackend : return "backend";
+    case rpSerialize : return "serialize";
+    case rpWrite : return "write";
+    default : return "unknown";
+  }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+static inline int64_t monotonicTimeUs()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Log-linear histogram of durations in microseconds (HDR-like, 16 sub-buckets per power of two,
+// relative error below 6.25%); recording is lock-free
+class CLatencyHistogram {
+public:
+  void record(int64_t value);
+  uint64_t count() const;
+  uint64_t sum() const { return Sum_.load(std::memory_order_relaxed); }
+  uint64_t max() const { return Max_.load(std::memory_order_relaxed); }
+  // q in [0, 1]; returns highest value equivalent to bucket containing quantile
+  uint64_t percentile(double q) const;
+
+private:
+  static constexpr unsigned SubBucketsLog2 = 4;
+  static constexpr unsigned SubBuckets = 1u << SubBucketsLog2;
+  // Values up to 2^40 us
+  static constexpr unsigned MaxExponent = 40;
+  static constexpr unsigned BucketsNum = SubBuckets + (MaxExponent - SubBucketsLog2) * SubBuckets;
+
+  static unsigned bucketIndex(uint64_t value);
+  static uint64_t bucketUpperBound(unsigned index);
+
+private:
+  std::atomic<uint64_t> Buckets_[BucketsNum] = {};
+  std::atomic<uint64_t> Max_ = 0;
+  std::atomic<uint64_t> Sum_ = 0;
+};
+
+enum ERequestPhase {
+  // Whole request, from first line to last written byte
+  rpTotal = 0,
+  // HTTP and JSON parsing, limits, cache lookup
+  rpParse,
+  rpSession,
+  // Handler and backend query until reply serialization started
+  rpBackend,
+  rpSerialize,
+  rpWrite,
+  rpPhasesNum
+};
+
+// Counters of one API function
+struct CRequestStats {
+  CLatencyHistogram Latency[rpPhasesNum];
+  std::atomic<uint64_t> Requests = 0;
+  std::atomic<uint64_t> Errors = 0;
+  std::atomic<uint64_t> BytesIn = 0;
+  std::atomic<uint64_t> BytesOut = 0;
+};
+
+const char *requestPhaseName(ERequestPhase phase);
@@ -0,0 +1,77 @@
+#include "responseCache.h"
+#include <time.h>
+
+std::shared_ptr<const std::string> CResponseCache::get(const std::string &key)
+{
+  int64_t currentTime = time(nullptr);
+  uint64_t currentGeneration = generation();
+  {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    auto It = Entries_.find(key);
+    if (It != Entries_.end()) {
+      if (It->second.ExpireTime > currentTime && It->second.Generation == currentGeneration) {
+        Hits_.fetch_add(1, std::memory_order_relaxed);
+        return It->second.Data;
+      }
+
+      erase(It);
+    }
+  }
+
+  Misses_.fetch_add(1, std::memory_order_relaxed);
+  return nullptr;
+}
+
+void CResponseCache::put(const std::string &key, uint64_t generation, std::string &&data)
+{
+  // Response was built before invalidation
+  if (generation != this->generation())
+    return;
+
+  size_t entrySize = key.size() + data.size();
+  if (entrySize > MaxSize_)
+    return;
+
+  int64_t currentTime = time(nullptr);
+  std::lock_guard<std::mutex> lock(Mutex_);
+  auto It = Entries_.find(key);
+  if (It != Entries_.end())
+    erase(It);
+
+  // Front of list expires first
+  while (!Order_.empty() && (Entries_.size() >= MaxEntries_ || Size_ + entrySize > MaxSize_)) {
+    auto Oldest = Entries_.find(Order_.front());
+    if (Oldest->second.ExpireTime > currentTime && Oldest->second.Generation == generation)
+      Evictions_.fetch_add(1, std::memory_order_relaxed);
+    erase(Oldest);
+  }
+
+  CEntry &entry = Entries_[key];
+  entry.Data = std::make_shared<const std::string>(std::move(data));
+  entry.ExpireTime = currentTime + TTL_;
+  entry.Generation = generation;
+  entry.Order = Order_.insert(Order_.end(), key);
+  Size_ += entrySize;
+}
+
+void CResponseCache::invalidate()
+{
+  Generation_.fetch_add(1, std::memory_order_acq_rel);
+  std::lock_guard<std::mutex> lock(Mutex_);
+  Entries_.clear();
+  Order_.clear();
+  Size_ = 0;
+}
+
+size_t CResponseCache::size()
+{
+  std::lock_guard<std::mutex> lock(Mutex_);
+  return Size_;
+}
+
+void CResponseCache::erase(std::unordered_map<std::string, CEntry>::iterator It)
+{
+  Size_ -= It->first.size() + It->second.Data->size();
+  Order_.erase(It->second.Order);
+  Entries_.erase(It);
+}
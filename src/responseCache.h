@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <stdint.h>
+
+// Serialized responses of public API functions with time limited validity
+// Bounded by entries number and total size; oldest entries evicted first (all entries have same TTL)
+class CResponseCache {
+public:
+  // Request parameters after parsing and defaults substitution; every value is length-prefixed
+  class CKey {
+  public:
+    CKey &add(std::string_view value) {
+      add(static_cast<int64_t>(value.size()));
+      Data_.append(value.data(), value.size());
+      return *this;
+    }
+
+    CKey &add(int64_t value) {
+      Data_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+      return *this;
+    }
+
+    const std::string &data() const { return Data_; }
+
+  private:
+    std::string Data_;
+  };
+
+public:
+  CResponseCache(unsigned ttl, size_t maxEntries, size_t maxSize) : TTL_(ttl), MaxEntries_(maxEntries), MaxSize_(maxSize) {}
+
+  bool enabled() const { return TTL_ != 0; }
+  uint64_t generation() const { return Generation_.load(std::memory_order_acquire); }
+
+  std::shared_ptr<const std::string> get(const std::string &key);
+  void put(const std::string &key, uint64_t generation, std::string &&data);
+  // Drop all entries (found new block, etc.)
+  void invalidate();
+
+  uint64_t hits() const { return Hits_.load(std::memory_order_relaxed); }
+  uint64_t misses() const { return Misses_.load(std::memory_order_relaxed); }
+  uint64_t evictions() const { return Evictions_.load(std::memory_order_relaxed); }
+  size_t size();
+
+private:
+  struct CEntry {
+    std::shared_ptr<const std::string> Data;
+    int64_t ExpireTime;
+    uint64_t Generation;
+    // Position in insertion order list
+    std::list<std::string>::iterator Order;
+  };
+
+  // Must be called with locked mutex
+  void erase(std::unordered_map<std::string, CEntry>::iterator It);
+
+private:
+  unsigned TTL_;
+  size_t MaxEntries_;
+  size_t MaxSize_;
+  std::atomic<uint64_t> Generation_ = 0;
+  std::atomic<uint64_t> Hits_ = 0;
+  std::atomic<uint64_t> Misses_ = 0;
+  std::atomic<uint64_t> Evictions_ = 0;
+  std::mutex Mutex_;
+  std::unordered_map<std::string, CEntry> Entries_;
+  std::list<std::string> Order_;
+  // Keys and responses
+  size_t Size_ = 0;
+};
@@ -0,0 +1,285 @@
+#include "serializers.h"
+#include "cbor.h"
+#include "fastJson.h"
+#include "poolcommon/jsonSerializer.h"
+#include "poolcommon/utils.h"
+
+// Serializers are instantiated for CBOR, poolcommon JSON and FastJSON; the latter is used for JSON when its output is the same
+
+static inline void addMoney(JSON::Object &object, const char *name, int64_t value, int64_t rationalPartSize)
+{
+  object.addString(name, FormatMoney(value, rationalPartSize));
+}
+
+static inline void addMoney(FastJSON::Object &object, const char *name, int64_t value, int64_t rationalPartSize)
+{
+  object.addMoney(name, value, rationalPartSize);
+}
+
+static inline void addMoney(CBOR::Object &object, const char *name, int64_t value, int64_t rationalPartSize)
+{
+  object.addString(name, FormatMoney(value, rationalPartSize));
+}
+
+// Field bits, in order of FieldNames tables
+enum EWorkerStatsField : uint32_t {
+  wsfName = 1u << 0,
+  wsfShareRate = 1u << 1,
+  wsfShareWork = 1u << 2,
+  wsfPower = 1u << 3,
+  wsfLastShareTime = 1u << 4
+};
+
+enum EStatsHistoryField : uint32_t {
+  shfName = 1u << 0,
+  shfTime = 1u << 1,
+  shfShareRate = 1u << 2,
+  shfShareWork = 1u << 3,
+  shfPower = 1u << 4
+};
+
+enum EUserField : uint32_t {
+  ufLogin = 1u << 0,
+  ufName = 1u << 1,
+  ufEmail = 1u << 2,
+  ufRegistrationDate = 1u << 3,
+  ufIsActive = 1u << 4,
+  ufIsReadOnly = 1u << 5,
+  ufFeePlanId = 1u << 6,
+  ufWorkers = 1u << 7,
+  ufShareRate = 1u << 8,
+  ufPower = 1u << 9,
+  ufLastShareTime = 1u << 10
+};
+
+enum EFoundBlockField : uint32_t {
+  fbfHeight = 1u << 0,
+  fbfHash = 1u << 1,
+  fbfTime = 1u << 2,
+  fbfConfirmations = 1u << 3,
+  fbfGeneratedCoins = 1u << 4,
+  fbfFoundBy = 1u << 5
+};
+
+enum EPayoutField : uint32_t {
+  pfTime = 1u << 0,
+  pfTxid = 1u << 1,
+  pfValue = 1u << 2,
+  pfStatus = 1u << 3
+};
+
+static const std::vector<std::string_view> FieldNames[] = {
+  // rtWorkerStats
+  {"name", "shareRate", "shareWork", "power", "lastShareTime"},
+  // rtStatsHistory
+  {"name", "time", "shareRate", "shareWork", "power"},
+  // rtUser
+  {"login", "name", "email", "registrationDate", "isActive", "isReadOnly", "feePlanId", "workers", "shareRate", "power", "lastShareTime"},
+  // rtFoundBlock
+  {"height", "hash", "time", "confirmations", "generatedCoins", "foundBy"},
+  // rtPayout
+  {"time", "txid", "value", "status"}
+};
+
+uint32_t rowFieldBit(ERowType type, std::string_view name)
+{
+  const std::vector<std::string_view> &names = FieldNames[type];
+  for (size_t i = 0; i < names.size(); i++) {
+    if (names[i] == name)
+      return 1u << i;
+  }
+  return 0;
+}
+
+template<typename ObjectTy, typename ArrayTy>
+static void serializeUserStatsImpl(xmstream &stream,
+                                   const CCoinInfo &coinInfo,
+                                   int64_t currentTime,
+                                   const StatisticDb::CStats &aggregate,
+                                   const std::vector<StatisticDb::CStats> &workers,
+                                   uint32_t workerFields)
+{
+  ObjectTy object(stream);
+  object.addString("status", "ok");
+  object.addString("powerUnit", coinInfo.getPowerUnitName());
+  object.addInt("powerMultLog10", coinInfo.PowerMultLog10);
+  object.addInt("currentTime", currentTime);
+  object.addField("total");
+  {
+    ObjectTy total(stream);
+    total.addInt("clients", aggregate.ClientsNum);
+    total.addInt("workers", aggregate.WorkersNum);
+    total.addDouble("shareRate", aggregate.SharesPerSecond);
+    total.addDouble("shareWork", aggregate.SharesWork);
+    total.addInt("power", aggregate.AveragePower);
+    total.addInt("lastShareTime", aggregate.LastShareTime);
+  }
+
+  object.addField("workers");
+  {
+    ArrayTy workersOutput(stream);
+    for (size_t i = 0, ie = workers.size(); i != ie; ++i) {
+      workersOutput.addField();
+      {
+        ObjectTy workerOutput(stream);
+        if (workerFields & wsfName)
+          workerOutput.addString("name", workers[i].WorkerId);
+        if (workerFields & wsfShareRate)
+          workerOutput.addDouble("shareRate", workers[i].SharesPerSecond);
+        if (workerFields & wsfShareWork)
+          workerOutput.addDouble("shareWork", workers[i].SharesWork);
+        if (workerFields & wsfPower)
+          workerOutput.addInt("power", workers[i].AveragePower);
+        if (workerFields & wsfLastShareTime)
+          workerOutput.addInt("lastShareTime", workers[i].LastShareTime);
+      }
+    }
+  }
+}
+
+template<typename ObjectTy>
+static void serializeStatsHistoryRowImpl(xmstream &stream, const StatisticDb::CStats &stats, uint32_t fields)
+{
+  ObjectTy workerOutput(stream);
+  if (fields & shfName)
+    workerOutput.addString("name", stats.WorkerId);
+  if (fields & shfTime)
+    workerOutput.addInt("time", stats.Time);
+  if (fields & shfShareRate)
+    workerOutput.addDouble("shareRate", stats.SharesPerSecond);
+  if (fields & shfShareWork)
+    workerOutput.addDouble("shareWork", stats.SharesWork);
+  if (fields & shfPower)
+    workerOutput.addInt("power", stats.AveragePower);
+}
+
+template<typename ObjectTy>
+static void serializeUserRowImpl(xmstream &stream, const StatisticDb::CredentialsWithStatistic &user, uint32_t fields)
+{
+  ObjectTy userObject(stream);
+  if (fields & ufLogin)
+    userObject.addString("login", user.Credentials.Login);
+  if (fields & ufName)
+    userObject.addString("name", user.Credentials.Name);
+  if (fields & ufEmail)
+    userObject.addString("email", user.Credentials.EMail);
+  if (fields & ufRegistrationDate)
+    userObject.addInt("registrationDate", user.Credentials.RegistrationDate);
+  if (fields & ufIsActive)
+    userObject.addBoolean("isActive", user.Credentials.IsActive);
+  if (fields & ufIsReadOnly)
+    userObject.addBoolean("isReadOnly", user.Credentials.IsReadOnly);
+  if (fields & ufFeePlanId)
+    userObject.addString("feePlanId", user.Credentials.FeePlan);
+  if (fields & ufWorkers)
+    userObject.addInt("workers", user.WorkersNum);
+  if (fields & ufShareRate)
+    userObject.addDouble("shareRate", user.SharesPerSecond);
+  if (fields & ufPower)
+    userObject.addInt("power", user.AveragePower);
+  if (fields & ufLastShareTime)
+    userObject.addInt("lastShareTime", user.LastShareTime);
+}
+
+template<typename ObjectTy>
+static void serializeFoundBlockImpl(xmstream &stream, const FoundBlockRecord &block, int64_t confirmations, const CCoinInfo &coinInfo, uint32_t fields)
+{
+  ObjectTy object(stream);
+  if (fields & fbfHeight)
+    object.addInt("height", block.Height);
+  if (fields & fbfHash)
+    object.addString("hash", !block.PublicHash.empty() ? block.PublicHash : block.Hash);
+  if (fields & fbfTime)
+    object.addInt("time", block.Time);
+  if (fields & fbfConfirmations)
+    object.addInt("confirmations", confirmations);
+  if (fields & fbfGeneratedCoins)
+    addMoney(object, "generatedCoins", block.AvailableCoins, coinInfo.RationalPartSize);
+  if (fields & fbfFoundBy)
+    object.addString("foundBy", block.FoundBy);
+}
+
+template<typename ObjectTy>
+static void serializePayoutImpl(xmstream &stream, const PayoutDbRecord &payout, const CCoinInfo &coinInfo, uint32_t fields)
+{
+  ObjectTy object(stream);
+  if (fields & pfTime)
+    object.addInt("time", payout.Time);
+  if (fields & pfTxid)
+    object.addString("txid", payout.TransactionId);
+  if (fields & pfValue)
+    addMoney(object, "value", payout.Value, coinInfo.RationalPartSize);
+  if (fields & pfStatus)
+    object.addInt("status", payout.Status);
+}
+
+template<typename ObjectTy, typename ArrayTy>
+static void serializePayoutsImpl(xmstream &stream, const std::vector<PayoutDbRecord> &payouts, const CCoinInfo &coinInfo, uint32_t fields)
+{
+  ObjectTy response(stream);
+  response.addString("status", "ok");
+  response.addField("payouts");
+  {
+    ArrayTy payoutsArray(stream);
+    for (size_t i = 0, ie = payouts.size(); i != ie; ++i) {
+      payoutsArray.addField();
+      serializePayoutImpl<ObjectTy>(stream, payouts[i], coinInfo, fields);
+    }
+  }
+}
+
+void serializeUserStats(xmstream &stream,
+                        EReplyFormat format,
+                        const CCoinInfo &coinInfo,
+                        int64_t currentTime,
+                        const StatisticDb::CStats &aggregate,
+                        const std::vector<StatisticDb::CStats> &workers,
+                        uint32_t workerFields)
+{
+  if (format == rfCbor)
+    serializeUserStatsImpl<CBOR::Object, CBOR::Array>(stream, coinInfo, currentTime, aggregate, workers, workerFields);
+  else if (FastJSON::enabled())
+    serializeUserStatsImpl<FastJSON::Object, FastJSON::Array>(stream, coinInfo, currentTime, aggregate, workers, workerFields);
+  else
+    serializeUserStatsImpl<JSON::Object, JSON::Array>(stream, coinInfo, currentTime, aggregate, workers, workerFields);
+}
+
+void serializeStatsHistoryRow(xmstream &stream, EReplyFormat format, const StatisticDb::CStats &stats, uint32_t fields)
+{
+  if (format == rfCbor)
+    serializeStatsHistoryRowImpl<CBOR::Object>(stream, stats, fields);
+  else if (FastJSON::enabled())
+    serializeStatsHistoryRowImpl<FastJSON::Object>(stream, stats, fields);
+  else
+    serializeStatsHistoryRowImpl<JSON::Object>(stream, stats, fields);
+}
+
+void serializeUserRow(xmstream &stream, EReplyFormat format, const StatisticDb::CredentialsWithStatistic &user, uint32_t fields)
+{
+  if (format == rfCbor)
+    serializeUserRowImpl<CBOR::Object>(stream, user, fields);
+  else if (FastJSON::enabled())
+    serializeUserRowImpl<FastJSON::Object>(stream, user, fields);
+  else
+    serializeUserRowImpl<JSON::Object>(stream, user, fields);
+}
+
+void serializeFoundBlock(xmstream &stream, EReplyFormat format, const FoundBlockRecord &block, int64_t confirmations, const CCoinInfo &coinInfo, uint32_t fields)
+{
+  if (format == rfCbor)
+    serializeFoundBlockImpl<CBOR::Object>(stream, block, confirmations, coinInfo, fields);
+  else if (FastJSON::enabled())
+    serializeFoundBlockImpl<FastJSON::Object>(stream, block, confirmations, coinInfo, fields);
+  else
+    serializeFoundBlockImpl<JSON::Object>(stream, block, confirmations, coinInfo, fields);
+}
+
+void serializePayouts(xmstream &stream, EReplyFormat format, const std::vector<PayoutDbRecord> &payouts, const CCoinInfo &coinInfo, uint32_t fields)
+{
+  if (format == rfCbor)
+    serializePayoutsImpl<CBOR::Object, CBOR::Array>(stream, payouts, coinInfo, fields);
+  else if (FastJSON::enabled())
+    serializePayoutsImpl<FastJSON::Object, FastJSON::Array>(stream, payouts, coinInfo, fields);
+  else
+    serializePayoutsImpl<JSON::Object, JSON::Array>(stream, payouts, coinInfo, fields);
+}
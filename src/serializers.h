@@ -0,0 +1,42 @@
+#pragma once
+
+#include "cbor.h"
+#include "poolcore/backend.h"
+#include "p2putils/xmstream.h"
+#include <string_view>
+#include <vector>
+#include <stdint.h>
+
+// Objects of data-heavy API replies, shared by request handlers and handlerbench
+// Each one is written as JSON or CBOR, with the same schema
+
+// Rows with projection by 'fields' request argument
+enum ERowType {
+  rtWorkerStats = 0,
+  rtStatsHistory,
+  rtUser,
+  rtFoundBlock,
+  rtPayout
+};
+
+// Set of row fields: bit N is N-th field of row in reply order
+static constexpr uint32_t AllFields = UINT32_MAX;
+// Bit of field with given name, 0 for unknown name
+uint32_t rowFieldBit(ERowType type, std::string_view name);
+
+// backendQueryUserStats reply
+void serializeUserStats(xmstream &stream,
+                        EReplyFormat format,
+                        const CCoinInfo &coinInfo,
+                        int64_t currentTime,
+                        const StatisticDb::CStats &aggregate,
+                        const std::vector<StatisticDb::CStats> &workers,
+                        uint32_t workerFields);
+// Row of backendQueryUserStatsHistory/backendQueryWorkerStatsHistory
+void serializeStatsHistoryRow(xmstream &stream, EReplyFormat format, const StatisticDb::CStats &stats, uint32_t fields);
+// Row of userEnumerateAll
+void serializeUserRow(xmstream &stream, EReplyFormat format, const StatisticDb::CredentialsWithStatistic &user, uint32_t fields);
+// Row of backendQueryFoundBlocks
+void serializeFoundBlock(xmstream &stream, EReplyFormat format, const FoundBlockRecord &block, int64_t confirmations, const CCoinInfo &coinInfo, uint32_t fields);
+// backendQueryPayouts reply
+void serializePayouts(xmstream &stream, EReplyFormat format, const std::vector<PayoutDbRecord> &payouts, const CCoinInfo &coinInfo, uint32_t fields);
@@ -0,0 +1,90 @@
+#include "sessionCache.h"
+#include <unordered_map>
+#include <time.h>
+
+namespace {
+struct CEntry {
+  UserManager::UserWithAccessRights TokenInfo;
+  int64_t ExpireTime;
+};
+
+struct CThreadTable {
+  const CSessionCache *Owner = nullptr;
+  uint64_t Epoch = 0;
+  std::unordered_map<std::string, CEntry> Entries;
+};
+}
+
+static inline void makeKey(std::string &key, const std::string &id, const std::string &targetLogin, bool needWriteAccess)
+{
+  key.assign(id);
+  key.push_back('\0');
+  key.append(targetLogin);
+  key.push_back(needWriteAccess ? 'w' : 'r');
+}
+
+// Table of calling thread, cleared if cache invalidated after last access
+static CThreadTable &threadTable(const CSessionCache *owner, uint64_t epoch)
+{
+  static thread_local CThreadTable table;
+  if (table.Owner != owner || table.Epoch != epoch) {
+    table.Entries.clear();
+    table.Owner = owner;
+    table.Epoch = epoch;
+  }
+
+  return table;
+}
+
+bool CSessionCache::get(const std::string &id, const std::string &targetLogin, bool needWriteAccess, UserManager::UserWithAccessRights &tokenInfo)
+{
+  static thread_local std::string key;
+  CThreadTable &table = threadTable(this, epoch());
+  makeKey(key, id, targetLogin, needWriteAccess);
+  auto It = table.Entries.find(key);
+  if (It != table.Entries.end()) {
+    if (It->second.ExpireTime > time(nullptr)) {
+      tokenInfo = It->second.TokenInfo;
+      Hits_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+
+    table.Entries.erase(It);
+  }
+
+  Misses_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+void CSessionCache::put(const std::string &id, const std::string &targetLogin, bool needWriteAccess, uint64_t epoch, const UserManager::UserWithAccessRights &tokenInfo)
+{
+  // Session validated before invalidation
+  if (epoch != this->epoch())
+    return;
+
+  int64_t currentTime = time(nullptr);
+  CThreadTable &table = threadTable(this, epoch);
+  if (table.Entries.size() >= MaxEntries_) {
+    for (auto It = table.Entries.begin(); It != table.Entries.end();) {
+      if (It->second.ExpireTime <= currentTime)
+        It = table.Entries.erase(It);
+      else
+        ++It;
+    }
+
+    if (table.Entries.size() >= MaxEntries_)
+      return;
+  }
+
+  std::string key;
+  makeKey(key, id, targetLogin, needWriteAccess);
+  CEntry &entry = table.Entries[key];
+  entry.TokenInfo = tokenInfo;
+  entry.ExpireTime = currentTime + TTL_;
+}
+
+void CSessionCache::invalidate()
+{
+  Epoch_.fetch_add(1, std::memory_order_acq_rel);
+  Invalidations_.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "poolcore/usermgr.h"
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+// Validated sessions cached by every HTTP thread in its own table, lookups don't take any locks
+// Logout and password change increment global epoch, all thread tables drop their entries on next access
+class CSessionCache {
+public:
+  CSessionCache(unsigned ttl, size_t maxEntries) : TTL_(ttl), MaxEntries_(maxEntries) {}
+
+  bool enabled() const { return TTL_ != 0; }
+  uint64_t epoch() const { return Epoch_.load(std::memory_order_acquire); }
+
+  bool get(const std::string &id, const std::string &targetLogin, bool needWriteAccess, UserManager::UserWithAccessRights &tokenInfo);
+  // Only valid sessions stored; epoch must be taken before validation
+  void put(const std::string &id, const std::string &targetLogin, bool needWriteAccess, uint64_t epoch, const UserManager::UserWithAccessRights &tokenInfo);
+  void invalidate();
+
+  uint64_t hits() const { return Hits_.load(std::memory_order_relaxed); }
+  uint64_t misses() const { return Misses_.load(std::memory_order_relaxed); }
+  uint64_t invalidations() const { return Invalidations_.load(std::memory_order_relaxed); }
+
+private:
+  unsigned TTL_;
+  size_t MaxEntries_;
+  std::atomic<uint64_t> Epoch_ = 0;
+  std::atomic<uint64_t> Hits_ = 0;
+  std::atomic<uint64_t> Misses_ = 0;
+  std::atomic<uint64_t> Invalidations_ = 0;
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "cbor.h"
+#include "fastJson.h"
+#include "poolcommon/jsonSerializer.h"
+#include "p2putils/xmstream.h"
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Size of serialized part after which it sent to socket
+static constexpr size_t StreamingReplyChunkSize = 32768;
+
+// Response serialized and sent by parts, next part built after previous one written to socket
+// All parts are written to the same stream object, so serializer state can live between calls
+class CStreamingReply {
+public:
+  virtual ~CStreamingReply() {}
+  // Append next part to stream, returns false after last part
+  virtual bool next(xmstream &stream) = 0;
+  // First part sent, rest of reply outlives backend callback and its arguments
+  virtual void detach() {}
+};
+
+// Rows of array reply: one or more vectors of same size, element i of each vector makes row i
+// Borrowed vectors (backend callback arguments) are copied on detach, only rows not sent yet
+template<typename... T>
+class CReplyRows {
+public:
+  CReplyRows(const std::vector<T>&... rows) : Borrowed_(&rows...), Size_(std::get<0>(Borrowed_)->size()) {}
+  CReplyRows(std::vector<T>&&... rows) : Owned_(std::move(rows)...), Size_(std::get<0>(Owned_).size()) {}
+
+  size_t size() const { return Size_; }
+
+  template<typename RowFn>
+  void row(RowFn &fn, xmstream &stream, size_t i) const { row(fn, stream, i, std::index_sequence_for<T...>()); }
+
+  void detach(size_t first) {
+    if (!std::get<0>(Borrowed_))
+      return;
+    detach(first, std::index_sequence_for<T...>());
+  }
+
+private:
+  template<typename RowFn, size_t... I>
+  void row(RowFn &fn, xmstream &stream, size_t i, std::index_sequence<I...>) const {
+    if (std::get<0>(Borrowed_))
+      fn(stream, (*std::get<I>(Borrowed_))[i]...);
+    else
+      fn(stream, std::get<I>(Owned_)[i - Offset_]...);
+  }
+
+  template<size_t... I>
+  void detach(size_t first, std::index_sequence<I...>) {
+    (std::get<I>(Owned_).assign(std::get<I>(Borrowed_)->begin() + first, std::get<I>(Borrowed_)->end()), ...);
+    ((std::get<I>(Borrowed_) = nullptr), ...);
+    Offset_ = first;
+  }
+
+private:
+  std::tuple<const std::vector<T>*...> Borrowed_ = {};
+  std::tuple<std::vector<T>...> Owned_;
+  size_t Size_;
+  // Index of first owned row
+  size_t Offset_ = 0;
+};
+
+// Object with array as last field: {<header fields>, "<arrayName>": [<rows>]}
+// Header function is called with object of reply format (JSON::Object, FastJSON::Object or CBOR::Object),
+// row function with stream and elements of row
+template<typename ObjectTy, typename ArrayTy, typename RowsTy, typename HeaderFn, typename RowFn>
+class CArrayStreamingReply : public CStreamingReply {
+public:
+  CArrayStreamingReply(const char *arrayName, RowsTy &&rows, HeaderFn &&header, RowFn &&row) :
+    ArrayName_(arrayName), Rows_(std::move(rows)), Header_(std::move(header)), Row_(std::move(row)) {}
+
+  bool next(xmstream &stream) override {
+    if (!Object_) {
+      Object_.emplace(stream);
+      Header_(*Object_);
+      Object_->addField(ArrayName_);
+      Array_.emplace(stream);
+    }
+
+    while (Index_ < Rows_.size() && stream.sizeOf() < StreamingReplyChunkSize) {
+      Array_->addField();
+      Rows_.row(Row_, stream, Index_++);
+    }
+
+    if (Index_ < Rows_.size())
+      return true;
+
+    // Write closing brackets
+    Array_.reset();
+    Object_.reset();
+    return false;
+  }
+
+  void detach() override { Rows_.detach(Index_); }
+
+private:
+  const char *ArrayName_;
+  RowsTy Rows_;
+  size_t Index_ = 0;
+  HeaderFn Header_;
+  RowFn Row_;
+  std::optional<ObjectTy> Object_;
+  std::optional<ArrayTy> Array_;
+};
+
+template<typename RowsTy, typename HeaderFn, typename RowFn>
+std::unique_ptr<CStreamingReply> arrayStreamingReply(EReplyFormat format, const char *arrayName, RowsTy rows, HeaderFn header, RowFn row)
+{
+  if (format == rfCbor)
+    return std::make_unique<CArrayStreamingReply<CBOR::Object, CBOR::Array, RowsTy, HeaderFn, RowFn>>(arrayName, std::move(rows), std::move(header), std::move(row));
+  else if (FastJSON::enabled())
+    return std::make_unique<CArrayStreamingReply<FastJSON::Object, FastJSON::Array, RowsTy, HeaderFn, RowFn>>(arrayName, std::move(rows), std::move(header), std::move(row));
+  else
+    return std::make_unique<CArrayStreamingReply<JSON::Object, JSON::Array, RowsTy, HeaderFn, RowFn>>(arrayName, std::move(rows), std::move(header), std::move(row));
+}
@@ -0,0 +1,211 @@
+#include "threadUsage.h"
+#include "requestStats.h"
+#include "loguru.hpp"
+#include <algorithm>
+#include <chrono>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+static bool readFile(const char *path, char *buffer, size_t size)
+{
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return false;
+  size_t bytesRead = fread(buffer, 1, size - 1, file);
+  fclose(file);
+  buffer[bytesRead] = 0;
+  return bytesRead != 0;
+}
+
+// Thread CPU time in microseconds
+static bool threadCpuTime(int tid, uint64_t &cpuTime)
+{
+  char path[64];
+  char data[512];
+
+  // Nanoseconds on CPU, available if kernel has scheduler statistics
+  snprintf(path, sizeof(path), "/proc/self/task/%d/schedstat", tid);
+  if (readFile(path, data, sizeof(data))) {
+    cpuTime = strtoull(data, nullptr, 10) / 1000;
+    return true;
+  }
+
+  // utime and stime (fields 14 and 15) in clock ticks; thread name can contain spaces, skip it
+  snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+  if (!readFile(path, data, sizeof(data)))
+    return false;
+  const char *p = strrchr(data, ')');
+  if (!p)
+    return false;
+  for (unsigned field = 2; field < 14 && p; field++)
+    p = strchr(p + 1, ' ');
+  if (!p)
+    return false;
+  char *end = nullptr;
+  uint64_t utime = strtoull(p + 1, &end, 10);
+  uint64_t stime = strtoull(end, nullptr, 10);
+  cpuTime = (utime + stime) * 1000000 / sysconf(_SC_CLK_TCK);
+  return true;
+}
+#endif
+
+void CThreadUsage::start()
+{
+#if defined(__linux__)
+  sample();
+  Thread_ = std::thread([this]() { run(); });
+#endif
+}
+
+void CThreadUsage::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    Stopped_ = true;
+  }
+
+  StopCv_.notify_all();
+  if (Thread_.joinable())
+    Thread_.join();
+}
+
+std::vector<CThreadUsage::CThreadStats> CThreadUsage::threads()
+{
+  std::vector<CThreadStats> result;
+  std::lock_guard<std::mutex> lock(Mutex_);
+  result.reserve(Threads_.size());
+  for (const auto &It: Threads_) {
+    const CThread &thread = It.second;
+    CThreadStats &stats = result.emplace_back();
+    stats.Name = thread.Name;
+    stats.Group = thread.Group;
+    stats.CpuTime = thread.CpuTime[(Tick_ - 1) % HistorySize];
+    for (size_t i = 0; i < WindowsNum; i++)
+      stats.Utilization[i] = utilization(thread, Windows[i]);
+  }
+
+  return result;
+}
+
+std::vector<CThreadUsage::CGroupStats> CThreadUsage::groups()
+{
+  std::vector<CGroupStats> result;
+  std::lock_guard<std::mutex> lock(Mutex_);
+  for (const auto &It: Threads_) {
+    const CThread &thread = It.second;
+    auto groupIt = std::find_if(result.begin(), result.end(), [&thread](const CGroupStats &group) { return group.Name == thread.Group; });
+    if (groupIt == result.end()) {
+      groupIt = result.insert(result.end(), CGroupStats{thread.Group, 0, {}});
+    }
+
+    groupIt->ThreadsNum++;
+    for (size_t i = 0; i < WindowsNum; i++)
+      groupIt->Utilization[i] += utilization(thread, Windows[i]);
+  }
+
+  for (auto &group: result) {
+    for (size_t i = 0; i < WindowsNum; i++)
+      group.Utilization[i] /= group.ThreadsNum;
+  }
+
+  std::sort(result.begin(), result.end(), [](const CGroupStats &l, const CGroupStats &r) { return l.Name < r.Name; });
+  return result;
+}
+
+void CThreadUsage::run()
+{
+  loguru::set_thread_name("thread_usage");
+  std::unique_lock<std::mutex> lock(Mutex_);
+  while (!StopCv_.wait_for(lock, std::chrono::seconds(1), [this]() { return Stopped_; })) {
+    lock.unlock();
+    sample();
+    lock.lock();
+  }
+}
+
+void CThreadUsage::sample()
+{
+#if defined(__linux__)
+  // Read /proc without lock, it takes ~10us per thread
+  struct CSample {
+    int Tid;
+    uint64_t CpuTime;
+    std::string Name;
+  };
+
+  std::vector<CSample> samples;
+  DIR *dir = opendir("/proc/self/task");
+  if (!dir)
+    return;
+  while (dirent *entry = readdir(dir)) {
+    if (!isdigit(static_cast<unsigned char>(entry->d_name[0])))
+      continue;
+
+    CSample sample;
+    sample.Tid = atoi(entry->d_name);
+    if (!threadCpuTime(sample.Tid, sample.CpuTime))
+      continue;
+
+    char path[64];
+    char name[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/comm", sample.Tid);
+    if (!readFile(path, name, sizeof(name)))
+      continue;
+    name[strcspn(name, "\n")] = 0;
+    sample.Name = name;
+    samples.push_back(std::move(sample));
+  }
+  closedir(dir);
+
+  int64_t now = monotonicTimeUs();
+  std::lock_guard<std::mutex> lock(Mutex_);
+  uint64_t tick = Tick_++;
+  TickTime_[tick % HistorySize] = now;
+
+  std::map<int, CThread> threads;
+  for (auto &sample: samples) {
+    auto It = Threads_.find(sample.Tid);
+    CThread &thread = threads[sample.Tid];
+    if (It != Threads_.end() && It->second.Name == sample.Name) {
+      thread = It->second;
+    } else {
+      // New thread or thread renamed itself after start
+      thread.Name = sample.Name;
+      thread.Group = sample.Name;
+      while (!thread.Group.empty() && isdigit(static_cast<unsigned char>(thread.Group.back())))
+        thread.Group.pop_back();
+      if (thread.Group.empty())
+        thread.Group = thread.Name;
+      thread.FirstTick = tick;
+    }
+
+    thread.CpuTime[tick % HistorySize] = sample.CpuTime;
+  }
+
+  // Exited threads removed
+  Threads_.swap(threads);
+#endif
+}
+
+double CThreadUsage::utilization(const CThread &thread, unsigned window)
+{
+  if (Tick_ == 0)
+    return 0.0;
+
+  uint64_t last = Tick_ - 1;
+  uint64_t first = last - std::min<uint64_t>(window, last - thread.FirstTick);
+  if (first == last)
+    return 0.0;
+
+  int64_t wallTime = TickTime_[last % HistorySize] - TickTime_[first % HistorySize];
+  uint64_t cpuTime = thread.CpuTime[last % HistorySize] - thread.CpuTime[first % HistorySize];
+  return wallTime > 0 ? std::min(100.0, cpuTime * 100.0 / wallTime) : 0.0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <condition_variable>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+// CPU time of all process threads sampled once per second (Linux only, from /proc/self/task)
+// Utilization of thread is its CPU time divided by wall time over window (CPU utilization, not event loop
+// occupancy); time spent blocked in poller, in I/O or waiting for CPU is idle time. Threads with the same name prefix (http0, http1, ...) form a group.
+class CThreadUsage {
+public:
+  // Window lengths, seconds
+  static constexpr unsigned Windows[] = {10, 60};
+  static constexpr size_t WindowsNum = std::size(Windows);
+
+  struct CThreadStats {
+    std::string Name;
+    std::string Group;
+    // Microseconds since thread start
+    uint64_t CpuTime;
+    // Percents
+    double Utilization[WindowsNum];
+  };
+
+  struct CGroupStats {
+    std::string Name;
+    unsigned ThreadsNum;
+    // Average of group threads, percents
+    double Utilization[WindowsNum];
+  };
+
+public:
+  ~CThreadUsage() { stop(); }
+
+  void start();
+  void stop();
+
+  std::vector<CThreadStats> threads();
+  std::vector<CGroupStats> groups();
+
+private:
+  static constexpr size_t HistorySize = 61;
+
+  struct CThread {
+    std::string Name;
+    std::string Group;
+    uint64_t FirstTick;
+    // Cumulative CPU time by tick, microseconds
+    uint64_t CpuTime[HistorySize];
+  };
+
+private:
+  void run();
+  void sample();
+  // Must be called with locked mutex
+  double utilization(const CThread &thread, unsigned window);
+
+private:
+  std::mutex Mutex_;
+  std::condition_variable StopCv_;
+  bool Stopped_ = false;
+  uint64_t Tick_ = 0;
+  // Wall time by tick, microseconds
+  int64_t TickTime_[HistorySize];
+  std::map<int, CThread> Threads_;
+  std::thread Thread_;
+};
@@ -0,0 +1,122 @@
+#include "tracing.h"
+#include "poolcommon/jsonSerializer.h"
+#include "loguru.hpp"
+#include <algorithm>
+#include <string>
+
+namespace {
+// Thread names by trace thread id, filled on first span recorded by thread
+struct CThreadRegistry {
+  std::mutex Mutex;
+  std::vector<std::string> Names;
+};
+}
+
+static CThreadRegistry &threadRegistry()
+{
+  static CThreadRegistry registry;
+  return registry;
+}
+
+static unsigned currentThreadId()
+{
+  static thread_local unsigned id = []() {
+    char name[64];
+    loguru::get_thread_name(name, sizeof(name), false);
+    CThreadRegistry &registry = threadRegistry();
+    std::lock_guard<std::mutex> lock(registry.Mutex);
+    registry.Names.emplace_back(name);
+    return static_cast<unsigned>(registry.Names.size());
+  }();
+  return id;
+}
+
+void CTrace::span(const char *name, int64_t begin, int64_t end)
+{
+  // Phase not reached by request (cached or rejected reply)
+  if (!begin || end < begin)
+    return;
+
+  unsigned threadId = currentThreadId();
+  std::lock_guard<std::mutex> lock(Mutex_);
+  Spans_.push_back(CTraceSpan{name, threadId, begin, end});
+}
+
+std::vector<CTraceSpan> CTrace::spans()
+{
+  std::lock_guard<std::mutex> lock(Mutex_);
+  return Spans_;
+}
+
+std::shared_ptr<CTrace> CTracer::start(std::string_view function)
+{
+  if (!enabled())
+    return nullptr;
+
+  uint64_t request = Requests_.fetch_add(1, std::memory_order_relaxed);
+  if (request % SampleInterval_ != 0)
+    return nullptr;
+
+  Sampled_.fetch_add(1, std::memory_order_relaxed);
+  return std::make_shared<CTrace>(request, function);
+}
+
+void CTracer::finish(std::shared_ptr<CTrace> &&trace)
+{
+  std::lock_guard<std::mutex> lock(Mutex_);
+  Traces_.push_back(std::move(trace));
+  while (Traces_.size() > MaxTraces_)
+    Traces_.pop_front();
+}
+
+void CTracer::dump(xmstream &stream, size_t limit)
+{
+  std::vector<std::shared_ptr<CTrace>> traces;
+  {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    size_t tracesNum = std::min(limit, Traces_.size());
+    traces.assign(Traces_.end() - tracesNum, Traces_.end());
+  }
+
+  std::vector<unsigned> threads;
+  JSON::Array events(stream);
+  for (const auto &trace: traces) {
+    std::string function(trace->function());
+    for (const auto &span: trace->spans()) {
+      if (std::find(threads.begin(), threads.end(), span.ThreadId) == threads.end())
+        threads.push_back(span.ThreadId);
+
+      events.addField();
+      JSON::Object event(stream);
+      event.addString("name", span.Name);
+      event.addString("cat", function);
+      event.addString("ph", "X");
+      event.addInt("ts", span.Begin);
+      event.addInt("dur", span.End - span.Begin);
+      event.addInt("pid", 1);
+      event.addInt("tid", span.ThreadId);
+      event.addField("args");
+      {
+        JSON::Object args(stream);
+        args.addInt("trace", trace->id());
+      }
+    }
+  }
+
+  // Metadata events, viewer shows thread names instead of ids
+  CThreadRegistry &registry = threadRegistry();
+  std::lock_guard<std::mutex> lock(registry.Mutex);
+  for (unsigned threadId: threads) {
+    events.addField();
+    JSON::Object event(stream);
+    event.addString("name", "thread_name");
+    event.addString("ph", "M");
+    event.addInt("pid", 1);
+    event.addInt("tid", threadId);
+    event.addField("args");
+    {
+      JSON::Object args(stream);
+      args.addString("name", registry.Names[threadId - 1]);
+    }
+  }
+}
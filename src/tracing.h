@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+#include <stdint.h>
+
+class xmstream;
+
+// Interval of request processing on one thread, monotonic microseconds
+struct CTraceSpan {
+  // Static string
+  const char *Name;
+  unsigned ThreadId;
+  int64_t Begin;
+  int64_t End;
+};
+
+// Spans of one sampled request; trace pointer is captured by callback chain of request,
+// so user manager, backend loops and query pool threads add their spans too
+class CTrace {
+public:
+  CTrace(uint64_t id, std::string_view function) : Id_(id), Function_(function) {}
+
+  // Span on current thread
+  void span(const char *name, int64_t begin, int64_t end);
+
+  uint64_t id() const { return Id_; }
+  std::string_view function() const { return Function_; }
+  std::vector<CTraceSpan> spans();
+
+private:
+  uint64_t Id_;
+  std::string_view Function_;
+  // Calls of batch request add spans in parallel
+  std::mutex Mutex_;
+  std::vector<CTraceSpan> Spans_;
+};
+
+// Traces every N-th request and keeps last finished traces
+class CTracer {
+public:
+  CTracer(unsigned sampleInterval, size_t maxTraces) : SampleInterval_(sampleInterval), MaxTraces_(maxTraces) {}
+
+  bool enabled() const { return SampleInterval_ != 0 && MaxTraces_ != 0; }
+  // Returns nullptr if request is not sampled
+  std::shared_ptr<CTrace> start(std::string_view function);
+  void finish(std::shared_ptr<CTrace> &&trace);
+
+  // Last 'limit' traces as array of Chrome trace events (chrome://tracing, Perfetto UI)
+  void dump(xmstream &stream, size_t limit);
+
+  uint64_t sampled() const { return Sampled_.load(std::memory_order_relaxed); }
+
+private:
+  unsigned SampleInterval_;
+  size_t MaxTraces_;
+  std::atomic<uint64_t> Requests_ = 0;
+  std::atomic<uint64_t> Sampled_ = 0;
+  std::mutex Mutex_;
+  std::deque<std::shared_ptr<CTrace>> Traces_;
+};
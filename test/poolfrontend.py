@@ -226,3 +226,37 @@ class Poolfrontend:
 
     def instanceEnumerateAll(self, requiredStatus=None, debug=None):
         return self.__call__("instanceEnumerateAll", {}, requiredStatus, debug)
+
+    def batch(self, calls, sessionId=None, requiredStatus=None, debug=None):
+        data = {"calls": [{"function": function, "params": params} for function, params in calls]}
+        if sessionId is not None:
+            data.update({"id": sessionId})
+        return self.__call__("batch", data, requiredStatus, debug)
+
+    def serverStats(self, adminSessionId, requiredStatus=None, debug=None):
+        return self.__call__("serverStats", {"id": adminSessionId}, requiredStatus, debug)
+
+    def serverTraces(self, adminSessionId, limit=None, requiredStatus=None, debug=None):
+        data = {"id": adminSessionId}
+        if limit is not None:
+            data["limit"] = limit
+        return self.__call__("serverTraces", data, requiredStatus, debug)
+
+    def eventSubscribe(self, topics, sessionId=None, coins=None, targetLogin=None):
+        data = {"topics": topics}
+        if sessionId is not None:
+            data.update({"id": sessionId})
+        if coins is not None:
+            data.update({"coins": coins})
+        if targetLogin is not None:
+            data.update({"targetLogin": targetLogin})
+        # Yields (event, data) pairs until connection closed
+        event = None
+        with requests.post(self.URL + "/eventSubscribe", json=data, stream=True) as response:
+            for line in response.iter_lines(decode_unicode=True):
+                if line.startswith("event: "):
+                    event = line[7:]
+                elif line.startswith("data: "):
+                    yield event, json.loads(line[6:])
+                elif line.startswith("{"):
+                    yield None, json.loads(line)